@@ -0,0 +1,550 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "cnetsim.h"
+
+/*  THIS FILE PROVIDES THE cnet API FUNCTIONS CALLED BY PROTOCOLS, AND
+    DISPATCHES EACH EVENT TO THE HANDLER OF THE NODE AT WHICH IT OCCURS.
+
+    As in cnet, each message generated by a node's Application Layer
+    carries (hidden from the protocol) its source, destination, sequence
+    number and a checksum, so that CNET_write_application() can report
+    corrupted, misdelivered, duplicated and missing messages.
+
+    All randomness (message sizes and destinations, frame loss and
+    corruption) comes from each node's own generator, seeded from the
+    command line, so every run with the same seed is identical.  When a
+    recorded workload is replayed, the messages' destinations and sizes
+    come from the trace instead (see workload.c).
+ */
+
+__thread CnetNodeInfo	nodeinfo;
+__thread CnetLinkInfo	*linkinfo	= NULL;
+__thread int		cnet_errno	= ER_OK;
+
+__thread NODE		*sim_thisnode	= NULL;
+__thread EVENT		*sim_thisevent	= NULL;
+
+typedef struct {
+    int32_t		src;			// node numbers
+    int32_t		dest;
+    int32_t		seq;
+    uint32_t		length;			// of the whole message
+    CnetTime		created;
+    uint32_t		checksum;		// of the whole message
+} MSGHEADER;
+
+#define	FAIL(err)	do { cnet_errno = (err); return(-1); } while(0)
+
+static const char *errors[N_CNET_ERRORS] = {
+    "no error", "invalid argument", "invalid event", "invalid link number",
+    "invalid node", "invalid sender", "invalid session", "invalid size",
+    "invalid timer", "corrupted data", "duplicate message", "link is down",
+    "message missing", "not for me", "not ready", "not supported",
+    "too busy"
+};
+
+const char *sim_errstr(int err)
+{
+    return (err >= 0 && err < N_CNET_ERRORS) ? errors[err] : "unknown error";
+}
+
+//  xorshift64*, WHICH IS SMALL, FAST AND GOOD ENOUGH FOR A SIMULATION
+uint64_t sim_rand(uint64_t *state)
+{
+    uint64_t	x	= *state;
+
+    x		^= x >> 12;
+    x		^= x << 25;
+    x		^= x >> 27;
+    *state	= x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+// -----------------------------------------------------------------
+
+//  EVENTS ARE ORDERED BY THEIR CREATOR'S COUNT, SO NEVER BY CHANCE
+void sim_schedule(NODE *creator, EVENT *e)
+{
+    e->creator	= (int)(creator - sim_nodes);
+    e->cseq	= ++creator->cseq;
+    sim_partition_push(&sim_partitions[sim_nodes[e->node].partition], e);
+}
+
+void sim_schedule_message(NODE *n, CnetTime when)
+{
+    EVENT	*e	= sim_newevent();
+
+    e->time	= when;
+    e->node	= (int)(n - sim_nodes);
+    e->kind	= SE_MESSAGE;
+    n->generating	= true;
+    sim_schedule(n, e);
+}
+
+//  THE NODE NUMBER HAVING THIS ADDRESS, OR -1
+int sim_findaddress(CnetAddr addr)
+{
+    if(addr >= 0 && addr < sim_nnodes && sim_nodes[addr].info.address == addr)
+	return addr;
+    for(int n=0 ; n<sim_nnodes ; ++n)
+	if(sim_nodes[n].info.address == addr)
+	    return n;
+    return -1;
+}
+
+//  A CHEAP CHECKSUM, 8 BYTES AT A TIME, AS MESSAGES MAY BE 32KB LONG
+static uint32_t msg_checksum(const char *msg, size_t len)
+{
+    uint64_t	h	= len, w;
+    size_t	i;
+
+    for(i=0 ; i+8 <= len ; i+=8) {
+	memcpy(&w, msg+i, 8);
+	h	= (h ^ w) * 0x100000001B3ULL;
+	h	^= h >> 29;
+    }
+    for( ; i<len ; ++i)
+	h	= (h ^ (unsigned char)msg[i]) * 0x100000001B3ULL;
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+/*  MAKE A MESSAGE FOR dest, OF len BYTES, AND OFFER IT TO THE PROTOCOL.
+    ITS CONTENTS DEPEND ONLY ON ITS SOURCE, DESTINATION AND SEQUENCE
+    NUMBER, SO A REPLAYED WORKLOAD DOES NOT DRAW ON THE NODE'S GENERATOR.
+ */
+void sim_makemessage(NODE *n, int dest, size_t len, CnetTime created)
+{
+    CnetNodeInfo	*ni	= &n->info;
+    MSGHEADER		h;
+    uint64_t		fill;
+
+    n->msgdest	= dest;
+    h.src	= ni->nodenumber;
+    h.dest	= dest;
+    h.seq	= n->nextseq[dest]++;
+    h.length	= (uint32_t)len;
+    h.created	= created;
+    h.checksum	= 0;
+    fill	= ((uint64_t)h.src << 48) ^ ((uint64_t)h.dest << 32) ^
+				(uint32_t)h.seq;
+    for(size_t i=sizeof(MSGHEADER) ; i<len ; i+=8) {
+	memcpy(n->msg+i, &fill, len-i < 8 ? len-i : 8);
+	fill	+= 0x9E3779B97F4A7C15ULL;
+    }
+    memcpy(n->msg, &h, sizeof(MSGHEADER));
+    h.checksum	= msg_checksum(n->msg, len);
+    memcpy(n->msg, &h, sizeof(MSGHEADER));
+    n->msglen	= len;
+
+    if(n->handlers[EV_APPLICATIONREADY] != NULL)
+	n->handlers[EV_APPLICATIONREADY](EV_APPLICATIONREADY, NULLTIMER,
+					 n->hdata[EV_APPLICATIONREADY]);
+    n->msglen	= 0;			// unread messages are lost
+}
+
+//  SE_MESSAGE - GENERATE A MESSAGE FOR A RANDOM ENABLED DESTINATION
+static void generate_message(NODE *n)
+{
+    CnetNodeInfo	*ni	= &n->info;
+    size_t		len;
+    int			k, dest;
+
+    n->generating	= false;
+    if(n->nenabled == 0)		// resumes when a destination is enabled
+	return;
+
+    k	= sim_rand(&n->simrng) % n->nenabled;
+    for(dest=0 ; ; ++dest)
+	if(n->enabled[dest] && k-- == 0)
+	    break;
+
+    len	= ni->minmessagesize;
+    if(ni->maxmessagesize > ni->minmessagesize)
+	len	+= sim_rand(&n->simrng) %
+			(ni->maxmessagesize - ni->minmessagesize + 1);
+
+    sim_makemessage(n, dest, len, sim_thisevent->time);
+
+//  THE NEXT MESSAGE, AFTER AN EXPONENTIALLY DISTRIBUTED INTERVAL
+    double	u	= (sim_rand(&n->simrng) >> 11) * (1.0 / 9007199254740992.0);
+    CnetTime	gap	= (CnetTime)(-log(1.0 - u) * ni->messagerate) + 1;
+
+    sim_schedule_message(n, sim_thisevent->time + gap);
+}
+
+void sim_dispatch(EVENT *e)
+{
+    static __thread NODE	*lastnode	= NULL;
+    NODE	*n	= &sim_nodes[e->node];
+    CnetEvent	ev;
+    CnetData	data;
+
+    sim_thisnode	= n;
+    sim_thisevent	= e;
+    if(lastnode != n) {
+	nodeinfo	= n->info;
+	linkinfo	= n->links;
+	lastnode	= n;
+    }
+    nodeinfo.time_in_usec	= e->time;
+    cnet_errno	= ER_OK;
+    ++n->stats.events;
+
+    switch (e->kind) {
+    case SE_REBOOT :
+	n->reboot(EV_REBOOT, NULLTIMER, 0);
+	return;
+
+    case SE_MESSAGE :
+	if(sim_replaying)
+	    sim_replaymessage(n);
+	else
+	    generate_message(n);
+	return;
+
+    case SE_TIMER :
+	++n->stats.timers;
+	sim_timer_remove(n, e->id);
+	ev	= e->ev;
+	data	= e->data;		// timers carry their own data
+	break;
+
+    case SE_FRAME :
+	++n->stats.frames_rx;
+	ev	= EV_PHYSICALREADY;
+	data	= n->hdata[ev];
+	break;
+
+    case SE_COLLISION :
+	ev	= EV_FRAMECOLLISION;
+	data	= n->hdata[ev];
+	break;
+
+    case SE_SHUTDOWN :
+	ev	= EV_SHUTDOWN;
+	data	= n->hdata[ev];
+	break;
+
+    default :
+	ev	= EV_PERIODIC;
+	data	= n->hdata[ev];
+	break;
+    }
+    if(n->handlers[ev] != NULL)
+	n->handlers[ev](ev, e->id, data);
+}
+
+//  RAISE EV_SHUTDOWN AT EVERY NODE, ONCE THE SIMULATION HAS ENDED
+void sim_shutdown(CnetTime now)
+{
+    for(int i=0 ; i<sim_nnodes ; ++i) {
+	EVENT	*e	= sim_newevent();
+
+	e->time	= now;
+	e->node	= i;
+	e->kind	= SE_SHUTDOWN;
+	sim_dispatch(e);
+	sim_freeevent(e);
+    }
+}
+
+// -----------------------------------------------------------------
+
+void CNET_exit(const char *file, const char *function, int line)
+{
+    fflush(stdout);
+    fprintf(stderr, "%s: %s:%s():%d: %s\n", nodeinfo.nodename,
+		file, function, line, sim_errstr(cnet_errno));
+    exit(EXIT_FAILURE);
+}
+
+int CNET_set_handler(CnetEvent ev, HANDLER handler, CnetData data)
+{
+    if(ev <= EV_NULL || ev >= N_CNET_EVENTS)
+	FAIL(ER_BADEVENT);
+    sim_thisnode->handlers[ev]	= handler;
+    sim_thisnode->hdata[ev]	= data;
+    return(0);
+}
+
+int CNET_set_debug_string(CnetEvent ev, const char *str)
+{
+    if(ev < EV_DEBUG0 || ev > EV_DEBUG4)
+	FAIL(ER_BADEVENT);
+    return(0);				// there are no buttons to label
+}
+
+int CNET_read_application(CnetAddr *dest, void *msg, size_t *len)
+{
+    NODE	*n	= sim_thisnode;
+
+    if(sim_thisevent->kind != SE_MESSAGE || n->msglen == 0)
+	FAIL(ER_NOTREADY);
+    if(*len < n->msglen)
+	FAIL(ER_BADSIZE);
+    memcpy(msg, n->msg, n->msglen);
+    *len	= n->msglen;
+    *dest	= sim_nodes[n->msgdest].info.address;
+    sim_recordmessage(n, n->msgdest, n->msglen);
+    n->msglen	= 0;
+    ++n->stats.msgs_generated;
+    return(0);
+}
+
+int CNET_write_application(void *msg, size_t *len)
+{
+    NODE	*n	= sim_thisnode;
+    MSGHEADER	h;
+
+    if(*len < sizeof(MSGHEADER) || *len > MAX_MESSAGE_SIZE)
+	FAIL(ER_BADSIZE);
+    memcpy(&h, msg, sizeof(MSGHEADER));
+    ((MSGHEADER *)msg)->checksum	= 0;
+    if(h.length != *len || msg_checksum(msg, *len) != h.checksum) {
+	((MSGHEADER *)msg)->checksum	= h.checksum;
+	FAIL(ER_CORRUPTDATA);
+    }
+    ((MSGHEADER *)msg)->checksum	= h.checksum;
+
+    if(h.dest != nodeinfo.nodenumber)
+	FAIL(ER_NOTFORME);
+    if(h.src < 0 || h.src >= sim_nnodes)
+	FAIL(ER_BADSENDER);
+    if(h.seq < n->expectseq[h.src])
+	FAIL(ER_DUPLICATEMSG);
+    if(h.seq > n->expectseq[h.src])
+	FAIL(ER_MISSINGMSG);
+
+    ++n->expectseq[h.src];
+    ++n->stats.msgs_delivered;
+    n->stats.msgbytes_delivered	+= *len;
+    n->stats.delivery_time	+= sim_thisevent->time - h.created;
+    return(0);
+}
+
+//  AS IN cnet, ONLY HOSTS AND MOBILES HAVE AN APPLICATION LAYER
+static bool generates(NODE *n)
+{
+    return n->info.nodetype == NT_HOST || n->info.nodetype == NT_MOBILE;
+}
+
+static int set_application(CnetAddr dest, bool enable)
+{
+    NODE	*n	= sim_thisnode;
+    int		from	= 0, to = sim_nnodes-1;
+    bool	wasidle	= (n->nenabled == 0);
+
+    if(dest != ALLNODES) {
+	if((from = to = sim_findaddress(dest)) < 0 ||
+		from == nodeinfo.nodenumber)
+	    FAIL(ER_BADNODE);
+    }
+    for(int d=from ; d<=to ; ++d) {
+	if(d == nodeinfo.nodenumber || !generates(&sim_nodes[d]))
+	    continue;
+	if(n->enabled[d] != enable) {
+	    n->enabled[d]	= enable;
+	    n->nenabled		+= enable ? 1 : -1;
+	}
+    }
+    if(sim_replaying) {
+	if(enable)
+	    sim_replaywake(n);
+    }
+    else if(wasidle && n->nenabled > 0 && !n->generating &&
+			generates(n))
+	sim_schedule_message(n, sim_thisevent->time + n->info.messagerate);
+    return(0);
+}
+
+int CNET_enable_application(CnetAddr dest)
+{
+    return set_application(dest, true);
+}
+
+int CNET_disable_application(CnetAddr dest)
+{
+    return set_application(dest, false);
+}
+
+// -----------------------------------------------------------------
+
+int CNET_read_physical(int *link, void *frame, size_t *len)
+{
+    EVENT	*e	= sim_thisevent;
+
+    if(e->kind != SE_FRAME || e->frame == NULL)
+	FAIL(ER_NOTREADY);
+    if(*len < e->len)
+	FAIL(ER_BADSIZE);
+    memcpy(frame, e->frame, e->len);
+    *len	= e->len;
+    *link	= e->link;
+    return(0);
+}
+
+static int write_physical(int link, void *frame, size_t *len, bool reliable)
+{
+    NODE	*n	= sim_thisnode;
+    CnetTime	now	= sim_thisevent->time;
+    LINKEND	*end;
+    EVENT	*e;
+    CnetTime	txtime;
+    bool	lost	= false;
+
+    if(link < 1 || link > n->info.nlinks)
+	FAIL(ER_BADLINK);
+    if(*len == 0 || *len > (size_t)n->links[link].mtu)
+	FAIL(ER_BADSIZE);
+    end	= &n->ends[link];
+    if(end->busy_until > now)
+	FAIL(ER_TOOBUSY);
+
+    txtime	= ((CnetTime)*len * 8000000) / n->links[link].bandwidth;
+    end->busy_until	= now + txtime;
+    ++n->stats.frames_tx;
+    n->stats.framebytes_tx	+= *len;
+
+    if(!reliable && end->probframeloss > 0 &&
+	(sim_rand(&n->simrng) & ((1ULL << end->probframeloss) - 1)) == 0) {
+	++n->stats.frames_lost;
+	if(end->segment == NULL)
+	    return(0);
+	lost	= true;			// but it still occupies the segment
+    }
+
+    e		= sim_newevent();
+    e->time	= now + txtime + n->links[link].propagationdelay;
+    e->node	= end->peer;
+    e->kind	= SE_FRAME;
+    e->link	= end->peerlink;
+    e->len	= *len;
+    e->frame	= malloc(*len);
+    memcpy(e->frame, frame, *len);
+
+    if(!reliable && !lost && end->probframecorrupt > 0 &&
+	(sim_rand(&n->simrng) & ((1ULL << end->probframecorrupt) - 1)) == 0) {
+	uint64_t	r	= sim_rand(&n->simrng);
+
+	e->frame[(r >> 8) % *len]	^= (char)((r & 0x7f) | 1);
+	++n->stats.frames_corrupted;
+    }
+    if(end->segment != NULL)
+	sim_segment_send(n, link, e, txtime, lost);
+    else
+	sim_schedule(n, e);
+    return(0);
+}
+
+int CNET_write_physical(int link, void *frame, size_t *len)
+{
+    return write_physical(link, frame, len, false);
+}
+
+int CNET_write_physical_reliable(int link, void *frame, size_t *len)
+{
+    return write_physical(link, frame, len, true);
+}
+
+//  1 IF ANOTHER NODE'S FRAME IS PASSING US ON A LAN OR WLAN, ELSE 0
+int CNET_carrier_sense(int link)
+{
+    NODE	*n	= sim_thisnode;
+
+    if(link < 1 || link > n->info.nlinks)
+	FAIL(ER_BADLINK);
+    if(n->ends[link].segment == NULL)
+	FAIL(ER_NOTSUPPORTED);		// a WAN link has no carrier to sense
+    return sim_segment_busy(n->ends[link].segment, nodeinfo.nodenumber,
+				sim_thisevent->time) ? 1 : 0;
+}
+
+// -----------------------------------------------------------------
+
+CnetTimerID CNET_start_timer(CnetEvent ev, CnetTime usecs, CnetData data)
+{
+    NODE	*n	= sim_thisnode;
+    EVENT	*e;
+
+    if(ev < EV_TIMER0 || ev > EV_TIMER9) {
+	cnet_errno	= ER_BADEVENT;
+	return NULLTIMER;
+    }
+    if(++n->lasttimer <= NULLTIMER)
+	n->lasttimer	= NULLTIMER+1;
+
+    e		= sim_newevent();
+    e->time	= sim_thisevent->time + (usecs > 0 ? usecs : 1);
+    e->node	= (int)(n - sim_nodes);
+    e->kind	= SE_TIMER;
+    e->ev	= ev;
+    e->id	= n->lasttimer;
+    e->data	= data;
+    sim_timer_add(n, e);
+    sim_schedule(n, e);
+    return e->id;
+}
+
+int CNET_stop_timer(CnetTimerID timer)
+{
+    EVENT	*e	= sim_timer_remove(sim_thisnode, timer);
+
+    if(e == NULL)
+	FAIL(ER_BADTIMERID);
+    e->cancelled	= true;		// discarded when it reaches the top
+    return(0);
+}
+
+// -----------------------------------------------------------------
+
+static	uint16_t	ccitt_table[256];
+
+//  CALLED ONCE, BEFORE ANY THREADS START
+void sim_ccitt_init(void)
+{
+    for(int i=0 ; i<256 ; ++i) {
+	uint16_t	c	= (uint16_t)(i << 8);
+
+	for(int b=0 ; b<8 ; ++b)
+	    c	= (c & 0x8000) ? (uint16_t)((c << 1) ^ 0x1021) : (uint16_t)(c << 1);
+	ccitt_table[i]	= c;
+    }
+}
+
+int CNET_ccitt(unsigned char *addr, int nbytes)
+{
+    uint16_t	crc	= 0;
+
+    while(nbytes-- > 0)
+	crc	= (uint16_t)((crc << 8) ^ ccitt_table[(crc >> 8) ^ *addr++]);
+    return crc;
+}
+
+uint32_t CNET_crc32(unsigned char *addr, int nbytes)
+{
+    uint32_t	crc	= 0xFFFFFFFF;
+
+    while(nbytes-- > 0) {
+	crc	^= *addr++;
+	for(int b=0 ; b<8 ; ++b)
+	    crc	= (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+int CNET_clear(void)
+{
+    return(0);				// there is no output window
+}
+
+long CNET_rand(void)
+{
+    return (long)(sim_rand(&sim_thisnode->rng) >> 33);
+}
+
+void CNET_srand(unsigned int seed)
+{
+    sim_thisnode->rng	= 0x9E3779B97F4A7C15ULL * (seed + 1);
+}
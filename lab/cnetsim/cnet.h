@@ -0,0 +1,116 @@
+#ifndef _CNET_H
+#define _CNET_H
+
+/* ------- THE SUBSET OF THE cnet API PROVIDED BY cnetsim --------
+
+   Protocol files written for cnet compile against this header unchanged.
+   Wide-area (LT_WAN) links, lansegments (LT_LAN) and wireless (LT_WLAN)
+   links are simulated.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef	__cplusplus			// so C++ protocols may include us
+extern "C" {
+#endif
+
+#define	MAX_MESSAGE_SIZE	32768
+#define	MAX_NODENAME_LEN	32
+
+typedef int		CnetAddr;
+typedef int64_t		CnetTime;
+typedef int32_t		CnetTimerID;
+typedef long		CnetData;
+
+#define	NULLTIMER	0
+#define	ALLNODES	(-1)
+
+typedef enum {
+    EV_NULL, EV_REBOOT, EV_SHUTDOWN, EV_APPLICATIONREADY, EV_PHYSICALREADY,
+    EV_FRAMECOLLISION, EV_KEYBOARDREADY, EV_LINKSTATE, EV_DRAWFRAME,
+    EV_PERIODIC,
+    EV_DEBUG0, EV_DEBUG1, EV_DEBUG2, EV_DEBUG3, EV_DEBUG4,
+    EV_TIMER0, EV_TIMER1, EV_TIMER2, EV_TIMER3, EV_TIMER4,
+    EV_TIMER5, EV_TIMER6, EV_TIMER7, EV_TIMER8, EV_TIMER9,
+    N_CNET_EVENTS
+} CnetEvent;
+
+typedef enum {
+    ER_OK, ER_BADARG, ER_BADEVENT, ER_BADLINK, ER_BADNODE, ER_BADSENDER,
+    ER_BADSESSION, ER_BADSIZE, ER_BADTIMERID, ER_CORRUPTDATA,
+    ER_DUPLICATEMSG, ER_LINKDOWN, ER_MISSINGMSG, ER_NOTFORME, ER_NOTREADY,
+    ER_NOTSUPPORTED, ER_TOOBUSY,
+    N_CNET_ERRORS
+} CnetError;
+
+typedef enum { NT_HOST, NT_ROUTER, NT_MOBILE, NT_ACCESSPOINT } CnetNodeType;
+typedef enum { LT_LOOPBACK, LT_WAN, LT_LAN, LT_WLAN } CnetLinkType;
+
+typedef struct {
+    CnetNodeType	nodetype;
+    int			nodenumber;
+    CnetAddr		address;
+    char		nodename[MAX_NODENAME_LEN];
+    int			nlinks;
+    int			minmessagesize;
+    int			maxmessagesize;
+    CnetTime		messagerate;
+    CnetTime		time_in_usec;
+} CnetNodeInfo;
+
+typedef struct {
+    CnetLinkType	linktype;
+    bool		linkup;
+    int			bandwidth;		// bits per second
+    CnetTime		propagationdelay;	// usecs
+    int			mtu;
+} CnetLinkInfo;
+
+//  THESE DESCRIBE THE NODE WHOSE EVENT IS BEING HANDLED.  THEY ARE PER-THREAD
+//  SO THAT NODES MAY BE SIMULATED IN PARALLEL.
+extern	__thread CnetNodeInfo	nodeinfo;
+extern	__thread CnetLinkInfo	*linkinfo;
+extern	__thread int		cnet_errno;
+
+#define	EVENT_HANDLER(name)	\
+		void name(CnetEvent ev, CnetTimerID timer, CnetData data)
+
+extern	void	CNET_exit(const char *file, const char *function, int line);
+
+#define	CHECK(call)	do { if((call) != 0) \
+			    CNET_exit(__FILE__, __func__, __LINE__); } while(0)
+
+extern	int	CNET_set_handler(CnetEvent ev,
+			void (*handler)(CnetEvent, CnetTimerID, CnetData),
+			CnetData data);
+extern	int	CNET_set_debug_string(CnetEvent ev, const char *str);
+
+extern	int	CNET_read_application(CnetAddr *dest, void *msg, size_t *len);
+extern	int	CNET_write_application(void *msg, size_t *len);
+extern	int	CNET_enable_application(CnetAddr dest);
+extern	int	CNET_disable_application(CnetAddr dest);
+
+extern	int	CNET_read_physical(int *link, void *frame, size_t *len);
+extern	int	CNET_write_physical(int link, void *frame, size_t *len);
+extern	int	CNET_write_physical_reliable(int link, void *frame, size_t *len);
+extern	int	CNET_carrier_sense(int link);
+
+extern	CnetTimerID	CNET_start_timer(CnetEvent ev, CnetTime usecs,
+					 CnetData data);
+extern	int	CNET_stop_timer(CnetTimerID timer);
+
+extern	int	CNET_ccitt(unsigned char *addr, int nbytes);
+extern	uint32_t CNET_crc32(unsigned char *addr, int nbytes);
+
+extern	int	CNET_clear(void);
+extern	long	CNET_rand(void);
+extern	void	CNET_srand(unsigned int seed);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif
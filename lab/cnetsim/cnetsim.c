@@ -0,0 +1,314 @@
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cnetsim.h"
+
+/*  cnetsim RUNS A cnet TOPOLOGY FILE WITHOUT cnet, AS A PLAIN DISCRETE
+    EVENT SIMULATION, SO THAT PROTOCOLS MAY BE BENCHMARKED QUICKLY AND
+    THEIR CPU COST MEASURED.  IT ACCEPTS THE SAME COMMAND LINE AS OUR
+    SCRIPTS GIVE TO cnet:
+
+	cnetsim [-q] [-s] [-m] [-e duration] [-f period] [-S seed]
+		[-D name[=value]] [-j nthreads] [-w trace | -r trace] TOPOLOGY
+
+    (-W and -T are accepted and ignored, there being no windows), and
+    prints its statistics in the same format as cnet.  Each -D is passed
+    to the C compiler, so constants such as MAXHOPS may be varied between
+    runs without editing the protocol.  With -j, the nodes are simulated
+    by several threads (see parallel.c), with identical results.  With -w
+    the messages read by each node's protocol are recorded, and with -r
+    they are replayed in place of random ones (see workload.c).  With -m
+    the heap held by each node's protocol is reported (see memory.c).
+
+    The topology's compile = "..." sources are compiled once into a shared
+    object, and each node is given its own copy of it, so each node has
+    its own copy of the protocol's global variables, as it does in cnet.
+ */
+
+#ifndef	CNETSIM_INCLUDE
+#define	CNETSIM_INCLUDE		"."		// where our cnet.h is
+#endif
+
+NODE		*sim_nodes	= NULL;
+int		sim_nnodes	= 0;
+CnetTime	sim_duration	= 3600000000LL;	// 1 hour
+CnetTime	sim_period	= 0;
+bool		sim_showstats	= false;
+
+static	bool		quiet		= false;
+static	int		nthreads	= 1;
+static	uint64_t	seed		= 1;
+static	FILE		*out;			// our statistics
+static	char		defines[1024]	= "";	// -D options for the compiler
+
+// -----------------------------------------------------------------
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+	"Usage: %s [-q] [-s] [-m] [-e duration] [-f period] [-S seed]\n"
+	"\t\t[-D name[=value]] [-j nthreads] [-w trace | -r trace] TOPOLOGY\n",
+	argv0);
+    exit(EXIT_FAILURE);
+}
+
+//  COMPILE THE TOPOLOGY'S SOURCES, RETURNING THE SHARED OBJECT'S NAME
+static char *compile(const char *topofile, const char *sources, char *tmpdir)
+{
+    const char	*slash	= strrchr(topofile, '/');
+    int		dirlen	= slash ? (int)(slash - topofile) : 1;
+    const char	*dir	= slash ? topofile : ".";
+    const char	*cc	= getenv("CC") ? getenv("CC") : "cc";
+    char	*cmd, *so, *copy, *src;
+    size_t	size	= 1024 + strlen(defines) + 2*strlen(sources) * (dirlen+2);
+
+    cmd		= malloc(size);
+    so		= malloc(strlen(tmpdir) + 16);
+    sprintf(so, "%s/protocol.so", tmpdir);
+    snprintf(cmd, size, "%s -shared -fPIC -std=c99 -O2 -Wall -I%s%s "
+		"-Wl,-Bsymbolic -o %s", cc, CNETSIM_INCLUDE, defines, so);
+
+    copy	= strdup(sources);
+    for(src=strtok(copy, " \t") ; src ; src=strtok(NULL, " \t"))
+	sprintf(cmd+strlen(cmd), " '%.*s/%s'", dirlen, dir, src);
+    strcat(cmd, " -lm");
+    free(copy);
+
+    if(system(cmd) != 0) {
+	fprintf(stderr, "cnetsim: compilation failed: %s\n", cmd);
+	exit(EXIT_FAILURE);
+    }
+    free(cmd);
+    return so;
+}
+
+//  dlopen() RETURNS THE SAME HANDLE FOR THE SAME FILE, SO EACH NODE
+//  IS GIVEN ITS OWN COPY OF THE SHARED OBJECT TO OPEN
+static void *load_copy(const char *so, const char *tmpdir, int n)
+{
+    static char	*image	= NULL;
+    static long	size	= 0;
+    char	name[1024];
+    FILE	*fp;
+    void	*dl;
+
+    if(image == NULL) {
+	if((fp = fopen(so, "rb")) == NULL) {
+	    perror(so);
+	    exit(EXIT_FAILURE);
+	}
+	fseek(fp, 0, SEEK_END);
+	size	= ftell(fp);
+	rewind(fp);
+	image	= malloc(size);
+	if(fread(image, 1, size, fp) != (size_t)size) {
+	    perror(so);
+	    exit(EXIT_FAILURE);
+	}
+	fclose(fp);
+    }
+    snprintf(name, sizeof(name), "%s/node%d.so", tmpdir, n);
+    if((fp = fopen(name, "wb")) == NULL ||
+	fwrite(image, 1, size, fp) != (size_t)size || fclose(fp) != 0) {
+	perror(name);
+	exit(EXIT_FAILURE);
+    }
+    if((dl = dlopen(name, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+	fprintf(stderr, "cnetsim: %s\n", dlerror());
+	exit(EXIT_FAILURE);
+    }
+    unlink(name);
+    return dl;
+}
+
+static void make_nodes(TOPOLOGY *topo, const char *topofile)
+{
+    const char	*sources	= topo_attr(topo->attrs, topo->nattrs, "compile");
+    char	tmpdir[]	= "/tmp/cnetsimXXXXXX";
+    char	*so;
+
+    if(sources == NULL) {
+	fprintf(stderr, "cnetsim: %s has no compile attribute\n", topofile);
+	exit(EXIT_FAILURE);
+    }
+    if(mkdtemp(tmpdir) == NULL) {
+	perror("mkdtemp");
+	exit(EXIT_FAILURE);
+    }
+    so		= compile(topofile, sources, tmpdir);
+
+    sim_makenodes(topo, seed);
+    for(int i=0 ; i<sim_nnodes ; ++i) {
+	NODE		*n	= &sim_nodes[i];
+	const char	*v	= sim_attr(topo, i, "rebootfunc");
+
+	n->dl		= load_copy(so, tmpdir, i);
+	n->reboot	= (HANDLER)dlsym(n->dl, v ? v : "reboot_node");
+	if(n->reboot == NULL) {
+	    fprintf(stderr, "cnetsim: %s() not found\n", v ? v : "reboot_node");
+	    exit(EXIT_FAILURE);
+	}
+    }
+
+    unlink(so);
+    rmdir(tmpdir);
+    free(so);
+}
+
+// -----------------------------------------------------------------
+
+//  CONVERT A TIME SUCH AS "10mins", "30secs" OR "500ms" TO usecs
+static CnetTime parse_time(const char *s)
+{
+    char	*units;
+    double	v	= strtod(s, &units);
+
+    if(strncmp(units, "us", 2) == 0)
+	return (CnetTime)v;
+    if(strncmp(units, "ms", 2) == 0)
+	return (CnetTime)(v * 1000);
+    if(*units == 'm')
+	return (CnetTime)(v * 60000000);
+    if(*units == 'h')
+	return (CnetTime)(v * 3600000000LL);
+    return (CnetTime)(v * 1000000);		// seconds
+}
+
+void sim_report(CnetTime now)
+{
+    STATS	t;
+
+    memset(&t, 0, sizeof(t));
+    for(int i=0 ; i<sim_nnodes ; ++i) {
+	STATS	*s	= &sim_nodes[i].stats;
+
+	t.events		+= s->events;
+	t.timers		+= s->timers;
+	t.msgs_generated	+= s->msgs_generated;
+	t.msgs_delivered	+= s->msgs_delivered;
+	t.msgbytes_delivered	+= s->msgbytes_delivered;
+	t.delivery_time		+= s->delivery_time;
+	t.frames_tx		+= s->frames_tx;
+	t.framebytes_tx		+= s->framebytes_tx;
+	t.frames_rx		+= s->frames_rx;
+	t.frames_corrupted	+= s->frames_corrupted;
+	t.frames_lost		+= s->frames_lost;
+	t.frames_collided	+= s->frames_collided;
+	t.heap			+= s->heap;
+	if(t.maxheap < s->maxheap)
+	    t.maxheap	= s->maxheap;
+    }
+    fprintf(out, "\n%-30s: %lldusecs\n", "Simulation time", (long long)now);
+    fprintf(out, "%-30s: %lld\n", "Events raised", (long long)t.events);
+    fprintf(out, "%-30s: %lld (%.2f/sec)\n", "Timer events raised",
+	    (long long)t.timers, now > 0 ? t.timers * 1e6 / now : 0.0);
+    fprintf(out, "%-30s: %lld\n", "Messages generated",
+		(long long)t.msgs_generated);
+    fprintf(out, "%-30s: %lld\n", "Messages delivered",
+		(long long)t.msgs_delivered);
+    fprintf(out, "%-30s: %lld\n", "Message bytes delivered",
+		(long long)t.msgbytes_delivered);
+    fprintf(out, "%-30s: %lldusecs\n", "Average delivery time",
+	    (long long)(t.msgs_delivered ? t.delivery_time/t.msgs_delivered :0));
+    fprintf(out, "%-30s: %lld\n", "Frames transmitted", (long long)t.frames_tx);
+    fprintf(out, "%-30s: %lld\n", "Frames received", (long long)t.frames_rx);
+    fprintf(out, "%-30s: %lld\n", "Frames corrupted",
+		(long long)t.frames_corrupted);
+    fprintf(out, "%-30s: %lld\n", "Frames lost", (long long)t.frames_lost);
+    if(sim_nsegments > 0)
+	fprintf(out, "%-30s: %lld\n", "Frames collided",
+		(long long)t.frames_collided);
+    fprintf(out, "%-30s: %.2f%%\n", "Efficiency (bytes AL/PL)",
+	    t.framebytes_tx ? 100.0 * t.msgbytes_delivered / t.framebytes_tx : 0.0);
+    if(sim_countheap) {
+	fprintf(out, "%-30s: %lldbytes\n", "Heap per node (mean)",
+		(long long)(sim_nnodes ? t.heap / sim_nnodes : 0));
+	fprintf(out, "%-30s: %lldbytes\n", "Heap per node (max)",
+		(long long)t.maxheap);
+    }
+    fflush(out);
+}
+
+static double wallclock(void)
+{
+    struct timespec	ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    TOPOLOGY	topo;
+    double	started, elapsed;
+    int64_t	nevents;
+    const char	*record	= NULL, *replay = NULL;
+    int		opt;
+
+    while((opt = getopt(argc, argv, "D:e:f:j:mqr:sS:Tw:W")) != -1) {
+	switch (opt) {
+	case 'D' :
+	    if(strlen(defines) + strlen(optarg) + 8 > sizeof(defines) ||
+		strchr(optarg, '\'') != NULL)
+		usage(argv[0]);
+	    sprintf(defines+strlen(defines), " '-D%s'", optarg);
+	    break;
+	case 'e' :	sim_duration	= parse_time(optarg);	break;
+	case 'f' :	sim_period	= parse_time(optarg);	break;
+	case 'j' :	nthreads	= atoi(optarg);		break;
+	case 'm' :	sim_countheap	= true;			break;
+	case 'q' :	quiet		= true;			break;
+	case 'r' :	replay		= optarg;		break;
+	case 's' :	sim_showstats	= true;			break;
+	case 'S' :	seed		= strtoull(optarg, NULL, 0);	break;
+	case 'w' :	record		= optarg;		break;
+	case 'T' :
+	case 'W' :	break;			// no windows, always fast
+	default :	usage(argv[0]);
+	}
+    }
+    if(optind != argc-1 || (record != NULL && replay != NULL))
+	usage(argv[0]);
+
+    out		= stdout;
+    if(quiet) {				// silence the nodes, but not us
+	int	null	= open("/dev/null", O_WRONLY);
+
+	out	= fdopen(dup(STDOUT_FILENO), "w");
+	dup2(null, STDOUT_FILENO);
+	close(null);
+    }
+
+    if(topo_read(argv[optind], &topo) != 0)
+	exit(EXIT_FAILURE);
+    make_nodes(&topo, argv[optind]);
+    topo_free(&topo);
+    if(replay != NULL)
+	sim_replay_workload(replay);
+    if(record != NULL)
+	sim_record_workload(record);
+
+    sim_ccitt_init();
+    sim_partition(nthreads);
+    sim_boot();
+
+    started	= wallclock();
+    nevents	= sim_run();
+    elapsed	= wallclock() - started;
+    fflush(stdout);
+    sim_save_workload();
+
+    if(sim_showstats)
+	sim_report(sim_duration);
+    sim_shutdown(sim_duration);
+    fflush(stdout);
+    fprintf(out, "\n%-30s: %.3fsecs\n", "Wall-clock time", elapsed);
+    fprintf(out, "%-30s: %.0f\n", "Events per second",
+		elapsed > 0 ? nevents / elapsed : 0.0);
+    fflush(out);
+    return 0;
+}
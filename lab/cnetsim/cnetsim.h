@@ -0,0 +1,215 @@
+#ifndef _CNETSIM_H
+#define _CNETSIM_H
+
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "cnet.h"
+#include "../lab#3/topology.h"
+
+/* ------- INTERNAL DECLARATIONS OF THE cnetsim SIMULATOR -------- */
+
+typedef void	(*HANDLER)(CnetEvent, CnetTimerID, CnetData);
+
+typedef enum {
+    SE_REBOOT,			// call the node's reboot function
+    SE_TIMER,			// one of EV_TIMER0..9
+    SE_FRAME,			// a frame arrives at the node
+    SE_MESSAGE,			// the node's Application Layer has a message
+    SE_PERIODIC,		// EV_PERIODIC
+    SE_COLLISION,		// EV_FRAMECOLLISION, on a lansegment
+    SE_SHUTDOWN			// EV_SHUTDOWN, after the last event
+} SIMEVENT;
+
+typedef struct _event {
+    CnetTime		time;		// events are ordered by
+    int			creator;	// (time, creator, cseq), so every
+    uint64_t		cseq;		// run from one seed is identical
+
+    int			node;		// node at which it occurs
+    SIMEVENT		kind;
+    CnetEvent		ev;		// SE_TIMER only
+    CnetTimerID		id;
+    CnetData		data;
+    int			link;		// SE_FRAME and SE_COLLISION only
+    char		*frame;
+    size_t		len;
+    bool		cancelled;
+    struct _event	*next;		// on free list, or timer hash chain
+} EVENT;
+
+typedef struct {
+    EVENT		**heap;		// binary heap, earliest first
+    int			nevents;
+    int			size;
+} EVENTQUEUE;
+
+typedef struct {			// from one partition to another
+    EVENT		**slots;
+    atomic_uint		head;		// written only by the consumer
+    atomic_uint		tail;		// written only by the producer
+} CHANNEL;
+
+typedef struct {
+    int			index;
+    EVENTQUEUE		queue;		// for this partition's nodes
+    CHANNEL		*in;		// from each other partition
+    CnetTime		next;		// its earliest event, at barriers
+    int64_t		nevents;
+    pthread_t		thread;
+} PARTITION;
+
+typedef struct _onair {			// a frame sent on a lansegment
+    int			sender;		// node number
+    CnetTime		start, end;	// when it is sent, at the sender
+    bool		collided;
+    struct _event	**arrivals;	// its SE_FRAMEs, unless it collides
+    int			narrivals;
+    struct _onair	*next;
+} ONAIR;
+
+typedef struct {			// a lansegment, or the wireless medium
+    CnetLinkType	type;		// LT_LAN or LT_WLAN
+    CnetTime		delay;		// propagation delay across it
+    int			*nodes;		// the nodes attached to it
+    int			*links;		// ... and their links to it
+    int			nattached;
+    ONAIR		*onair;		// frames not yet past every node
+} SEGMENT;
+
+typedef struct {
+    int			peer;		// node number at the other end
+    int			peerlink;	// ... and its link number there
+    CnetTime		busy_until;	// our transmitter is busy until
+    int			probframeloss;	// lose 1 frame in 2^N, 0 = never
+    int			probframecorrupt;
+    SEGMENT		*segment;	// LAN or WLAN medium, or NULL for WAN
+} LINKEND;
+
+typedef struct {
+    int64_t		events;
+    int64_t		timers;			// EV_TIMER0..9 events
+    int64_t		msgs_generated;
+    int64_t		msgs_delivered;
+    int64_t		msgbytes_delivered;
+    int64_t		delivery_time;		// total, usecs
+    int64_t		frames_tx;
+    int64_t		framebytes_tx;
+    int64_t		frames_rx;
+    int64_t		frames_corrupted;
+    int64_t		frames_lost;
+    int64_t		frames_collided;	// sent, on a LAN or WLAN
+    int64_t		heap;			// bytes held by the protocol
+    int64_t		maxheap;		// ... at most
+} STATS;
+
+#define	TIMER_BUCKETS	256			// per node, a power of 2
+#define	MIN_MESSAGE	32			// the hidden header must fit
+
+typedef struct {			// one message read by a protocol
+    CnetTime		time;
+    int32_t		dest;			// node number
+    uint32_t		length;
+} WLRECORD;
+
+typedef struct {
+    CnetNodeInfo	info;
+    CnetLinkInfo	*links;			// [0..nlinks]
+    LINKEND		*ends;			// [0..nlinks]
+    void		*dl;			// this node's copy of the protocol
+    int			partition;		// handled by this thread
+    HANDLER		reboot;
+    HANDLER		handlers[N_CNET_EVENTS];
+    CnetData		hdata[N_CNET_EVENTS];
+
+    bool		*enabled;		// by destination node number
+    int			nenabled;
+    bool		generating;		// an SE_MESSAGE is scheduled
+    char		*msg;			// message awaiting reading
+    size_t		msglen;
+    int			msgdest;		// node number
+    int32_t		*nextseq;		// by destination node number
+    int32_t		*expectseq;		// by source node number
+    WLRECORD		*trace;			// messages recorded or replayed
+    int			ntrace, maxtrace;
+    int			replayed;		// all before it were offered
+
+    EVENT		*timers[TIMER_BUCKETS];	// pending, by id
+    CnetTimerID		lasttimer;
+
+    uint64_t		simrng;			// for losses, messages
+    uint64_t		rng;			// for CNET_rand()
+    uint64_t		cseq;			// events created by this node
+    STATS		stats;
+} NODE;
+
+//  THE STATE OF THE WHOLE SIMULATION, FROM cnetsim.c
+extern	NODE		*sim_nodes;
+extern	int		sim_nnodes;
+extern	CnetTime	sim_duration;
+extern	CnetTime	sim_period;		// of EV_PERIODIC, or 0
+extern	bool		sim_showstats;
+extern	void		sim_report(CnetTime now);
+
+//  THE NODE WHOSE EVENT IS BEING HANDLED BY THIS THREAD
+extern	__thread NODE	*sim_thisnode;
+extern	__thread EVENT	*sim_thisevent;
+
+//  heap.c
+extern	void	sim_eq_init(EVENTQUEUE *q);
+extern	void	sim_eq_push(EVENTQUEUE *q, EVENT *e);
+extern	EVENT	*sim_eq_pop(EVENTQUEUE *q);
+extern	bool	sim_before(const EVENT *a, const EVENT *b);
+extern	EVENT	*sim_newevent(void);
+extern	void	sim_freeevent(EVENT *e);
+extern	void	sim_timer_add(NODE *n, EVENT *e);
+extern	EVENT	*sim_timer_remove(NODE *n, CnetTimerID id);
+
+//  api.c
+extern	void	sim_schedule(NODE *creator, EVENT *e);
+extern	void	sim_schedule_message(NODE *n, CnetTime when);
+extern	void	sim_makemessage(NODE *n, int dest, size_t len,
+				CnetTime created);
+extern	void	sim_dispatch(EVENT *e);
+extern	int	sim_findaddress(CnetAddr addr);
+extern	uint64_t sim_rand(uint64_t *state);
+extern	const char *sim_errstr(int err);
+extern	void	sim_ccitt_init(void);
+extern	void	sim_shutdown(CnetTime now);
+
+//  workload.c
+extern	bool	sim_replaying;
+
+extern	void	sim_record_workload(const char *filename);
+extern	void	sim_replay_workload(const char *filename);
+extern	void	sim_save_workload(void);
+extern	void	sim_recordmessage(NODE *n, int dest, size_t length);
+extern	void	sim_replaymessage(NODE *n);
+extern	void	sim_replaywake(NODE *n);
+
+//  segment.c
+extern	SEGMENT	*sim_segments;
+extern	int	sim_nsegments;
+
+extern	bool	sim_segment_busy(SEGMENT *s, int node, CnetTime now);
+extern	void	sim_segment_send(NODE *n, int link, EVENT *e, CnetTime txtime,
+				 bool lost);
+
+//  memory.c
+extern	bool	sim_countheap;
+
+//  nodes.c
+extern	const char *sim_attr(TOPOLOGY *topo, int n, const char *name);
+extern	void	sim_makenodes(TOPOLOGY *topo, uint64_t seed);
+extern	void	sim_boot(void);
+
+//  parallel.c
+extern	PARTITION		*sim_partitions;
+extern	int			sim_npartitions;
+extern	__thread PARTITION	*sim_thispartition;
+
+extern	void	sim_partition(int nparts);
+extern	void	sim_partition_push(PARTITION *to, EVENT *e);
+extern	int64_t	sim_run(void);
+
+#endif
@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "cnetsim.h"
+
+/*  THIS FILE PROVIDES cnetsim's PENDING EVENT QUEUE, A BINARY HEAP
+    ORDERED BY (time, creator, cseq).  BREAKING TIES BY THE NODE THAT
+    CREATED AN EVENT, AND ITS OWN COUNT OF EVENTS CREATED, (RATHER THAN BY
+    THE ORDER OF INSERTION) MEANS THAT THE ORDER DOES NOT DEPEND ON HOW
+    THE SIMULATION IS RUN.
+
+    Stopped timers are not removed from the heap: they are found through
+    their node's hash table of pending timers, marked as cancelled, and
+    discarded when they reach the top.  EVENTs are recycled through a
+    free list, as a busy simulation creates and discards millions of them.
+ */
+
+static	__thread EVENT	*freelist	= NULL;
+
+bool sim_before(const EVENT *a, const EVENT *b)
+{
+    if(a->time != b->time)
+	return a->time < b->time;
+    if(a->creator != b->creator)
+	return a->creator < b->creator;
+    return a->cseq < b->cseq;
+}
+
+void sim_eq_init(EVENTQUEUE *q)
+{
+    q->size	= 1024;
+    q->nevents	= 0;
+    q->heap	= malloc(q->size * sizeof(EVENT *));
+}
+
+void sim_eq_push(EVENTQUEUE *q, EVENT *e)
+{
+    int	i;
+
+    if(q->nevents == q->size) {
+	q->size	*= 2;
+	q->heap	= realloc(q->heap, q->size * sizeof(EVENT *));
+    }
+//  SIFT THE NEW EVENT UP FROM THE BOTTOM
+    for(i=q->nevents++ ; i>0 ; ) {
+	int	parent	= (i-1) / 2;
+
+	if(!sim_before(e, q->heap[parent]))
+	    break;
+	q->heap[i]	= q->heap[parent];
+	i		= parent;
+    }
+    q->heap[i]	= e;
+}
+
+EVENT *sim_eq_pop(EVENTQUEUE *q)
+{
+    EVENT	*top, *last;
+    int		i, child;
+
+    if(q->nevents == 0)
+	return NULL;
+    top		= q->heap[0];
+    last	= q->heap[--q->nevents];
+
+//  SIFT THE LAST EVENT DOWN FROM THE TOP
+    for(i=0 ; (child = 2*i+1) < q->nevents ; i=child) {
+	if(child+1 < q->nevents && sim_before(q->heap[child+1], q->heap[child]))
+	    ++child;
+	if(!sim_before(q->heap[child], last))
+	    break;
+	q->heap[i]	= q->heap[child];
+    }
+    q->heap[i]	= last;
+    return top;
+}
+
+// -----------------------------------------------------------------
+
+EVENT *sim_newevent(void)
+{
+    EVENT	*e	= freelist;
+
+    if(e == NULL)
+	e	= malloc(sizeof(EVENT));
+    else
+	freelist	= e->next;
+    memset(e, 0, sizeof(EVENT));
+    return e;
+}
+
+void sim_freeevent(EVENT *e)
+{
+    free(e->frame);
+    e->next	= freelist;
+    freelist	= e;
+}
+
+// -----------------------------------------------------------------
+
+void sim_timer_add(NODE *n, EVENT *e)
+{
+    EVENT	**b	= &n->timers[e->id & (TIMER_BUCKETS-1)];
+
+    e->next	= *b;
+    *b		= e;
+}
+
+//  REMOVE AND RETURN A PENDING TIMER, OR NULL IF IT HAS EXPIRED OR STOPPED
+EVENT *sim_timer_remove(NODE *n, CnetTimerID id)
+{
+    EVENT	**b	= &n->timers[id & (TIMER_BUCKETS-1)];
+
+    for( ; *b != NULL ; b = &(*b)->next)
+	if((*b)->id == id) {
+	    EVENT	*e	= *b;
+
+	    *b		= e->next;
+	    e->next	= NULL;
+	    return e;
+	}
+    return NULL;
+}
@@ -0,0 +1,69 @@
+#include "microbench.h"
+#include "../lab#3/flooding3.c"
+
+/*  MICRO-BENCHMARKS OF flooding3.c's PER-PACKET PATHS: up_to_network()
+    FORWARDING A PACKET FOR ANOTHER NODE, AND flood3() SENDING A NEW ONE,
+    WITH THE NL TABLE HOLDING ROUTES TO EACH OF mb_peers[] DESTINATIONS.
+ */
+
+#define	NLINKS		4
+#define	BANDWIDTH	100000000		// bps
+#define	STRIDE		7919
+
+static	NL_PACKET	p;
+
+static void learn_routes(int peers)
+{
+    for(int a=1 ; a<=peers ; ++a)
+	NL_savepathcost(a, 1 + a%3, 1000 * (1 + a%3), 1 + a%NLINKS);
+}
+
+static void make_packet(int64_t ops, int peers, size_t size)
+{
+    p.src		= 1 + (int)(ops % peers);
+    p.dest		= 1 + (int)((ops * STRIDE) % peers);
+    p.kind		= NL_DATA;
+    p.seqno		= 0;
+    p.hopcount		= 1;
+    p.pathcost		= 0;
+    p.ecn		= 0;
+    p.sack		= 0;
+    p.deflections	= 0;
+    p.length		= size;
+}
+
+void mb_suite(void)
+{
+    int64_t	ops;
+
+    for(int n=0 ; n<mb_npeers ; ++n)
+	for(int s=0 ; s<mb_nsizes ; ++s) {
+	    int		peers	= mb_peers[n];
+	    size_t	size	= mb_sizes[s];
+
+	    mb_topology(peers, NLINKS, BANDWIDTH);
+	    mb_reboot();
+	    learn_routes(peers);
+	    mb_begin("flood3.up_to_network", peers, size);
+	    for(ops=0 ; mb_more(ops) ; ++ops) {
+		make_packet(ops, peers, size);
+		/* not on the link that is the way to its destination */
+		up_to_network((char *)&p, PACKET_SIZE(p), 1 + (p.dest+1)%NLINKS);
+		mb_advance(mb_txtime(PACKET_SIZE(p)));
+	    }
+	    mb_end(ops);
+
+	    mb_topology(peers, NLINKS, BANDWIDTH);
+	    mb_reboot();
+	    learn_routes(peers);
+	    mb_begin("flood3.flood3", peers, size);
+	    for(ops=0 ; mb_more(ops) ; ++ops) {
+		make_packet(ops, peers, size);
+		p.src		= nodeinfo.address;
+		p.hopcount	= 0;
+		flood3((char *)&p, PACKET_SIZE(p), 0, 0);
+		mb_advance(mb_txtime(PACKET_SIZE(p)));
+	    }
+	    mb_end(ops);
+	}
+}
@@ -0,0 +1,42 @@
+#include "microbench.h"
+#include "../lab#3/lab3.c"
+
+/*  MICRO-BENCHMARK OF lab3.c's timeout_events(), RESENDING THE PACKET IN
+    FLIGHT TO ONE OF mb_peers[] DESTINATIONS ALONG ITS ROUTE, AS IT DOES
+    FOR THE FIRST RETX_ROUTED TIMEOUTS.
+ */
+
+#define	NLINKS		4
+#define	BANDWIDTH	100000000		// bps
+#define	STRIDE		7919
+
+void mb_suite(void)
+{
+    int64_t	ops;
+
+    for(int n=0 ; n<mb_npeers ; ++n)
+	for(int s=0 ; s<mb_nsizes ; ++s) {
+	    int		peers	= mb_peers[n];
+	    size_t	size	= mb_sizes[s];
+
+	    mb_topology(peers, NLINKS, BANDWIDTH);
+	    mb_reboot();
+	    for(int a=1 ; a<=peers ; ++a) {
+		NL_savepathcost(a, 1 + a%3, 1 + a%3, 1 + a%NLINKS);
+		mb_message(a, size);			// one packet in flight
+		mb_advance(NLINKS * mb_txtime(size + PACKET_HEADER_SIZE));
+	    }
+
+	    mb_begin("lab3.timeout_events", peers, size);
+	    for(ops=0 ; mb_more(ops) ; ++ops) {
+		CnetAddr	dest	= 1 + (int)((ops * STRIDE) % peers);
+		int		t	= find_address_timeout(dest);
+
+		tw_stop(timeout[t].last_timer);		// as if it expired
+		timeout[t].failures	= 0;
+		timeout_events(TW_NULLTIMER, (CnetData)dest);
+		mb_advance(mb_txtime(size + PACKET_HEADER_SIZE));
+	    }
+	    mb_end(ops);
+	}
+}
@@ -0,0 +1,33 @@
+#include "microbench.h"
+#include "../lab#3/nl_table.c"
+
+/*  MICRO-BENCHMARK OF THE NL TABLE'S find_address(), WHICH EVERY PACKET
+    SENT, FORWARDED OR RECEIVED BY THE lab#3 PROTOCOLS CALLS AT LEAST ONCE.
+ */
+
+#define	STRIDE		7919		// a prime, so every peer is visited
+
+EVENT_HANDLER(reboot_node)
+{
+    reboot_NL_table();
+}
+
+void mb_suite(void)
+{
+    volatile int	sink	= 0;
+    int64_t		ops;
+
+    for(int p=0 ; p<mb_npeers ; ++p) {
+	int	peers	= mb_peers[p];
+
+	mb_topology(peers, 1, 1000000);
+	mb_reboot();
+	for(int a=1 ; a<=peers ; ++a)
+	    find_address(a);
+
+	mb_begin("nl_table.find_address", peers, 0);
+	for(ops=0 ; mb_more(ops) ; ++ops)
+	    sink	+= find_address(1 + (int)((ops * STRIDE) % peers));
+	mb_end(ops);
+    }
+}
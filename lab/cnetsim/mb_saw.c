@@ -0,0 +1,56 @@
+#include "microbench.h"
+#include "../lab#2/stopandwait.c"
+
+/*  MICRO-BENCHMARKS OF THE STOP-AND-WAIT PROTOCOL'S PER-FRAME PATHS:
+    transmit_frame() SENDING A DATA FRAME, AND physical_ready() RECEIVING
+    ONE (WRITING ITS MESSAGE TO THE APPLICATION LAYER, AND SENDING THE ACK).
+ */
+
+#define	BANDWIDTH	100000000		// bps
+
+static	FRAME	frames[2];			// by sequence number
+
+//  A DATA FRAME FROM OUR NEIGHBOUR, CARRYING A VALID MESSAGE OF size BYTES
+static size_t make_frame(FRAME *f, int seq, size_t size)
+{
+    memset(f, 0, sizeof(FRAME));
+    f->kind	= DL_DATA;
+    f->seq	= seq;
+    f->more	= 0;
+    f->len	= mb_capture(1, &f->msg, size);
+    f->checksum	= CNET_ccitt((unsigned char *)f, (int)FRAME_SIZE((*f)));
+    return FRAME_SIZE((*f));
+}
+
+void mb_suite(void)
+{
+    static MSG	msg;
+    int64_t	ops;
+
+    for(int s=0 ; s<mb_nsizes ; ++s) {
+	size_t	size	= mb_sizes[s];
+	size_t	len[2];
+
+	mb_topology(1, 1, BANDWIDTH);
+	mb_reboot();
+	mb_begin("saw.transmit_frame", 1, size);
+	for(ops=0 ; mb_more(ops) ; ++ops) {
+	    transmit_frame(&msg, DL_DATA, size, ops & 1, 0);
+	    CNET_stop_timer(lasttimer);		// as its ACK would
+	    mb_advance(mb_txtime(FRAME_HEADER_SIZE + size));
+	}
+	mb_end(ops);
+
+	mb_topology(1, 1, BANDWIDTH);
+	mb_reboot();
+	len[0]	= make_frame(&frames[0], 0, size);
+	len[1]	= make_frame(&frames[1], 1, size);
+	mb_begin("saw.physical_ready", 1, size);
+	for(ops=0 ; mb_more(ops) ; ++ops) {
+	    mb_node->expectseq[1]	= 0;	// the same message, again
+	    mb_frame(1, &frames[frameexpected], len[frameexpected]);
+	    mb_advance(mb_txtime(FRAME_HEADER_SIZE));
+	}
+	mb_end(ops);
+    }
+}
@@ -0,0 +1,84 @@
+#include <malloc.h>
+#include <stdlib.h>
+
+#include "cnetsim.h"
+
+/*  THIS FILE MEASURES THE HEAP HELD BY EACH NODE'S PROTOCOL, SUCH AS ITS
+    NL TABLE, SO THAT THE MEMORY A PROTOCOL NEEDS MAY BE SEEN TO GROW WITH
+    THE SIZE OF THE NETWORK.
+
+    cnetsim is linked with -rdynamic, so these definitions of malloc(),
+    calloc(), realloc() and free() are used by every node's copy of the
+    protocol, and by the C library.  Each passes the request on to the
+    C library's allocator, and when it was made from outside the simulator
+    (by the protocol, or by the C library for it), while a node's event is
+    being handled, the size of the block is added to or taken from that
+    node's heap.  Blocks allocated and freed by the simulator itself, such
+    as frames, are not counted, whichever node's event it is handling.
+ */
+
+extern	void	*__libc_malloc(size_t size);
+extern	void	*__libc_calloc(size_t n, size_t size);
+extern	void	*__libc_realloc(void *ptr, size_t size);
+extern	void	__libc_free(void *ptr);
+
+extern	char	__executable_start[], etext[];	// from the linker
+
+bool		sim_countheap	= false;
+
+//  THE NODE TO CHARGE FOR A CALL FROM caller, OR NULL
+static inline NODE *charged(void *caller)
+{
+    if(!sim_countheap || sim_thisnode == NULL)
+	return NULL;
+    if((char *)caller >= __executable_start && (char *)caller < etext)
+	return NULL;				// the simulator's own
+    return sim_thisnode;
+}
+
+static inline void charge(NODE *n, void *ptr, int sign)
+{
+    if(n != NULL && ptr != NULL) {
+	n->stats.heap	+= sign * (int64_t)malloc_usable_size(ptr);
+	if(n->stats.maxheap < n->stats.heap)
+	    n->stats.maxheap	= n->stats.heap;
+    }
+}
+
+// -----------------------------------------------------------------
+
+void *malloc(size_t size)
+{
+    void	*ptr	= __libc_malloc(size);
+
+    charge(charged(__builtin_return_address(0)), ptr, 1);
+    return ptr;
+}
+
+void *calloc(size_t n, size_t size)
+{
+    void	*ptr	= __libc_calloc(n, size);
+
+    charge(charged(__builtin_return_address(0)), ptr, 1);
+    return ptr;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    NODE	*n	= charged(__builtin_return_address(0));
+    void	*newptr;
+
+    charge(n, ptr, -1);
+    newptr	= __libc_realloc(ptr, size);
+    if(newptr != NULL)
+	charge(n, newptr, 1);
+    else if(size > 0)
+	charge(n, ptr, 1);			// a failure leaves ptr alone
+    return newptr;
+}
+
+void free(void *ptr)
+{
+    charge(charged(__builtin_return_address(0)), ptr, -1);
+    __libc_free(ptr);
+}
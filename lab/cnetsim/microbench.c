@@ -0,0 +1,394 @@
+#define	_DEFAULT_SOURCE			// for syscall()
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "microbench.h"
+
+/*  THIS FILE IS THE HARNESS OF THE PROTOCOL MICRO-BENCHMARKS.  EACH SUITE
+    (mb_*.c) #includes the protocol file it measures, so that it may call
+    even its static functions, and is linked with this file and cnetsim's
+    own implementation of the cnet API into a program of its own.
+
+    A suite builds a small topology around node MB_NODE, reboots it, and
+    then calls the function being measured in a loop, with synthetic
+    frames, packets and messages, for about MB_SECONDS of CPU time.
+    Between calls it may advance the node's simulated time, which runs the
+    node's own timers (so queues drain as they would) and discards the
+    frames it has sent.
+
+    The programs run in a directory of their own, emptied before each
+    benchmark, so that files written by a protocol (such as the NL
+    table's snapshots, when NL_SNAPSHOTS is set) neither litter the
+    current directory nor carry state from one benchmark to the next.
+
+    For each benchmark one line of JSON is printed, giving the time taken
+    per operation (a frame, packet or lookup), and the heap allocations
+    and last-level cache misses per operation.  Allocations are counted by
+    wrapping malloc(), calloc() and realloc() when linking, so they include
+    cnetsim's copy of each frame written.  Cache misses are counted with a
+    hardware performance counter, and are null where none is available.
+
+	mb_saw [-t seconds] [-o file.json]
+ */
+
+#define	MB_SECONDS	0.25		// per benchmark, by default
+
+const int	mb_peers[]	= { 8, 100, 1000, 10000 };
+const int	mb_npeers	= sizeof(mb_peers) / sizeof(mb_peers[0]);
+const size_t	mb_sizes[]	= { 48, 1024, 8192, 32768 };
+const int	mb_nsizes	= sizeof(mb_sizes) / sizeof(mb_sizes[0]);
+
+NODE		*mb_node	= NULL;
+CnetTime	mb_now		= 0;
+
+//  THE PARTS OF cnetsim.c's STATE THAT ITS API NEEDS
+NODE		*sim_nodes	= NULL;
+int		sim_nnodes	= 0;
+CnetTime	sim_duration	= INT64_MAX;
+CnetTime	sim_period	= 0;
+bool		sim_showstats	= false;
+
+void sim_report(CnetTime now)
+{
+}
+
+static	FILE		*out;
+static	char		workdir[]	= "/tmp/microbenchXXXXXX";
+static	double		seconds		= MB_SECONDS;
+static	EVENT		current;		// for calls made directly
+
+static	const char	*bench;
+static	int		bench_peers;
+static	size_t		bench_size;
+static	double		started, deadline;
+static	int64_t		frames_before;
+static	int		perf_fd		= -1;
+
+static	int64_t		nallocs		= 0;
+
+// -----------------------------------------------------------------
+
+extern	void	*__real_malloc(size_t size);
+extern	void	*__real_calloc(size_t n, size_t size);
+extern	void	*__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    ++nallocs;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    ++nallocs;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    ++nallocs;
+    return __real_realloc(ptr, size);
+}
+
+static double cputime(void)
+{
+    struct timespec	ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//  A COUNTER OF THIS PROCESS'S LAST-LEVEL CACHE MISSES, OR -1
+static int open_perf(void)
+{
+    struct perf_event_attr	pe;
+
+    memset(&pe, 0, sizeof(pe));
+    pe.type		= PERF_TYPE_HARDWARE;
+    pe.size		= sizeof(pe);
+    pe.config		= PERF_COUNT_HW_CACHE_MISSES;
+    pe.disabled		= 1;
+    pe.exclude_kernel	= 1;
+    pe.exclude_hv	= 1;
+    return (int)syscall(__NR_perf_event_open, &pe, 0, -1, -1, 0);
+}
+
+//  REMOVE EVERY FILE THAT THE PROTOCOL HAS WRITTEN TO OUR DIRECTORY
+static void empty_workdir(void)
+{
+    DIR			*dir	= opendir(".");
+    struct dirent	*d;
+
+    if(dir == NULL)
+	return;
+    while((d = readdir(dir)) != NULL)
+	if(strcmp(d->d_name, ".") != 0 && strcmp(d->d_name, "..") != 0)
+	    unlink(d->d_name);
+    closedir(dir);
+}
+
+// -----------------------------------------------------------------
+
+//  THE CALLS BETWEEN EVENTS ARE MADE AS IF BY AN EVENT OF MB_NODE AT mb_now
+static void settime(void)
+{
+    current.time		= mb_now;
+    current.node		= MB_NODE;
+    current.kind		= SE_TIMER;
+    sim_thisevent		= &current;
+    sim_thisnode		= mb_node;
+    nodeinfo			= mb_node->info;
+    nodeinfo.time_in_usec	= mb_now;
+    linkinfo			= mb_node->links;
+}
+
+/*  A NODE WITH nlinks LINKS, OF bandwidth bps, TO ITS FIRST nlinks PEERS.
+    ONLY THE NODE AND ITS NEIGHBOURS HAVE AN APPLICATION LAYER, SO THAT
+    10,000 PEERS DO NOT NEED 10,000^2 SEQUENCE NUMBERS.
+ */
+void mb_topology(int npeers, int nlinks, int bandwidth)
+{
+    empty_workdir();
+    sim_nnodes	= 1 + (npeers > nlinks ? npeers : nlinks);
+    sim_nodes	= calloc(sim_nnodes, sizeof(NODE));
+    for(int i=0 ; i<sim_nnodes ; ++i) {
+	NODE	*n	= &sim_nodes[i];
+
+	n->info.nodetype	= NT_HOST;
+	n->info.nodenumber	= i;
+	n->info.address		= i;
+	n->info.minmessagesize	= MIN_MESSAGE;
+	n->info.maxmessagesize	= MAX_MESSAGE_SIZE;
+	snprintf(n->info.nodename, MAX_NODENAME_LEN, "node%d", i);
+	n->simrng		= i+1;
+	n->rng			= i+1;
+	if(i <= nlinks) {
+	    n->enabled		= calloc(sim_nnodes, sizeof(bool));
+	    n->nextseq		= calloc(sim_nnodes, sizeof(int32_t));
+	    n->expectseq	= calloc(sim_nnodes, sizeof(int32_t));
+	    n->msg		= malloc(MAX_MESSAGE_SIZE);
+	}
+    }
+
+    mb_node			= &sim_nodes[MB_NODE];
+    mb_node->info.nlinks	= nlinks;
+    mb_node->links		= calloc(nlinks+1, sizeof(CnetLinkInfo));
+    mb_node->ends		= calloc(nlinks+1, sizeof(LINKEND));
+    mb_node->links[0].linktype	= LT_LOOPBACK;
+    for(int l=1 ; l<=nlinks ; ++l) {
+	CnetLinkInfo	info	= { LT_WAN, true, bandwidth, 1000,
+				    2*MAX_MESSAGE_SIZE };
+
+	mb_node->links[l]	= info;
+	mb_node->ends[l].peer	= l;
+	mb_node->ends[l].peerlink	= 1;
+    }
+    mb_node->reboot	= reboot_node;
+
+    sim_partition(1);
+    mb_now	= 0;
+    settime();
+}
+
+void mb_reboot(void)
+{
+    EVENT	e;
+
+    memset(&e, 0, sizeof(e));
+    e.node	= MB_NODE;
+    e.kind	= SE_REBOOT;
+    e.time	= mb_now;
+    sim_dispatch(&e);
+    settime();
+}
+
+//  THE TIME TO TRANSMIT length BYTES ON ANY OF MB_NODE's LINKS
+CnetTime mb_txtime(size_t length)
+{
+    return ((CnetTime)length * 8000000) / mb_node->links[1].bandwidth + 1;
+}
+
+/*  ADVANCE MB_NODE's CLOCK, RUNNING ITS TIMERS.  FRAMES SENT TO OTHER NODES
+    ARE DISCARDED, AS ARE MESSAGES FROM ITS OWN APPLICATION LAYER, SO THE
+    NODE ONLY DOES THE WORK THAT A SUITE GIVES IT.
+ */
+void mb_advance(CnetTime usecs)
+{
+    EVENTQUEUE	*q	= &sim_partitions[0].queue;
+    EVENT	*e;
+
+    mb_now	+= usecs;
+    while(q->nevents > 0 && q->heap[0]->time <= mb_now) {
+	e	= sim_eq_pop(q);
+	if(!e->cancelled && e->node == MB_NODE && e->kind == SE_TIMER)
+	    sim_dispatch(e);
+	sim_freeevent(e);
+    }
+    settime();
+}
+
+//  DELIVER A FRAME TO MB_NODE's EV_PHYSICALREADY HANDLER
+void mb_frame(int link, void *frame, size_t len)
+{
+    EVENT	e;
+
+    memset(&e, 0, sizeof(e));
+    e.node	= MB_NODE;
+    e.kind	= SE_FRAME;
+    e.time	= mb_now;
+    e.link	= link;
+    e.frame	= frame;
+    e.len	= len;
+    sim_dispatch(&e);
+    settime();
+}
+
+//  OFFER A MESSAGE FOR dest TO MB_NODE's EV_APPLICATIONREADY HANDLER
+void mb_message(int dest, size_t len)
+{
+    EVENT	e;
+
+    memset(&e, 0, sizeof(e));
+    e.node	= MB_NODE;
+    e.kind	= SE_MESSAGE;
+    e.time	= mb_now;
+    sim_thisevent	= &e;
+    sim_makemessage(mb_node, dest, len, mb_now);
+    settime();
+}
+
+static	char	*captured;
+static	size_t	capturedlen;
+
+static EVENT_HANDLER(capture)
+{
+    CnetAddr	dest;
+
+    CHECK(CNET_read_application(&dest, captured, &capturedlen));
+}
+
+/*  A VALID MESSAGE FROM PEER from TO MB_NODE, WHICH MAY BE WRITTEN TO
+    MB_NODE's APPLICATION LAYER ONCE FOR EACH TIME ITS expectseq[from] IS
+    RESET TO ZERO.  THE PEER MUST BE A NEIGHBOUR.
+ */
+size_t mb_capture(int from, void *msg, size_t len)
+{
+    NODE	*n	= &sim_nodes[from];
+    EVENT	e;
+
+    memset(&e, 0, sizeof(e));
+    e.node	= from;
+    e.kind	= SE_MESSAGE;
+    e.time	= mb_now;
+    sim_thisevent	= &e;
+    sim_thisnode	= n;
+    captured	= msg;
+    capturedlen	= MAX_MESSAGE_SIZE;
+    n->handlers[EV_APPLICATIONREADY]	= capture;
+    n->nextseq[MB_NODE]			= 0;
+    sim_makemessage(n, MB_NODE, len, mb_now);
+    settime();
+    return capturedlen;
+}
+
+// -----------------------------------------------------------------
+
+void mb_begin(const char *name, int peers, size_t size)
+{
+    bench		= name;
+    bench_peers		= peers;
+    bench_size		= size;
+    frames_before	= mb_node->stats.frames_tx;
+    if(perf_fd >= 0) {
+	ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    nallocs		= 0;
+    started		= cputime();
+    deadline		= started + seconds;
+}
+
+//  SHOULD THE BENCHMARK CONTINUE, HAVING PERFORMED ops OPERATIONS?
+bool mb_more(int64_t ops)
+{
+    return (ops % 64) != 0 || cputime() < deadline;
+}
+
+void mb_end(int64_t ops)
+{
+    double	elapsed	= cputime() - started;
+    int64_t	allocs	= nallocs;
+    long long	misses	= -1;
+
+    if(perf_fd >= 0) {
+	ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+	if(read(perf_fd, &misses, sizeof(misses)) != sizeof(misses))
+	    misses	= -1;
+    }
+    if(ops < 1)
+	ops	= 1;
+    fprintf(out, "{\"bench\": \"%s\", \"peers\": %d, \"size\": %zu, "
+		 "\"ops\": %lld, \"ns_per_op\": %.1f, "
+		 "\"frames_per_op\": %.3f, \"allocs_per_op\": %.3f, ",
+		bench, bench_peers, bench_size, (long long)ops,
+		elapsed * 1e9 / ops,
+		(double)(mb_node->stats.frames_tx - frames_before) / ops,
+		(double)allocs / ops);
+    if(misses >= 0)
+	fprintf(out, "\"cache_misses_per_op\": %.3f}\n", (double)misses / ops);
+    else
+	fprintf(out, "\"cache_misses_per_op\": null}\n");
+    fflush(out);
+}
+
+// -----------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    int		opt, null;
+
+    out		= stdout;
+    while((opt = getopt(argc, argv, "o:t:")) != -1) {
+	switch (opt) {
+	case 'o' :
+	    if((out = fopen(optarg, "a")) == NULL) {
+		perror(optarg);
+		exit(EXIT_FAILURE);
+	    }
+	    break;
+	case 't' :	seconds	= atof(optarg);	break;
+	default :
+	    fprintf(stderr, "Usage: %s [-t seconds] [-o file.json]\n", argv[0]);
+	    exit(EXIT_FAILURE);
+	}
+    }
+
+//  THE PROTOCOLS' OWN OUTPUT IS PART OF THEIR COST, BUT IS NOT WANTED
+    if(out == stdout)
+	out	= fdopen(dup(STDOUT_FILENO), "w");
+    null	= open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    close(null);
+
+    if(mkdtemp(workdir) == NULL || chdir(workdir) != 0) {
+	perror(workdir);
+	exit(EXIT_FAILURE);
+    }
+    sim_ccitt_init();
+    perf_fd	= open_perf();
+    mb_suite();
+    fclose(out);
+
+    empty_workdir();
+    if(chdir("/") == 0)
+	rmdir(workdir);
+    return 0;
+}
@@ -0,0 +1,38 @@
+#ifndef _MICROBENCH_H
+#define _MICROBENCH_H
+
+#include "cnetsim.h"
+
+/* ------- DECLARATIONS FOR THE PROTOCOL MICRO-BENCHMARKS -------- */
+
+#define	MB_NODE		0		// the node whose protocol is measured
+
+//  THE PEER COUNTS AND MESSAGE SIZES THAT EACH SUITE IS RUN WITH
+extern	const int	mb_peers[];
+extern	const int	mb_npeers;
+extern	const size_t	mb_sizes[];
+extern	const int	mb_nsizes;
+
+//  PROVIDED BY EACH SUITE
+extern	void		mb_suite(void);
+
+//  THE NODE UNDER TEST, AND ITS SIMULATED TIME
+extern	NODE		*mb_node;
+extern	CnetTime	mb_now;
+
+//  microbench.c
+extern	void	mb_topology(int npeers, int nlinks, int bandwidth);
+extern	void	reboot_node(CnetEvent ev, CnetTimerID timer, CnetData data);
+extern	void	mb_reboot(void);
+extern	void	mb_advance(CnetTime usecs);
+extern	CnetTime mb_txtime(size_t length);
+
+extern	void	mb_frame(int link, void *frame, size_t len);
+extern	void	mb_message(int dest, size_t len);
+extern	size_t	mb_capture(int from, void *msg, size_t len);
+
+extern	void	mb_begin(const char *bench, int peers, size_t size);
+extern	bool	mb_more(int64_t ops);
+extern	void	mb_end(int64_t ops);
+
+#endif
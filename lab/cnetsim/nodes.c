@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "cnetsim.h"
+
+/*  THIS FILE BUILDS THE SIMULATED NODES, LINKS, lansegments AND WIRELESS
+    MEDIUM FROM A TOPOLOGY, AND
+    SCHEDULES EACH NODE'S REBOOT.  IT IS SHARED BY cnetsim ITSELF, WHICH
+    THEN LOADS EACH NODE'S COPY OF THE PROTOCOL, AND BY PROGRAMS THAT RUN
+    PROTOCOLS LINKED INTO THEMSELVES (SUCH AS ../stack/stackbench).
+ */
+
+#define	DEFAULT_MESSAGERATE	1000000		// usecs, as in cnet
+#define	DEFAULT_MINMESSAGE	100		// bytes
+#define	DEFAULT_MAXMESSAGE	1000
+
+//  A NODE'S ATTRIBUTE, ELSE THE GLOBAL ONE, ELSE NULL
+const char *sim_attr(TOPOLOGY *topo, int n, const char *name)
+{
+    const char	*v	= topo_attr(topo->nodes[n].attrs,
+				    topo->nodes[n].nattrs, name);
+
+    return v ? v : topo_attr(topo->attrs, topo->nattrs, name);
+}
+
+static uint64_t mix(uint64_t x)			// splitmix64
+{
+    x	+= 0x9E3779B97F4A7C15ULL;
+    x	= (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x	= (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    x	^= x >> 31;
+    return x ? x : 1;
+}
+
+//  THE NODES AND LINKS OF topo, WITHOUT ANY PROTOCOL (n->reboot IS NULL)
+void sim_makenodes(TOPOLOGY *topo, uint64_t seed)
+{
+    sim_nnodes	= topo->nnodes;
+    sim_nodes	= calloc(sim_nnodes, sizeof(NODE));
+    for(int i=0 ; i<sim_nnodes ; ++i) {
+	NODE		*n	= &sim_nodes[i];
+	TOPONODE	*t	= &topo->nodes[i];
+	const char	*v;
+
+	n->info.nodetype	= t->router ? NT_ROUTER :
+				  t->mobile ? NT_MOBILE :
+				  t->accesspoint ? NT_ACCESSPOINT : NT_HOST;
+	n->info.nodenumber	= i;
+	n->info.address		= t->address;
+	n->info.nlinks		= t->nlinks;
+	snprintf(n->info.nodename, MAX_NODENAME_LEN, "%s", t->name);
+
+	v	= sim_attr(topo, i, "messagerate");
+	n->info.messagerate	= v ? topo_usecs(v) : DEFAULT_MESSAGERATE;
+	v	= sim_attr(topo, i, "minmessagesize");
+	n->info.minmessagesize	= v ? atoi(v) : DEFAULT_MINMESSAGE;
+	v	= sim_attr(topo, i, "maxmessagesize");
+	n->info.maxmessagesize	= v ? atoi(v) : DEFAULT_MAXMESSAGE;
+	if(n->info.minmessagesize < MIN_MESSAGE)
+	    n->info.minmessagesize	= MIN_MESSAGE;
+	if(n->info.maxmessagesize > MAX_MESSAGE_SIZE)
+	    n->info.maxmessagesize	= MAX_MESSAGE_SIZE;
+	if(n->info.maxmessagesize < n->info.minmessagesize)
+	    n->info.maxmessagesize	= n->info.minmessagesize;
+
+	n->links	= calloc(t->nlinks+1, sizeof(CnetLinkInfo));
+	n->ends		= calloc(t->nlinks+1, sizeof(LINKEND));
+	n->links[0].linktype	= LT_LOOPBACK;
+
+	n->enabled	= calloc(sim_nnodes, sizeof(bool));
+	n->nextseq	= calloc(sim_nnodes, sizeof(int32_t));
+	n->expectseq	= calloc(sim_nnodes, sizeof(int32_t));
+	n->msg		= malloc(MAX_MESSAGE_SIZE);
+	n->simrng	= mix(seed * 0x100000001ULL + 2*i);
+	n->rng		= mix(seed * 0x100000001ULL + 2*i + 1);
+    }
+
+    for(int l=0 ; l<topo->nlinks ; ++l) {
+	TOPOLINK	*tl	= &topo->links[l];
+	CnetLinkInfo	info	= { LT_WAN, true, (int)tl->bandwidth,
+				    tl->delay, 2*MAX_MESSAGE_SIZE };
+	LINKEND		end	= { 0, 0, 0, tl->probframeloss,
+				    tl->probframecorrupt };
+
+	sim_nodes[tl->from].links[tl->fromlink]	= info;
+	sim_nodes[tl->from].ends[tl->fromlink]	= end;
+	sim_nodes[tl->from].ends[tl->fromlink].peer	= tl->to;
+	sim_nodes[tl->from].ends[tl->fromlink].peerlink	= tl->tolink;
+	sim_nodes[tl->to].links[tl->tolink]	= info;
+	sim_nodes[tl->to].ends[tl->tolink]	= end;
+	sim_nodes[tl->to].ends[tl->tolink].peer		= tl->from;
+	sim_nodes[tl->to].ends[tl->tolink].peerlink	= tl->fromlink;
+    }
+
+    sim_nsegments	= topo->nsegments;
+    sim_segments	= calloc(sim_nsegments, sizeof(SEGMENT));
+    for(int s=0 ; s<sim_nsegments ; ++s) {
+	sim_segments[s].type	= topo->segments[s].wireless ? LT_WLAN : LT_LAN;
+	sim_segments[s].delay	= topo->segments[s].delay;
+	sim_segments[s].nodes	= calloc(topo->nattaches, sizeof(int));
+	sim_segments[s].links	= calloc(topo->nattaches, sizeof(int));
+    }
+    for(int a=0 ; a<topo->nattaches ; ++a) {
+	TOPOATTACH	*ta	= &topo->attaches[a];
+	TOPOSEGMENT	*ts	= &topo->segments[ta->segment];
+	SEGMENT		*seg	= &sim_segments[ta->segment];
+	CnetLinkInfo	info	= { seg->type, true, (int)ts->bandwidth,
+				    ts->delay, 2*MAX_MESSAGE_SIZE };
+	LINKEND		end	= { 0, 0, 0, ts->probframeloss,
+				    ts->probframecorrupt, seg };
+
+	sim_nodes[ta->node].links[ta->link]	= info;
+	sim_nodes[ta->node].ends[ta->link]	= end;
+	seg->nodes[seg->nattached]	= ta->node;
+	seg->links[seg->nattached]	= ta->link;
+	++seg->nattached;
+    }
+}
+
+//  SCHEDULE EVERY NODE'S REBOOT, AND ITS EV_PERIODIC, AFTER sim_partition()
+void sim_boot(void)
+{
+    for(int i=0 ; i<sim_nnodes ; ++i) {
+	EVENT	*e	= sim_newevent();
+
+	e->node	= i;
+	e->kind	= SE_REBOOT;
+	sim_schedule(&sim_nodes[i], e);
+	if(sim_period > 0) {
+	    e		= sim_newevent();
+	    e->time	= sim_period;
+	    e->node	= i;
+	    e->kind	= SE_PERIODIC;
+	    sim_schedule(&sim_nodes[i], e);
+	}
+    }
+}
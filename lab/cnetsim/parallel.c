@@ -0,0 +1,264 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cnetsim.h"
+
+/*  THIS FILE RUNS THE SIMULATION, ON ONE OR MORE THREADS.
+
+    The nodes are divided into partitions, each with its own event queue
+    and its own thread.  Nodes only affect each other by sending frames,
+    and a frame cannot arrive sooner than its link's propagation delay
+    after it was sent.  So if L is the shortest propagation delay of any
+    link between two partitions (the lookahead), every partition may
+    safely handle all of its events in the window [T, T+L), where T is
+    the time of the earliest pending event anywhere, without hearing
+    from the others: any frame sent to it in that window arrives at T+L
+    or later.  Windows are separated by a barrier.
+
+    Frames for another partition are passed through a lock-free single
+    producer, single consumer channel from each partition to each other
+    one.  Each partition handles its own nodes' events in the same
+    (time, creator, cseq) order as a single thread would, so the results
+    of a run do not depend on the number of threads.
+
+    With a single partition the lookahead is unbounded, and windows only
+    end to print the periodic statistics.
+ */
+
+#define	CHANNEL_SIZE	4096			// events, a power of 2
+#define	NEVER		INT64_MAX
+
+PARTITION		*sim_partitions		= NULL;
+int			sim_npartitions		= 0;
+__thread PARTITION	*sim_thispartition	= NULL;
+
+static	CnetTime	lookahead		= NEVER;
+
+static	atomic_int	arrived			= 0;	// at the barrier
+static	atomic_int	generation		= 0;
+
+// -----------------------------------------------------------------
+
+//  ONLY THE PRODUCER WRITES tail, AND ONLY THE CONSUMER WRITES head
+static bool channel_put(CHANNEL *c, EVENT *e)
+{
+    unsigned	tail	= atomic_load_explicit(&c->tail, memory_order_relaxed);
+
+    if(tail - atomic_load_explicit(&c->head, memory_order_acquire)
+							== CHANNEL_SIZE)
+	return false;
+    c->slots[tail & (CHANNEL_SIZE-1)]	= e;
+    atomic_store_explicit(&c->tail, tail+1, memory_order_release);
+    return true;
+}
+
+static EVENT *channel_get(CHANNEL *c)
+{
+    unsigned	head	= atomic_load_explicit(&c->head, memory_order_relaxed);
+    EVENT	*e;
+
+    if(head == atomic_load_explicit(&c->tail, memory_order_acquire))
+	return NULL;
+    e	= c->slots[head & (CHANNEL_SIZE-1)];
+    atomic_store_explicit(&c->head, head+1, memory_order_release);
+    return e;
+}
+
+//  MOVE ALL FRAMES SENT TO THIS PARTITION INTO ITS QUEUE.  THEY ALL ARRIVE
+//  AFTER THE CURRENT WINDOW, SO THIS MAY BE DONE AT ANY TIME.
+static void drain(PARTITION *p)
+{
+    EVENT	*e;
+
+    for(int from=0 ; from<sim_npartitions ; ++from)
+	while((e = channel_get(&p->in[from])) != NULL)
+	    sim_eq_push(&p->queue, e);
+}
+
+void sim_partition_push(PARTITION *to, EVENT *e)
+{
+    PARTITION	*from	= sim_thispartition;
+
+    if(from == NULL || from == to) {
+	sim_eq_push(&to->queue, e);
+	return;
+    }
+//  IF THE CHANNEL IS FULL, ITS CONSUMER MAY ITSELF BE WAITING ON US
+    while(!channel_put(&to->in[from->index], e)) {
+	drain(from);
+	sched_yield();
+    }
+}
+
+static void barrier(PARTITION *p)
+{
+    int	gen	= atomic_load(&generation);
+
+    if(atomic_fetch_add(&arrived, 1) == sim_npartitions-1) {
+	atomic_store(&arrived, 0);
+	atomic_fetch_add(&generation, 1);
+    }
+    else
+	while(atomic_load(&generation) == gen) {
+	    drain(p);
+	    sched_yield();
+	}
+}
+
+// -----------------------------------------------------------------
+
+//  HANDLE ALL OF THIS PARTITION'S EVENTS BEFORE end
+static void run_window(PARTITION *p, CnetTime end)
+{
+    EVENTQUEUE	*q	= &p->queue;
+    EVENT	*e;
+
+    while(q->nevents > 0 && q->heap[0]->time < end) {
+	e	= sim_eq_pop(q);
+	if(!e->cancelled) {
+	    sim_dispatch(e);
+	    ++p->nevents;
+	}
+	if(e->kind == SE_PERIODIC && e->time + sim_period <= sim_duration) {
+	    e->time	+= sim_period;		// the same event, rescheduled
+	    sim_schedule(&sim_nodes[e->node], e);
+	}
+	else
+	    sim_freeevent(e);
+    }
+}
+
+static void *worker(void *arg)
+{
+    PARTITION	*p		= arg;
+    CnetTime	nextreport	= (sim_showstats && sim_period > 0) ?
+					sim_period : NEVER;
+
+    sim_thispartition	= p;
+    for(;;) {
+	CnetTime	next	= NEVER, end;
+
+	drain(p);
+	p->next	= (p->queue.nevents > 0) ? p->queue.heap[0]->time : NEVER;
+	barrier(p);
+	for(int i=0 ; i<sim_npartitions ; ++i)
+	    if(next > sim_partitions[i].next)
+		next	= sim_partitions[i].next;
+	if(next > sim_duration)
+	    break;
+
+//  EVERY THREAD AGREES WHEN TO REPORT, BUT ONLY THE FIRST REPORTS
+	if(next >= nextreport && nextreport < sim_duration) {
+	    while(next >= nextreport && nextreport < sim_duration) {
+		if(p->index == 0)
+		    sim_report(nextreport);
+		nextreport	+= sim_period;
+	    }
+	    barrier(p);			// no one moves on until it is printed
+	}
+	end	= (next > NEVER - lookahead) ? NEVER : next + lookahead;
+	if(end > nextreport && nextreport < sim_duration)
+	    end	= nextreport;
+	if(end > sim_duration)
+	    end	= sim_duration + 1;
+
+	run_window(p, end);
+	barrier(p);			// all frames for the window are sent
+    }
+    return NULL;
+}
+
+// -----------------------------------------------------------------
+
+/*  DIVIDE THE NODES INTO nparts PARTITIONS OF NEARLY EQUAL SIZE.  NODES
+    ARE TAKEN IN BREADTH-FIRST ORDER, SO THAT NEIGHBOURS TEND TO SHARE A
+    PARTITION AND FEW LINKS CROSS BETWEEN PARTITIONS.
+ */
+void sim_partition(int nparts)
+{
+    int		*order	= malloc(sim_nnodes * sizeof(int));
+    bool	*seen	= calloc(sim_nnodes, sizeof(bool));
+    int		norder	= 0;
+
+    if(nparts > sim_nnodes)
+	nparts	= sim_nnodes;
+    if(nparts > 1 && sim_nsegments > 0) {
+	fprintf(stderr, "cnetsim: LAN and WLAN links are simulated by only "
+			"one thread\n");
+	nparts	= 1;
+    }
+    if(nparts < 1)
+	nparts	= 1;
+
+    for(int start=0 ; start<sim_nnodes ; ++start) {
+	if(seen[start])
+	    continue;
+	seen[start]	= true;
+	order[norder++]	= start;
+	for(int o=norder-1 ; o<norder ; ++o) {
+	    NODE	*n	= &sim_nodes[order[o]];
+
+	    for(int l=1 ; l<=n->info.nlinks ; ++l)
+		if(!seen[n->ends[l].peer]) {
+		    seen[n->ends[l].peer]	= true;
+		    order[norder++]		= n->ends[l].peer;
+		}
+	}
+    }
+    for(int o=0 ; o<sim_nnodes ; ++o)
+	sim_nodes[order[o]].partition	= (int)((int64_t)o * nparts / sim_nnodes);
+    free(order);
+    free(seen);
+
+//  THE LOOKAHEAD IS THE SHORTEST DELAY OF ANY LINK BETWEEN PARTITIONS
+    lookahead	= NEVER;
+    for(int i=0 ; i<sim_nnodes ; ++i) {
+	NODE	*n	= &sim_nodes[i];
+
+	for(int l=1 ; l<=n->info.nlinks ; ++l)
+	    if(sim_nodes[n->ends[l].peer].partition != n->partition &&
+		    lookahead > n->links[l].propagationdelay)
+		lookahead	= n->links[l].propagationdelay;
+    }
+    if(lookahead <= 0) {
+	fprintf(stderr, "cnetsim: a link has no propagation delay, "
+			"so using only one thread\n");
+	for(int i=0 ; i<sim_nnodes ; ++i)
+	    sim_nodes[i].partition	= 0;
+	nparts		= 1;
+	lookahead	= NEVER;
+    }
+
+    sim_npartitions	= nparts;
+    sim_partitions	= calloc(nparts, sizeof(PARTITION));
+    for(int p=0 ; p<nparts ; ++p) {
+	sim_partitions[p].index	= p;
+	sim_eq_init(&sim_partitions[p].queue);
+	sim_partitions[p].in	= calloc(nparts, sizeof(CHANNEL));
+	for(int from=0 ; from<nparts ; ++from)
+	    sim_partitions[p].in[from].slots =
+				malloc(CHANNEL_SIZE * sizeof(EVENT *));
+    }
+}
+
+//  RUN THE WHOLE SIMULATION, RETURNING THE NUMBER OF EVENTS HANDLED
+int64_t sim_run(void)
+{
+    int64_t	nevents	= 0;
+
+    for(int p=1 ; p<sim_npartitions ; ++p)
+	if(pthread_create(&sim_partitions[p].thread, NULL,
+				worker, &sim_partitions[p]) != 0) {
+	    perror("pthread_create");
+	    exit(EXIT_FAILURE);
+	}
+    worker(&sim_partitions[0]);
+    for(int p=1 ; p<sim_npartitions ; ++p)
+	pthread_join(sim_partitions[p].thread, NULL);
+
+    for(int p=0 ; p<sim_npartitions ; ++p)
+	nevents	+= sim_partitions[p].nevents;
+    return nevents;
+}
@@ -0,0 +1,127 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "cnetsim.h"
+
+/*  THIS FILE SIMULATES THE SHARED MEDIUM OF EACH lansegment, AND OF THE
+    WIRELESS LINKS (ONE MEDIUM, SHARED BY EVERY wlan LINK).
+
+    Every node attached to a segment hears every frame sent on it.  The
+    propagation delay across a segment is the same between any two of its
+    nodes, so a node senses another's frame from when its first bit
+    arrives (the delay after it was sent) until its last bit has passed,
+    and each other node receives the frame the delay after it was sent
+    in full.
+
+    For the same reason, two frames overlap wherever they are heard if
+    one is sent before the other has finished: when its sender sensed an
+    idle medium because the other's first bit had not yet reached it, or
+    when its sender did not sense the carrier at all.  Neither frame is
+    then received by anyone.  On a lansegment every node is told of the
+    collision with EV_FRAMECOLLISION when the later frame's first bit has
+    crossed the segment; a wireless sender cannot hear a collision, and
+    learns of it only when no reply comes.
+
+    A node's frames on a segment affect the delivery of others' as they
+    are sent, so topologies with segments are simulated by one thread.
+ */
+
+SEGMENT		*sim_segments	= NULL;
+int		sim_nsegments	= 0;
+
+//  FORGET THE FRAMES THAT HAVE PASSED EVERY NODE
+static void prune(SEGMENT *s, CnetTime now)
+{
+    ONAIR	**p	= &s->onair;
+
+    while(*p != NULL) {
+	ONAIR	*f	= *p;
+
+	if(f->end + s->delay <= now) {
+	    *p	= f->next;
+	    free(f->arrivals);
+	    free(f);
+	}
+	else
+	    p	= &f->next;
+    }
+}
+
+//  A FRAME THAT HAS COLLIDED IS NOT RECEIVED
+static void collide(ONAIR *f)
+{
+    if(f->collided)
+	return;
+    f->collided	= true;
+    for(int a=0 ; a<f->narrivals ; ++a)
+	f->arrivals[a]->cancelled	= true;	// discarded when at the top
+    f->narrivals	= 0;
+    ++sim_nodes[f->sender].stats.frames_collided;
+}
+
+//  IS ANOTHER NODE'S FRAME PASSING THIS NODE ON THE SEGMENT?
+bool sim_segment_busy(SEGMENT *s, int node, CnetTime now)
+{
+    prune(s, now);
+    for(ONAIR *f=s->onair ; f ; f=f->next)
+	if(f->sender != node && f->start + s->delay <= now)
+	    return true;
+    return false;
+}
+
+/*  SEND THE FRAME IN e, WHICH TAKES txtime usecs, FROM n's link TO ITS
+    SEGMENT.  e IS COPIED FOR EACH OTHER NODE, AND THEN FREED.
+ */
+void sim_segment_send(NODE *n, int link, EVENT *e, CnetTime txtime, bool lost)
+{
+    SEGMENT	*s	= n->ends[link].segment;
+    CnetTime	now	= sim_thisevent->time;
+    int		node	= (int)(n - sim_nodes);
+    ONAIR	*f	= calloc(1, sizeof(ONAIR));
+    bool	collision	= false;
+
+    prune(s, now);
+    for(ONAIR *g=s->onair ; g ; g=g->next)
+	if(g->end > now) {		// still being sent, so we overlap
+	    collide(g);
+	    collision	= true;
+	}
+    f->sender	= node;
+    f->start	= now;
+    f->end	= now + txtime;
+    f->next	= s->onair;
+    s->onair	= f;
+
+    if(collision) {
+	collide(f);
+	for(int a=0 ; s->type == LT_LAN && a<s->nattached ; ++a) {
+	    EVENT	*c	= sim_newevent();
+
+	    c->time	= now + s->delay;
+	    c->node	= s->nodes[a];
+	    c->kind	= SE_COLLISION;
+	    c->link	= s->links[a];
+	    sim_schedule(n, c);
+	}
+    }
+    else if(!lost) {
+	f->arrivals	= malloc(s->nattached * sizeof(EVENT *));
+	for(int a=0 ; a<s->nattached ; ++a) {
+	    EVENT	*r;
+
+	    if(s->nodes[a] == node)
+		continue;
+	    r		= sim_newevent();
+	    r->time	= f->end + s->delay;
+	    r->node	= s->nodes[a];
+	    r->kind	= SE_FRAME;
+	    r->link	= s->links[a];
+	    r->len	= e->len;
+	    r->frame	= malloc(e->len);
+	    memcpy(r->frame, e->frame, e->len);
+	    sim_schedule(n, r);
+	    f->arrivals[f->narrivals++]	= r;
+	}
+    }
+    sim_freeevent(e);
+}
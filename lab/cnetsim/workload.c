@@ -0,0 +1,227 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "cnetsim.h"
+
+/*  THIS FILE RECORDS THE MESSAGES THAT EACH NODE'S PROTOCOL READS FROM ITS
+    APPLICATION LAYER, AND REPLAYS THEM TO ANOTHER RUN, SO THAT PROTOCOLS
+    MAY BE COMPARED ON EXACTLY THE SAME WORKLOAD.
+
+    With -w, each CNET_read_application() appends (time, destination,
+    length) to its node's trace, and the traces are written when the run
+    ends.  With -r, no messages are generated at random: each node offers
+    its recorded messages at their recorded times, whatever the seed.  A
+    message whose destination the protocol has disabled is held until it
+    is enabled again, and is then offered before any later message; its
+    delivery time is still measured from its recorded time, so a protocol
+    that throttles its sources is not flattered.
+
+    The file holds a header, then each node's name and trace.  Times are
+    stored as the difference from the node's previous message, and all
+    numbers as variable length (7 bits per byte) integers, so each
+    message takes about 7 bytes.
+ */
+
+#define	MAGIC		"cnetwl1\n"
+
+bool		sim_replaying	= false;
+
+static	const char	*recordfile	= NULL;
+
+// -----------------------------------------------------------------
+
+static void put_varint(FILE *fp, uint64_t v)
+{
+    while(v >= 0x80) {
+	putc((int)(v & 0x7F) | 0x80, fp);
+	v	>>= 7;
+    }
+    putc((int)v, fp);
+}
+
+static bool get_varint(FILE *fp, uint64_t *v)
+{
+    int		c, shift	= 0;
+
+    *v	= 0;
+    do {
+	if((c = getc(fp)) == EOF || shift > 63)
+	    return false;
+	*v	|= (uint64_t)(c & 0x7F) << shift;
+	shift	+= 7;
+    } while(c & 0x80);
+    return true;
+}
+
+static void append(NODE *n, CnetTime time, int dest, size_t length)
+{
+    if(n->ntrace == n->maxtrace) {
+	n->maxtrace	= (n->maxtrace == 0) ? 1024 : 2*n->maxtrace;
+	n->trace	= realloc(n->trace, n->maxtrace * sizeof(WLRECORD));
+    }
+    n->trace[n->ntrace].time	= time;
+    n->trace[n->ntrace].dest	= dest;
+    n->trace[n->ntrace].length	= (uint32_t)length;
+    ++n->ntrace;
+}
+
+// -----------------------------------------------------------------
+
+void sim_record_workload(const char *filename)
+{
+    recordfile	= filename;
+}
+
+//  CALLED BY CNET_read_application(), ON THE NODE'S OWN THREAD
+void sim_recordmessage(NODE *n, int dest, size_t length)
+{
+    if(recordfile != NULL)
+	append(n, sim_thisevent->time, dest, length);
+}
+
+//  WRITE EVERY NODE'S TRACE, WHEN THE SIMULATION HAS FINISHED
+void sim_save_workload(void)
+{
+    FILE	*fp;
+
+    if(recordfile == NULL)
+	return;
+    if((fp = fopen(recordfile, "wb")) == NULL) {
+	perror(recordfile);
+	exit(EXIT_FAILURE);
+    }
+    fputs(MAGIC, fp);
+    put_varint(fp, sim_nnodes);
+    for(int i=0 ; i<sim_nnodes ; ++i) {
+	NODE		*n	= &sim_nodes[i];
+	CnetTime	prev	= 0;
+
+	fputs(n->info.nodename, fp);
+	putc('\0', fp);
+	put_varint(fp, n->ntrace);
+	for(int m=0 ; m<n->ntrace ; ++m) {
+	    put_varint(fp, n->trace[m].time - prev);
+	    put_varint(fp, n->trace[m].dest);
+	    put_varint(fp, n->trace[m].length);
+	    prev	= n->trace[m].time;
+	}
+    }
+    if(fclose(fp) != 0) {
+	perror(recordfile);
+	exit(EXIT_FAILURE);
+    }
+}
+
+//  READ A TRACE, WHICH MUST HAVE BEEN RECORDED ON THE SAME TOPOLOGY
+void sim_replay_workload(const char *filename)
+{
+    FILE	*fp;
+    char	magic[sizeof(MAGIC)];
+    uint64_t	nnodes, count, delta, dest, length;
+
+    if((fp = fopen(filename, "rb")) == NULL) {
+	perror(filename);
+	exit(EXIT_FAILURE);
+    }
+    if(fread(magic, 1, strlen(MAGIC), fp) != strlen(MAGIC) ||
+	memcmp(magic, MAGIC, strlen(MAGIC)) != 0 ||
+	!get_varint(fp, &nnodes))
+	goto corrupt;
+    if(nnodes != (uint64_t)sim_nnodes)
+	goto mismatch;
+
+    for(int i=0 ; i<sim_nnodes ; ++i) {
+	NODE		*n	= &sim_nodes[i];
+	char		name[MAX_NODENAME_LEN];
+	CnetTime	time	= 0;
+	int		c, len	= 0;
+
+	while((c = getc(fp)) != '\0') {
+	    if(c == EOF || len == MAX_NODENAME_LEN-1)
+		goto corrupt;
+	    name[len++]	= c;
+	}
+	name[len]	= '\0';
+	if(strcmp(name, n->info.nodename) != 0)
+	    goto mismatch;
+
+	if(!get_varint(fp, &count))
+	    goto corrupt;
+	for(uint64_t m=0 ; m<count ; ++m) {
+	    if(!get_varint(fp, &delta) || !get_varint(fp, &dest) ||
+		!get_varint(fp, &length) ||
+		dest >= (uint64_t)sim_nnodes || dest == (uint64_t)i ||
+		length < MIN_MESSAGE || length > MAX_MESSAGE_SIZE)
+		goto corrupt;
+	    time	+= delta;
+	    append(n, time, (int)dest, length);
+	}
+    }
+    fclose(fp);
+    sim_replaying	= true;
+    return;
+
+corrupt:
+    fprintf(stderr, "cnetsim: %s is not a workload trace\n", filename);
+    exit(EXIT_FAILURE);
+mismatch:
+    fprintf(stderr, "cnetsim: %s was recorded on a different topology\n",
+		filename);
+    exit(EXIT_FAILURE);
+}
+
+// -----------------------------------------------------------------
+
+/*  THE RECORDED MESSAGE TO OFFER NEXT: THE EARLIEST THAT IS DUE AND WHOSE
+    DESTINATION IS ENABLED, OR -1.  OFFERED MESSAGES ARE MARKED BY A dest
+    OF -1, AND n->replayed SKIPS OVER ALL THOSE AT THE FRONT.
+ */
+static int next_due(NODE *n, CnetTime now)
+{
+    while(n->replayed < n->ntrace && n->trace[n->replayed].dest < 0)
+	++n->replayed;
+    for(int m=n->replayed ; m<n->ntrace && n->trace[m].time <= now ; ++m)
+	if(n->trace[m].dest >= 0 && n->enabled[n->trace[m].dest])
+	    return m;
+    return -1;
+}
+
+//  WHEN SHOULD THE NODE NEXT BE ASKED TO OFFER A MESSAGE?
+static void schedule_next(NODE *n, CnetTime now)
+{
+    int		m;
+
+    if(next_due(n, now) >= 0) {
+	sim_schedule_message(n, now);
+	return;
+    }
+    for(m=n->replayed ; m<n->ntrace && n->trace[m].time <= now ; ++m)
+	;
+    if(m < n->ntrace)
+	sim_schedule_message(n, n->trace[m].time);
+}
+
+//  SE_MESSAGE WHEN REPLAYING - OFFER THE NEXT RECORDED MESSAGE, IF ANY
+void sim_replaymessage(NODE *n)
+{
+    CnetTime	now	= sim_thisevent->time;
+    int		m;
+
+    n->generating	= false;
+    if((m = next_due(n, now)) >= 0) {
+	int	dest	= n->trace[m].dest;
+
+	n->trace[m].dest	= -1;		// offered, even if not read
+	sim_makemessage(n, dest, n->trace[m].length, n->trace[m].time);
+    }
+//  THE PROTOCOL MAY HAVE ENABLED A DESTINATION, AND SO WOKEN US ALREADY
+    if(!n->generating)
+	schedule_next(n, now);
+}
+
+//  A DESTINATION HAS BEEN ENABLED, SO HELD MESSAGES MAY NOW BE DUE
+void sim_replaywake(NODE *n)
+{
+    if(!n->generating)
+	schedule_next(n, sim_thisevent->time);
+}
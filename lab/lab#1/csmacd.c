@@ -0,0 +1,216 @@
+#include <cnet.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mac.h"
+
+/*  THIS FILE PROVIDES A CSMA/CD MEDIUM ACCESS CONTROL LAYER FOR LINKS TO
+    A lansegment (ETHERNET).  WRITING DIRECTLY TO A SHARED SEGMENT WITH
+    CNET_write_physical() WASTES THE MEDIUM WHENEVER TWO NODES TRANSMIT AT
+    ONCE, AND FAILS WITH ER_TOOBUSY IF OUR OWN INTERFACE IS STILL SENDING.
+
+    Instead, each frame is appended to a per-link transmit queue.  The
+    frame at the head of the queue is only written once carrier sense
+    reports the segment idle; if it is busy we defer, sensing again each
+    slot time.  cnet reports collisions on a LAN with EV_FRAMECOLLISION;
+    a collision during our transmission schedules a retry after a
+    truncated binary exponential backoff of 0..2^min(k,10)-1 slot times,
+    where k is the number of collisions that frame has suffered.
+    A frame is abandoned after MAX_ATTEMPTS collisions.
+ */
+
+#define	SLOT_BITS	512		// Ethernet slot time, in bit times
+#define	GAP_BITS	96		// interframe gap, in bit times
+#define	MAX_BACKOFF	10		// backoff exponent is truncated here
+#define	MAX_ATTEMPTS	16
+
+typedef struct _qframe {
+    struct _qframe	*next;
+    size_t		length;
+    char		data[];
+} QFRAME;
+
+typedef enum { MAC_IDLE, MAC_DEFERRING, MAC_SENDING, MAC_BACKOFF } MACSTATE;
+
+typedef struct {
+    MACSTATE		state;
+    QFRAME		*head, *tail;	// transmit queue, head is in progress
+    int			qlength;
+    int			attempts;	// collisions suffered by head frame
+    CnetTimerID		timer;
+
+    int			nsent;		// statistics
+    int			ncollisions;
+    int			ndeferred;
+    int			ndropped;
+} MACLINK;
+
+static	MACLINK		*mac	= NULL;
+
+// -----------------------------------------------------------------
+
+static CnetTime bits_to_usec(int link, int bits)
+{
+    CnetTime	usec = ((CnetTime)bits * 1000000) / linkinfo[link].bandwidth;
+
+    return (usec > 0) ? usec : 1;
+}
+
+//  REMOVE (AND FREE) THE FRAME AT THE HEAD OF THE QUEUE
+static void dequeue(MACLINK *m)
+{
+    QFRAME	*f	= m->head;
+
+    m->head	= f->next;
+    if(m->head == NULL)
+	m->tail	= NULL;
+    --m->qlength;
+    m->attempts	= 0;
+    free(f);
+}
+
+//  ATTEMPT TO TRANSMIT THE FRAME AT THE HEAD OF THE QUEUE
+static void try_transmit(int link)
+{
+    MACLINK	*m	= &mac[link];
+    size_t	length;
+
+    if(m->head == NULL) {
+	m->state	= MAC_IDLE;
+	return;
+    }
+
+//  CARRIER SENSE - IF SOMEONE ELSE IS TRANSMITTING, DEFER FOR A SLOT
+    if(CNET_carrier_sense(link) == 1) {
+	++m->ndeferred;
+	m->state	= MAC_DEFERRING;
+	m->timer	= CNET_start_timer(EV_TIMER1,
+				bits_to_usec(link, SLOT_BITS), (CnetData)link);
+	return;
+    }
+
+    length	= m->head->length;
+    if(CNET_write_physical(link, m->head->data, &length) != 0) {
+	if(cnet_errno != ER_TOOBUSY)
+	    CNET_exit(__FILE__, __func__, __LINE__);
+	m->state	= MAC_DEFERRING;	// our interface is still busy
+	m->timer	= CNET_start_timer(EV_TIMER1,
+				bits_to_usec(link, SLOT_BITS), (CnetData)link);
+	return;
+    }
+
+//  THE FRAME IS DELIVERED UNLESS A COLLISION IS REPORTED BEFORE IT ENDS
+    m->state	= MAC_SENDING;
+    m->timer	= CNET_start_timer(EV_TIMER2,
+			bits_to_usec(link, 8*(int)length + GAP_BITS),
+			(CnetData)link);
+}
+
+//  EV_TIMER1 - A DEFERRAL OR BACKOFF PERIOD HAS EXPIRED
+static EVENT_HANDLER(retry_timeout)
+{
+    int		link	= (int)data;
+
+    mac[link].timer	= NULLTIMER;
+    try_transmit(link);
+}
+
+//  EV_TIMER2 - OUR FRAME HAS LEFT THE INTERFACE WITHOUT A COLLISION
+static EVENT_HANDLER(sent_timeout)
+{
+    int		link	= (int)data;
+    MACLINK	*m	= &mac[link];
+
+    m->timer	= NULLTIMER;
+    ++m->nsent;
+    dequeue(m);
+    try_transmit(link);
+}
+
+//  BACK OFF FROM A COLLISION WITH THE FRAME WE ARE SENDING ON link
+static void backoff(int link)
+{
+    MACLINK	*m	= &mac[link];
+    int		k, slots;
+
+    CNET_stop_timer(m->timer);
+    ++m->ncollisions;
+    if(++m->attempts >= MAX_ATTEMPTS) {
+	++m->ndropped;
+	dequeue(m);
+	try_transmit(link);
+	return;
+    }
+
+    k		= (m->attempts < MAX_BACKOFF) ? m->attempts : MAX_BACKOFF;
+    slots	= CNET_rand() % (1 << k);
+    m->state	= MAC_BACKOFF;
+    m->timer	= CNET_start_timer(EV_TIMER1,
+			bits_to_usec(link, slots*SLOT_BITS + GAP_BITS),
+			(CnetData)link);
+}
+
+//  EV_FRAMECOLLISION - BACK OFF IF THE COLLISION INVOLVED OUR FRAME.
+//  cnet does not say on which link it happened, so any LAN link that is
+//  still sending has collided
+static EVENT_HANDLER(collision)
+{
+    for(int link=1 ; link<=nodeinfo.nlinks ; ++link)
+	if(linkinfo[link].linktype == LT_LAN && mac[link].state == MAC_SENDING)
+	    backoff(link);
+}
+
+// -----------------------------------------------------------------
+
+//  CSMACD_write() QUEUES A FRAME FOR TRANSMISSION ON A LAN LINK
+int CSMACD_write(int link, char *frame, size_t length)
+{
+    MACLINK	*m;
+    QFRAME	*f;
+
+    if(link < 1 || link > nodeinfo.nlinks) {
+	cnet_errno	= ER_BADLINK;
+	return(-1);
+    }
+    m	= &mac[link];
+    if(m->qlength >= MAC_MAXQUEUE) {
+	++m->ndropped;
+	cnet_errno	= ER_TOOBUSY;
+	return(-1);
+    }
+
+    f		= malloc(sizeof(QFRAME) + length);
+    f->next	= NULL;
+    f->length	= length;
+    memcpy(f->data, frame, length);
+    if(m->tail == NULL)
+	m->head	= f;
+    else
+	m->tail->next	= f;
+    m->tail	= f;
+    ++m->qlength;
+
+    if(m->state == MAC_IDLE)
+	try_transmit(link);
+    return(0);
+}
+
+void CSMACD_showstats(void)
+{
+    for(int link=1 ; link<=nodeinfo.nlinks ; ++link) {
+	MACLINK	*m	= &mac[link];
+
+	printf(" Link %d: sent=%d collisions=%d deferred=%d dropped=%d queued=%d\n",
+		link, m->nsent, m->ncollisions, m->ndeferred,
+		m->ndropped, m->qlength);
+    }
+}
+
+void reboot_CSMACD(void)
+{
+    mac		= calloc(nodeinfo.nlinks+1, sizeof(MACLINK));
+
+    CHECK(CNET_set_handler(EV_TIMER1,		retry_timeout, 0));
+    CHECK(CNET_set_handler(EV_TIMER2,		sent_timeout, 0));
+    CHECK(CNET_set_handler(EV_FRAMECOLLISION,	collision, 0));
+}
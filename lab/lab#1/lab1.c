@@ -1,5 +1,7 @@
 #include <cnet.h>
 
+#include "mac.h"
+
 /*  This function will be invoked each time the Application Layer has a
     message to deliver. Once we read the message from the application layer
     with CNET_read_application(), the Application Layer will be able to supply
@@ -24,7 +26,18 @@ static EVENT_HANDLER(application_ready)
     //CNET_disable_application(ALLNODES);
 
     CNET_read_application(&destaddr, buffer, &length);
-    CNET_write_physical(link, buffer, &length);
+
+/*  Shared LAN and WLAN links need medium access control; WAN links do not */
+    if(linkinfo[link].linktype == LT_LAN) {
+        if(CSMACD_write(link, buffer, length) != 0)
+            printf("\tMAC queue is full, message dropped\n");
+    }
+    else if(linkinfo[link].linktype == LT_WLAN) {
+        if(WLAN_write(link, destaddr, buffer, length) != 0)
+            printf("\tMAC queue is full, message dropped\n");
+    }
+    else
+        CNET_write_physical(link, buffer, &length);
 
     printf("\tI have a message of %4d bytes for address %d\n",
 			    length, (int)destaddr);
@@ -36,9 +49,22 @@ static EVENT_HANDLER(button_pressed)
     printf(" Node number     : %d\n",	nodeinfo.nodenumber);
     printf(" Node address    : %d\n",	nodeinfo.address);
     printf(" Number of links : %d\n\n",	nodeinfo.nlinks);
+    if(linkinfo[1].linktype == LT_LAN)
+        CSMACD_showstats();
+    else if(linkinfo[1].linktype == LT_WLAN)
+        WLAN_showstats();
 }
 
 ///////////////////////////////////////////////////////////////////
+/*  Messages arriving from the physical layer, or from a MAC layer which
+    has removed its own header, are passed up to the application here. */
+int up_to_application(char *msg, size_t length)
+{
+    CNET_write_application(msg, &length);
+    printf("\tI receive a message of %4d bytes\n", (int)length);
+    return(0);
+}
+
 static EVENT_HANDLER(physical_ready) {
   // CnetAddr   destaddr;
     int link;
@@ -50,9 +76,7 @@ static EVENT_HANDLER(physical_ready) {
     /*Accept the message from the Application Layer. We will be informed of the
       message's destination address and length and buffer will be filled in. */
     CNET_read_physical(&link, buffer, &length);
-    CNET_write_application(buffer, &length);
-    printf("\tI receive a message of %4d bytes\n", length);
-    
+    up_to_application(buffer, length);
 }
 
 ///////////////////////////////////////////////////////////////////
@@ -63,11 +87,18 @@ EVENT_HANDLER(reboot_node)
  */
     
     CNET_set_handler(EV_APPLICATIONREADY, application_ready, 0);
-    if (nodeinfo.address == 200){
-      CNET_set_handler(EV_PHYSICALREADY, physical_ready, 0);
+    if(linkinfo[1].linktype == LT_WLAN)
+        reboot_WLAN();          /* every node must answer RTS and DATA */
+    else {
+        if(linkinfo[1].linktype == LT_LAN)
+            reboot_CSMACD();
+        if (nodeinfo.address == 200){
+          CNET_set_handler(EV_PHYSICALREADY, physical_ready, 0);
+        }
     }
     CNET_set_handler(EV_DEBUG0, button_pressed, 0);
     CNET_set_debug_string(EV_DEBUG0, "Node Info");
+    CNET_set_handler(EV_SHUTDOWN, button_pressed, 0);	/* MAC counters too */
 
     CNET_enable_application(200);
 }
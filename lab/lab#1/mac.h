@@ -0,0 +1,15 @@
+#include <cnet.h>
+
+/* ------- DECLARATIONS FOR MEDIUM ACCESS CONTROL ON SHARED LINKS -------- */
+
+#define	MAC_MAXQUEUE	64		// frames waiting per link
+
+//  CSMA/CD FOR lansegment LINKS, PROVIDED BY csmacd.c
+extern	void	reboot_CSMACD(void);
+extern	int	CSMACD_write(int link, char *frame, size_t length);
+extern	void	CSMACD_showstats(void);
+
+//  RTS/CTS AND CONTENTION WINDOW ACCESS FOR wlan LINKS, PROVIDED BY wlanmac.c
+extern	void	reboot_WLAN(void);
+extern	int	WLAN_write(int link, CnetAddr dest, char *frame, size_t length);
+extern	void	WLAN_showstats(void);
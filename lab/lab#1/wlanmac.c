@@ -0,0 +1,349 @@
+#include <cnet.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mac.h"
+
+/*  THIS FILE PROVIDES A MEDIUM ACCESS CONTROL LAYER FOR WIRELESS (WLAN)
+    LINKS, LOOSELY BASED ON THE 802.11 DISTRIBUTED COORDINATION FUNCTION.
+
+    Mobile nodes cannot rely on carrier sense alone, because two nodes
+    that cannot hear each other (hidden terminals) may both reach the
+    same receiver.  So:
+
+    1) before each transmission attempt a node waits for DIFS plus a
+       random number of slots drawn from its contention window, and
+       starts again if the medium is then busy;
+    2) frames longer than RTS_THRESHOLD are preceded by an RTS/CTS
+       exchange; every node overhearing an RTS or CTS not addressed to
+       it sets its network allocation vector (NAV) and stays quiet for
+       the duration announced in the frame, which silences hidden nodes;
+    3) the receiver acknowledges each DATA frame after SIFS.  A missing
+       CTS or ACK doubles the contention window (up to CW_MAX) and the
+       frame is retried, at most MAX_RETRIES times.
+
+    Each frame carries a CCITT checksum; corrupted frames are ignored and
+    will be recovered by the sender's retry.
+ */
+
+#define	RTS_THRESHOLD	256		// bytes of payload
+#define	SLOT_TIME	500		// usec
+#define	SIFS		250		// usec
+#define	DIFS		(SIFS + 2*SLOT_TIME)
+#define	CW_MIN		16		// slots
+#define	CW_MAX		1024
+#define	MAX_RETRIES	7
+#define	MAX_PEERS	64		// for duplicate detection
+
+typedef enum { WF_RTS, WF_CTS, WF_DATA, WF_ACK } WLANKIND;
+
+typedef struct {
+    WLANKIND	kind;
+    CnetAddr	src;
+    CnetAddr	dest;
+    int		seq;
+    CnetTime	duration;	// medium reserved for this long after frame
+    int		checksum;
+    size_t	len;		// length of the payload only
+    char	payload[MAX_MESSAGE_SIZE];
+} WLANFRAME;
+
+#define	WLAN_HEADER_SIZE	(sizeof(WLANFRAME) - MAX_MESSAGE_SIZE)
+#define	WLAN_FRAME_SIZE(f)	(WLAN_HEADER_SIZE + (f).len)
+
+typedef struct _qframe {
+    struct _qframe	*next;
+    CnetAddr		dest;
+    int			seq;
+    size_t		length;
+    char		data[];
+} QFRAME;
+
+typedef enum { W_IDLE, W_CONTEND, W_WAITCTS, W_WAITACK } WLANSTATE;
+
+static	int		wlink		= 1;	// our (only) WLAN link
+static	WLANSTATE	state		= W_IDLE;
+static	QFRAME		*head		= NULL, *tail = NULL;
+static	int		qlength		= 0;
+static	int		cw		= CW_MIN;
+static	int		retries		= 0;
+static	int		nextseq		= 0;
+static	CnetTime	nav_until	= 0;
+static	CnetTimerID	contend_timer	= NULLTIMER;
+static	CnetTimerID	reply_timer	= NULLTIMER;
+
+static	WLANFRAME	pending;		// CTS, DATA or ACK awaiting SIFS
+
+static	struct { CnetAddr addr; int seq; } lastseen[MAX_PEERS];
+static	int		npeers		= 0;
+
+static	int		nsent, nretries, ndropped, ndelivered, nduplicates;
+
+// -----------------------------------------------------------------
+
+static CnetTime airtime(size_t bytes)
+{
+    return ((CnetTime)bytes * 8000000) / linkinfo[wlink].bandwidth;
+}
+
+static bool medium_busy(void)
+{
+    return nodeinfo.time_in_usec < nav_until || CNET_carrier_sense(wlink) == 1;
+}
+
+static void send_frame(WLANFRAME *f)
+{
+    size_t	length	= WLAN_FRAME_SIZE(*f);
+
+    f->checksum	= 0;
+    f->checksum	= CNET_ccitt((unsigned char *)f, (int)length);
+    if(CNET_write_physical(wlink, f, &length) != 0 && cnet_errno != ER_TOOBUSY)
+	CNET_exit(__FILE__, __func__, __LINE__);
+}
+
+//  BEGIN CONTENDING FOR THE MEDIUM FOR THE FRAME AT THE HEAD OF THE QUEUE
+static void contend(void)
+{
+    if(head == NULL) {
+	state	= W_IDLE;
+	return;
+    }
+    state		= W_CONTEND;
+    contend_timer	= CNET_start_timer(EV_TIMER1,
+				DIFS + (CNET_rand() % cw) * SLOT_TIME, 0);
+}
+
+static void dequeue(void)
+{
+    QFRAME	*f	= head;
+
+    head	= f->next;
+    if(head == NULL)
+	tail	= NULL;
+    --qlength;
+    free(f);
+    retries	= 0;
+    cw		= CW_MIN;
+}
+
+//  A CTS OR ACK DID NOT ARRIVE IN TIME - WIDEN THE WINDOW AND RETRY
+static void failed_attempt(void)
+{
+    ++nretries;
+    if(++retries > MAX_RETRIES) {
+	++ndropped;
+	dequeue();
+    }
+    else if(cw < CW_MAX)
+	cw	*= 2;
+    contend();
+}
+
+static void send_data(void)
+{
+    WLANFRAME	f;
+
+    f.kind	= WF_DATA;
+    f.src	= nodeinfo.address;
+    f.dest	= head->dest;
+    f.seq	= head->seq;
+    f.len	= head->length;
+    f.duration	= SIFS + airtime(WLAN_HEADER_SIZE);
+    memcpy(f.payload, head->data, head->length);
+    send_frame(&f);
+
+    state		= W_WAITACK;
+    contend_timer	= CNET_start_timer(EV_TIMER2,
+			    airtime(WLAN_FRAME_SIZE(f)) + f.duration +
+			    2*SLOT_TIME, 0);
+}
+
+//  EV_TIMER1 - OUR CONTENTION PERIOD HAS EXPIRED
+static EVENT_HANDLER(contention_over)
+{
+    contend_timer	= NULLTIMER;
+    if(state != W_CONTEND)
+	return;
+    if(medium_busy()) {
+	contend();
+	return;
+    }
+
+    if(head->length > RTS_THRESHOLD) {
+	WLANFRAME	rts;
+	CnetTime	ctstime	= airtime(WLAN_HEADER_SIZE);
+
+	rts.kind	= WF_RTS;
+	rts.src		= nodeinfo.address;
+	rts.dest	= head->dest;
+	rts.seq		= head->seq;
+	rts.len		= 0;
+	rts.duration	= 3*SIFS + 2*ctstime +
+			  airtime(WLAN_HEADER_SIZE + head->length);
+	send_frame(&rts);
+
+	state		= W_WAITCTS;
+	contend_timer	= CNET_start_timer(EV_TIMER2,
+				ctstime + SIFS + ctstime + 2*SLOT_TIME, 0);
+    }
+    else
+	send_data();
+    ++nsent;
+}
+
+//  EV_TIMER2 - NO CTS OR ACK ARRIVED
+static EVENT_HANDLER(response_timeout)
+{
+    contend_timer	= NULLTIMER;
+    if(state == W_WAITCTS || state == W_WAITACK)
+	failed_attempt();
+}
+
+//  EV_TIMER3 - SIFS HAS PASSED, SEND OUR CTS, DATA OR ACK
+static EVENT_HANDLER(sifs_over)
+{
+    reply_timer	= NULLTIMER;
+    if(pending.kind == WF_DATA)
+	send_data();
+    else
+	send_frame(&pending);
+}
+
+//  ONLY ONE REPLY MAY AWAIT SIFS; A FRAME ARRIVING WHILE ONE DOES IS NOT
+//  ANSWERED, AND ITS SENDER WILL RETRY
+static void reply_after_sifs(WLANKIND kind, WLANFRAME *to)
+{
+    if(reply_timer != NULLTIMER)
+	return;
+    pending.kind	= kind;
+    pending.src		= nodeinfo.address;
+    pending.dest	= to->src;
+    pending.seq		= to->seq;
+    pending.len		= 0;
+    pending.duration	= 0;
+    if(kind == WF_CTS)
+	pending.duration	= to->duration - SIFS - airtime(WLAN_HEADER_SIZE);
+    reply_timer	= CNET_start_timer(EV_TIMER3, SIFS, 0);
+}
+
+//  HAVE WE ALREADY DELIVERED THIS (src, seq) DATA FRAME?
+static bool is_duplicate(CnetAddr src, int seq)
+{
+    for(int p=0 ; p<npeers ; ++p)
+	if(lastseen[p].addr == src) {
+	    if(lastseen[p].seq == seq)
+		return true;
+	    lastseen[p].seq	= seq;
+	    return false;
+	}
+    if(npeers < MAX_PEERS) {
+	lastseen[npeers].addr	= src;
+	lastseen[npeers].seq	= seq;
+	++npeers;
+    }
+    return false;
+}
+
+static EVENT_HANDLER(wlan_physical_ready)
+{
+    extern int up_to_application(char *msg, size_t length);
+
+    WLANFRAME	f;
+    size_t	len;
+    int		link, checksum;
+
+    len		= sizeof(WLANFRAME);
+    CHECK(CNET_read_physical(&link, &f, &len));
+
+    checksum	= f.checksum;
+    f.checksum	= 0;
+    if(CNET_ccitt((unsigned char *)&f, (int)len) != checksum)
+	return;					// corrupted, ignore
+
+//  A FRAME FOR SOMEONE ELSE RESERVES THE MEDIUM FOR ITS DURATION
+    if(f.dest != nodeinfo.address) {
+	if(nodeinfo.time_in_usec + f.duration > nav_until)
+	    nav_until	= nodeinfo.time_in_usec + f.duration;
+	return;
+    }
+
+    switch (f.kind) {
+    case WF_RTS :
+	if(nodeinfo.time_in_usec >= nav_until)	// only if not silenced
+	    reply_after_sifs(WF_CTS, &f);
+	break;
+
+    case WF_CTS :
+	if(state == W_WAITCTS && head != NULL && f.seq == head->seq &&
+	   reply_timer == NULLTIMER) {
+	    CNET_stop_timer(contend_timer);
+	    reply_after_sifs(WF_DATA, &f);
+	}
+	break;
+
+    case WF_DATA :
+	reply_after_sifs(WF_ACK, &f);
+	if(is_duplicate(f.src, f.seq))
+	    ++nduplicates;
+	else {
+	    ++ndelivered;
+	    up_to_application(f.payload, f.len);
+	}
+	break;
+
+    case WF_ACK :
+	if(state == W_WAITACK && head != NULL && f.seq == head->seq) {
+	    CNET_stop_timer(contend_timer);
+	    dequeue();
+	    contend();
+	}
+	break;
+    }
+}
+
+// -----------------------------------------------------------------
+
+//  WLAN_write() QUEUES A FRAME FOR THE GIVEN DESTINATION
+int WLAN_write(int link, CnetAddr dest, char *frame, size_t length)
+{
+    QFRAME	*f;
+
+    if(qlength >= MAC_MAXQUEUE) {
+	++ndropped;
+	cnet_errno	= ER_TOOBUSY;
+	return(-1);
+    }
+    wlink	= link;
+
+    f		= malloc(sizeof(QFRAME) + length);
+    f->next	= NULL;
+    f->dest	= dest;
+    f->seq	= nextseq++;
+    f->length	= length;
+    memcpy(f->data, frame, length);
+    if(tail == NULL)
+	head	= f;
+    else
+	tail->next	= f;
+    tail	= f;
+    ++qlength;
+
+    if(state == W_IDLE)
+	contend();
+    return(0);
+}
+
+void WLAN_showstats(void)
+{
+    printf(" WLAN: sent=%d retries=%d dropped=%d delivered=%d duplicates=%d"
+	   " queued=%d cw=%d\n",
+	    nsent, nretries, ndropped, ndelivered, nduplicates, qlength, cw);
+}
+
+void reboot_WLAN(void)
+{
+    CHECK(CNET_set_handler(EV_PHYSICALREADY,	wlan_physical_ready, 0));
+    CHECK(CNET_set_handler(EV_TIMER1,		contention_over, 0));
+    CHECK(CNET_set_handler(EV_TIMER2,		response_timeout, 0));
+    CHECK(CNET_set_handler(EV_TIMER3,		sifs_over, 0));
+}
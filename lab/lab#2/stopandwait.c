@@ -1,12 +1,17 @@
 #include <cnet.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
 /*  This is an implementation of a stop-and-wait data link protocol.
     It is based on Tanenbaum's `protocol 4', 2nd edition, p227
     (or his 3rd edition, p205).
-    This protocol employs only data and acknowledgement frames -
-    piggybacking and negative acknowledgements are not used.
+    This protocol employs data and acknowledgement frames - piggybacking
+    is not used.  A DATA frame arriving with a bad checksum is answered at
+    once with a negative acknowledgement (DL_NAK) for the frame expected, and
+    the sender retransmits on receiving it, rather than waiting for its
+    timeout.  At most one NAK-driven retransmission is made per round
+    trip, so a burst of NAKs cannot trigger a burst of duplicates.
 
     It is currently written so that only one node (number 0) will
     generate and transmit messages and the other (number 1) will receive
@@ -18,21 +23,35 @@
 
     in reboot_node(). Both nodes will then transmit and receive (why?).
 
+    Each message is sent as one or more segments, each in its own frame,
+    and is reassembled by the receiver before being written to its
+    Application Layer.  The sender keeps, for each link, a moving average
+    of the fraction of frames corrupted (or lost), from which it estimates
+    the link's rate of corruption per byte, q.  If each attempt costs the
+    segment's s bytes, h bytes of header and idle round trip, and succeeds
+    with probability exp(-q(s+h)), the expected goodput is greatest when
+
+	    s = (-h + sqrt(h*h + 4h/q)) / 2
+
+    so large messages on a noisy link are sent as smaller segments, each of
+    which is cheaper to resend.  Changes of segment size are reported.
+
     Note that this file only provides a reliable data-link layer for a
     network of 2 nodes.
  */
 
-typedef enum    { DL_DATA, DL_ACK }   FRAMEKIND;
+typedef enum    { DL_DATA, DL_ACK, DL_NAK }   FRAMEKIND;
 
 typedef struct {
     char        data[MAX_MESSAGE_SIZE];
 } MSG;
 
 typedef struct {
-    FRAMEKIND    kind;      	// only ever DL_DATA or DL_ACK
+    FRAMEKIND    kind;      	// DL_DATA, DL_ACK or DL_NAK
     size_t	 len;       	// the length of the msg field only
     int          checksum;  	// checksum of the whole frame
     int          seq;       	// only ever 0 or 1
+    int          more;      	// more segments of this message follow
     MSG          msg;
 } FRAME;
 
@@ -43,19 +62,89 @@ typedef struct {
 static  MSG       	*lastmsg;
 static  size_t		lastlength		= 0;
 static  CnetTimerID	lasttimer		= NULLTIMER;
+static  CnetTime	lastrtt			= 0;
+static  CnetTime	nakquiet		= 0; // no NAK resends before
 
 static  int       	ackexpected		= 0;
 static	int		nextframetosend		= 0;
 static	int		frameexpected		= 0;
 
+static  size_t		lastoffset		= 0; // of the segment in flight
+static  size_t		lastseglen		= 0;
+
+static  char		reassembly[MAX_MESSAGE_SIZE];
+static  size_t		reassembled		= 0;
+static  bool		discarding		= false; // rest of a message
+static  int		ndiscarded		= 0;	 // messages too long
+
+#define	FER_ALPHA	0.125		// weight of each new observation
+#define	MIN_SEGMENT	64		// bytes
+
+typedef struct {
+    double	fer;			// average fraction of frames failed
+    double	framebytes;		// average size of those frames
+    size_t	segsize;		// current choice of segment size
+    int		nframes;
+    int		nfailed;
+} LINKERRORS;
+
+static  LINKERRORS	*linkerr		= NULL;
+
+//  CHOOSE THE SEGMENT SIZE GIVING THE GREATEST EXPECTED GOODPUT ON THIS LINK
+static void choose_segsize(int link)
+{
+    LINKERRORS	*le	= &linkerr[link];
+    double	h, q, s;
+    size_t	size;
+
+//  THE HEADER, AND THE IDLE ROUND TRIP OF STOP-AND-WAIT, IN BYTES
+    h	= FRAME_HEADER_SIZE + 2.0 * linkinfo[link].propagationdelay *
+				linkinfo[link].bandwidth / 8000000.0;
+    if(le->fer <= 0.0)
+	size	= MAX_MESSAGE_SIZE;
+    else {
+	q	= -log(1.0 - fmin(le->fer, 0.99)) / le->framebytes;
+	s	= (-h + sqrt(h*h + 4.0*h/q)) / 2.0;
+	if(s < MIN_SEGMENT)
+	    size	= MIN_SEGMENT;
+	else if(s > MAX_MESSAGE_SIZE)
+	    size	= MAX_MESSAGE_SIZE;
+	else
+	    size	= (size_t)s;
+    }
+    if(size != le->segsize) {
+	printf("link %d: FER=%.3f, segment size now %d bytes\n",
+			link, le->fer, (int)size);
+	le->segsize	= size;
+    }
+}
+
+//  RECORD WHETHER THE LAST FRAME SENT ON THIS LINK ARRIVED INTACT
+static void frame_outcome(int link, size_t bytes, bool failed)
+{
+    LINKERRORS	*le	= &linkerr[link];
+
+    le->fer	= (1.0-FER_ALPHA) * le->fer + (failed ? FER_ALPHA : 0.0);
+    if(le->framebytes == 0.0)
+	le->framebytes	= bytes;
+    else
+	le->framebytes	= (1.0-FER_ALPHA) * le->framebytes + FER_ALPHA * bytes;
+    ++le->nframes;
+    if(failed)
+	++le->nfailed;
+    choose_segsize(link);
+}
+
 
-static void transmit_frame(MSG *msg, FRAMEKIND kind, size_t length, int seqno)
+static void transmit_frame(MSG *msg, FRAMEKIND kind, size_t length, int seqno,
+			   int more)
 {
     FRAME       f;
     int		link = 1;
 
     f.kind      = kind;
     f.seq       = seqno;
+    f.more      = more;
     f.checksum  = 0;
     f.len       = length;
 
@@ -64,6 +153,10 @@ static void transmit_frame(MSG *msg, FRAMEKIND kind, size_t length, int seqno)
         printf("ACK transmitted, seq=%d\n", seqno);
 	break;
 
+    case DL_NAK :
+        printf("NAK transmitted, seq=%d\n", seqno);
+	break;
+
     case DL_DATA: {
 	CnetTime	timeout;
 
@@ -74,12 +167,33 @@ static void transmit_frame(MSG *msg, FRAMEKIND kind, size_t length, int seqno)
 				linkinfo[link].propagationdelay;
 
         lasttimer = CNET_start_timer(EV_TIMER1, 3 * timeout, 0);
+        lastrtt	  = 2 * timeout;
 	break;
       }
     }
     length      = FRAME_SIZE(f);
     f.checksum  = CNET_ccitt((unsigned char *)&f, (int)length);
-    CHECK(CNET_write_physical(link, &f, &length));
+//  A FRAME WRITTEN WHILE THE LINK IS STILL BUSY IS LOST, AND RECOVERED
+//  BY THE TIMEOUT, JUST AS IF IT HAD BEEN CORRUPTED
+    if(CNET_write_physical(link, &f, &length) != 0 && cnet_errno != ER_TOOBUSY)
+	CNET_exit(__FILE__, __func__, __LINE__);
+}
+
+//  (RE)TRANSMIT THE SEGMENT OF lastmsg THAT IS IN FLIGHT
+static void send_segment(int seqno)
+{
+    transmit_frame((MSG *)((char *)lastmsg + lastoffset), DL_DATA,
+		   lastseglen, seqno, lastoffset + lastseglen < lastlength);
+}
+
+//  SEND THE NEXT SEGMENT OF lastmsg, OF THE SIZE NOW CHOSEN FOR OUR LINK
+static void next_segment(void)
+{
+    lastseglen	= lastlength - lastoffset;
+    if(lastseglen > linkerr[1].segsize)
+	lastseglen	= linkerr[1].segsize;
+    send_segment(nextframetosend);
+    nextframetosend = 1-nextframetosend;
 }
 
 static EVENT_HANDLER(application_ready)
@@ -91,8 +205,8 @@ static EVENT_HANDLER(application_ready)
     CNET_disable_application(ALLNODES);
 
     printf("down from application, seq=%d\n", nextframetosend);
-    transmit_frame(lastmsg, DL_DATA, lastlength, nextframetosend);
-    nextframetosend = 1-nextframetosend;
+    lastoffset	= 0;
+    next_segment();
 }
 
 static EVENT_HANDLER(physical_ready)
@@ -107,8 +221,15 @@ static EVENT_HANDLER(physical_ready)
     checksum    = f.checksum;
     f.checksum  = 0;
     if(CNET_ccitt((unsigned char *)&f, (int)len) != checksum) {
-        printf("\t\t\t\tBAD checksum - frame ignored\n");
-        return;           // bad checksum, ignore frame
+        //  ONLY A DATA FRAME IS LONGER THAN A HEADER; A CORRUPTED ACK OR NAK
+        //  IS LEFT TO THE SENDER'S TIMEOUT, RATHER THAN NAKed BACK
+        if(len > FRAME_HEADER_SIZE) {
+            printf("\t\t\t\tBAD checksum - NAK sent\n");
+            transmit_frame(NULL, DL_NAK, 0, frameexpected, 0);
+        }
+        else
+            printf("\t\t\t\tBAD checksum - ignored\n");
+        return;           // bad checksum, ask for any DATA frame again
     }
 
     switch (f.kind) {
@@ -117,21 +238,58 @@ static EVENT_HANDLER(physical_ready)
             printf("\t\t\t\tACK received, seq=%d\n", f.seq);
             CNET_stop_timer(lasttimer);
             ackexpected = 1-ackexpected;
-            CNET_enable_application(ALLNODES);
+            frame_outcome(link, FRAME_HEADER_SIZE + lastseglen, false);
+
+            lastoffset += lastseglen;
+            if(lastoffset < lastlength)		// send the next segment
+                next_segment();
+            else
+                CNET_enable_application(ALLNODES);
+        }
+	break;
+
+    case DL_NAK :
+	// resend at once, unless already resent within the last round trip
+        if(f.seq == ackexpected && ackexpected != nextframetosend &&
+				nodeinfo.time_in_usec >= nakquiet) {
+            printf("\t\t\t\tNAK received, seq=%d\n", f.seq);
+            CNET_stop_timer(lasttimer);
+            frame_outcome(link, FRAME_HEADER_SIZE + lastseglen, true);
+            send_segment(ackexpected);
+            nakquiet = nodeinfo.time_in_usec + lastrtt;
         }
 	break;
 
     case DL_DATA :
         printf("\t\t\t\tDATA received, seq=%d, ", f.seq);
         if(f.seq == frameexpected) {
-            printf("up to application\n");
-            len = f.len;
-            CHECK(CNET_write_application(&f.msg, &len));
+            //  A MESSAGE TOO LONG TO REASSEMBLE IS DISCARDED, NOT TRUNCATED
+            if(!discarding && reassembled + f.len > sizeof(reassembly)) {
+                discarding = true;
+                ++ndiscarded;
+            }
+            if(!discarding) {
+                memcpy(&reassembly[reassembled], &f.msg, f.len);
+                reassembled += f.len;
+            }
+            if(f.more)
+                printf(discarding ? "segment discarded\n" : "segment held\n");
+            else if(discarding) {
+                printf("message discarded\n");
+                reassembled = 0;
+                discarding = false;
+            }
+            else {
+                printf("up to application\n");
+                len = reassembled;
+                CHECK(CNET_write_application(reassembly, &len));
+                reassembled = 0;
+            }
             frameexpected = 1-frameexpected;
         }
         else
             printf("ignored\n");
-        transmit_frame(NULL, DL_ACK, 0, f.seq);
+        transmit_frame(NULL, DL_ACK, 0, f.seq, 0);
 	break;
     }
 }
@@ -139,7 +297,8 @@ static EVENT_HANDLER(physical_ready)
 static EVENT_HANDLER(timeouts)
 {
     printf("timeout, seq=%d\n", ackexpected);
-    transmit_frame(lastmsg, DL_DATA, lastlength, ackexpected);
+    frame_outcome(1, FRAME_HEADER_SIZE + lastseglen, true);
+    send_segment(ackexpected);
 }
 
 static EVENT_HANDLER(showstate)
@@ -147,6 +306,11 @@ static EVENT_HANDLER(showstate)
     printf(
     "\n\tackexpected\t= %d\n\tnextframetosend\t= %d\n\tframeexpected\t= %d\n",
 		    ackexpected, nextframetosend, frameexpected);
+    printf("\tmessages discarded, too long to reassemble = %d\n", ndiscarded);
+    for(int link=1 ; link<=nodeinfo.nlinks ; ++link)
+	printf("\tlink %d: frames=%d failed=%d FER=%.3f segment=%d bytes\n",
+		link, linkerr[link].nframes, linkerr[link].nfailed,
+		linkerr[link].fer, (int)linkerr[link].segsize);
 }
 
 EVENT_HANDLER(reboot_node)
@@ -157,6 +321,9 @@ EVENT_HANDLER(reboot_node)
     }
 
     lastmsg	= calloc(1, sizeof(MSG));
+    linkerr	= calloc(nodeinfo.nlinks+1, sizeof(LINKERRORS));
+    for(int link=1 ; link<=nodeinfo.nlinks ; ++link)
+	linkerr[link].segsize	= MAX_MESSAGE_SIZE;
 
     CHECK(CNET_set_handler( EV_APPLICATIONREADY, application_ready, 0));
     CHECK(CNET_set_handler( EV_PHYSICALREADY,    physical_ready, 0));
@@ -2,11 +2,17 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "../../lab#3/pktpool.h"
+
 /*  This is an implementation of a stop-and-wait data link protocol.
     It is based on Tanenbaum's `protocol 4', 2nd edition, p227
     (or his 3rd edition, p205).
-    This protocol employs only data and acknowledgement frames -
-    piggybacking and negative acknowledgements are not used.
+    This protocol employs data and acknowledgement frames - piggybacking
+    is not used.  A frame arriving with a bad checksum is answered at once
+    with a negative acknowledgement (DL_NAK) for the frame expected, and
+    the sender retransmits on receiving it, rather than waiting for its
+    timeout.  At most one NAK-driven retransmission is made per round
+    trip, so a burst of NAKs cannot trigger a burst of duplicates.
 
     It is currently written so that only one node (number 0) will
     generate and transmit messages and the other (number 1) will receive
@@ -18,18 +24,24 @@
 
     in reboot_node(). Both nodes will then transmit and receive (why?).
 
+    Unlike ../stopandwait.c, messages are not segmented by the observed
+    rate of corruption.  Here most failed frames are not corrupted, but
+    are dropped by a router whose one-frame buffer is still full, so the
+    estimate would shrink the segments to the smallest size, and every
+    extra segment costs another round trip on each of the four hops.
+
     Note that this file only provides a reliable data-link layer for a
     network of 2 nodes.
  */
 
-typedef enum    { DL_DATA, DL_ACK }   FRAMEKIND;
+typedef enum    { DL_DATA, DL_ACK, DL_NAK }   FRAMEKIND;
 
 typedef struct {
     char        data[MAX_MESSAGE_SIZE];
 } MSG;
 
 typedef struct {
-    FRAMEKIND    kind;      	// only ever DL_DATA or DL_ACK
+    FRAMEKIND    kind;      	// DL_DATA, DL_ACK or DL_NAK
     size_t	 len;       	// the length of the msg field only
     int          checksum;  	// checksum of the whole frame
     int          seq;       	// only ever 0 or 1
@@ -40,9 +52,11 @@ typedef struct {
 #define FRAME_SIZE(f)      (FRAME_HEADER_SIZE + f.len)
 
 
-static  MSG       	*lastmsg;
-static size_t lastlength[5] = {0};
+static  char      	*lastmsg		= NULL; // pooled, sized to lastlength
+static  size_t		lastlength		= 0;
 static  CnetTimerID	lasttimer		= NULLTIMER;
+static  CnetTime	lastrtt			= 0;
+static  CnetTime	nakquiet		= 0; // no NAK resends before
 
 static  int       	ackexpected		= 0;
 static	int		nextframetosend		= 0;
@@ -67,6 +81,10 @@ static void transmit_frame(MSG *msg, FRAMEKIND kind, size_t length, int seqno)
         printf("ACK transmitted, seq=%d, link=%d\n", seqno, link);
 	break;
 
+    case DL_NAK :
+        printf("NAK transmitted, seq=%d, link=%d\n", seqno, link);
+	break;
+
     case DL_DATA: {
       if (nodeinfo.nodetype == NT_HOST) link = 1; // Host --> link = 1
       else link = 2; // Router --> link = 2
@@ -80,24 +98,32 @@ static void transmit_frame(MSG *msg, FRAMEKIND kind, size_t length, int seqno)
 				linkinfo[link].propagationdelay;
 
         lasttimer = CNET_start_timer(EV_TIMER1, 3 * timeout, 0);
+        lastrtt	  = 2 * timeout;
 	break;
       }
     }
     length      = FRAME_SIZE(f);
     f.checksum  = CNET_ccitt((unsigned char *)&f, (int)length);
-    CHECK(CNET_write_physical(link, &f, &length));
+//  A FRAME WRITTEN WHILE THE LINK IS STILL BUSY IS LOST, AND RECOVERED
+//  BY THE TIMEOUT, JUST AS IF IT HAD BEEN CORRUPTED
+    if(CNET_write_physical(link, &f, &length) != 0 && cnet_errno != ER_TOOBUSY)
+	CNET_exit(__FILE__, __func__, __LINE__);
 }
 
 static EVENT_HANDLER(application_ready)
 {
     CnetAddr destaddr;
+    MSG      msg;
 
-    lastlength[nodeinfo.nodenumber]  = sizeof(MSG);
-    CHECK(CNET_read_application(&destaddr, &lastmsg[nodeinfo.nodenumber], &lastlength[nodeinfo.nodenumber]));
+    lastlength  = sizeof(MSG);
+    CHECK(CNET_read_application(&destaddr, &msg, &lastlength));
     CNET_disable_application(ALLNODES);
 
+    pkt_release(lastmsg);
+    lastmsg = pkt_copy(&msg, lastlength);
+
     printf("down from application, seq=%d\n", nextframetosend);
-    transmit_frame(&lastmsg[nodeinfo.nodenumber], DL_DATA, lastlength[nodeinfo.nodenumber], nextframetosend);
+    transmit_frame((MSG *)lastmsg, DL_DATA, lastlength, nextframetosend);
     nextframetosend = 1-nextframetosend;
 }
 
@@ -113,8 +139,14 @@ static EVENT_HANDLER(physical_ready)
     checksum    = f.checksum;
     f.checksum  = 0;
     if(CNET_ccitt((unsigned char *)&f, (int)len) != checksum) {
-        printf("\t\t\t\tBAD checksum - frame ignored\n");
-        return;           // bad checksum, ignore frame
+	// only frames arriving on link 1 can be DATA frames for us
+	if(link == 1 && nodeinfo.nodenumber != 0) {
+	    printf("\t\t\t\tBAD checksum - NAK sent\n");
+	    transmit_frame(NULL, DL_NAK, 0, frameexpected);
+	}
+	else
+	    printf("\t\t\t\tBAD checksum - frame ignored\n");
+        return;
     }
 
     switch (f.kind) {
@@ -125,11 +157,24 @@ static EVENT_HANDLER(physical_ready)
             ackexpected = 1-ackexpected;
 	    //get ACK and send next data
             buffer = 0;
+            pkt_release(lastmsg);
+            lastmsg = NULL;
             if(nodeinfo.nodenumber == 0){
                 CNET_enable_application(ALLNODES);
             }
         }
 	break;
+    case DL_NAK :
+	// resend at once, unless already resent within the last round trip
+        if(f.seq == ackexpected && lastmsg != NULL &&
+				nodeinfo.time_in_usec >= nakquiet) {
+            printf("\t\t\t\tNAK received, seq=%d\n", f.seq);
+            CNET_stop_timer(lasttimer);
+            transmit_frame((MSG *)lastmsg, DL_DATA, lastlength, ackexpected);
+            nakquiet = nodeinfo.time_in_usec + lastrtt;
+        }
+	break;
+
     case DL_DATA :
       
         printf("\t\t\t\tDATA received, seq=%d, ", f.seq);
@@ -149,9 +194,9 @@ static EVENT_HANDLER(physical_ready)
 		    //lock the full buffer
 		    buffer= 1;
                     frameexpected = 1-frameexpected;
-                    lastlength[nodeinfo.nodenumber] = f.len;
-                    lastmsg[nodeinfo.nodenumber] = f.msg;
-                    transmit_frame(&lastmsg[nodeinfo.nodenumber], DL_DATA, lastlength[nodeinfo.nodenumber], ackexpected);
+                    lastlength = f.len;
+                    lastmsg = pkt_copy(&f.msg, f.len);
+                    transmit_frame((MSG *)lastmsg, DL_DATA, lastlength, ackexpected);
                 }
             }
         }
@@ -165,7 +210,7 @@ static EVENT_HANDLER(physical_ready)
 static EVENT_HANDLER(timeouts)
 {
     printf("timeout, seq=%d\n", ackexpected);
-    transmit_frame(&lastmsg[nodeinfo.nodenumber], DL_DATA, lastlength[nodeinfo.nodenumber], ackexpected);
+    transmit_frame((MSG *)lastmsg, DL_DATA, lastlength, ackexpected);
 }
 
 static EVENT_HANDLER(showstate)
@@ -173,12 +218,11 @@ static EVENT_HANDLER(showstate)
     printf(
     "\n\tackexpected\t= %d\n\tnextframetosend\t= %d\n\tframeexpected\t= %d\n",
 		    ackexpected, nextframetosend, frameexpected);
+    pkt_report();
 }
 
 EVENT_HANDLER(reboot_node)
 {
-    lastmsg = calloc(5, sizeof(MSG));
-
     if(nodeinfo.nodenumber == 0)
         CHECK(CNET_set_handler( EV_APPLICATIONREADY, application_ready, 0));
 
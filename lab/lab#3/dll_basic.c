@@ -1,53 +1,395 @@
+#include <stdlib.h>
+#include <string.h>
+
 #include "dll_basic.h"
 
  /* THIS FILE PROVIDES A MINIMAL RELIABLE DATALINK LAYER.  IT AVOIDS ANY
     FRAME LOSS AND CORRUPTION AT THE PHYSICAL LAYER BY CALLING
     CNET_write_physical_reliable() INSTEAD OF CNET_write_physical().
-    BECAUSE "NOTHING CAN GO WRONG", WE DON'T NEED TO MANAGE ANY SEQUENCE
-    NUMBERS OR BUFFERS OF FRAMES IN THIS LAYER, AND OUR DLL_FRAME
-    STRUCTURE CAN CONSIST OF JUST ITS PAYLOAD (THE NL's PACKETS).
+    BECAUSE "NOTHING CAN GO WRONG", WE DON'T NEED TO RETRANSMIT ANY
+    FRAMES IN THIS LAYER, AND OUR DLL_FRAME STRUCTURE NEEDS ONLY A SMALL
+    HEADER BEFORE ITS PAYLOAD (THE NL's PACKETS).
+
+    IT ALSO BONDS PARALLEL LINKS:  every frame carries its sender's
+    address, so each node soon learns which of its links lead to the same
+    neighbour.  Those links form a bundle, known to the Network Layer only
+    by its lowest-numbered link (its primary).  Frames for the primary
+    are striped over all of the bundle's links - each goes on the idle
+    link on which it would arrive soonest, so each link carries frames in
+    proportion to its bandwidth - and DLL_busyfor() tells the link
+    scheduler when another link of the bundle is free, so a neighbour may
+    be sent to at the sum of its links' bandwidths.
+
+    Frames sent to a known neighbour carry a sequence number, and the
+    receiver puts them back in order with a reorder buffer of BOND_REORDER
+    frames.  As each link delivers its frames in order, a missing frame
+    is known to be lost once every link of the bundle has delivered a
+    later one, or once it is more than BOND_REORDER frames late, or once
+    the slowest link of the bundle could have delivered it (EV_TIMER7).
+    A frame arriving after being given up on is still delivered, only
+    out of order.
  */
 int count_toobusy;
 
+#define	BOND_REORDER	64		// frames held back, per neighbour
+
+#define	SEQUENCED	1		// DLL_HEADER.flags
+
+typedef struct {
+    CnetAddr	from;			// the sender's address
+    uint32_t	seq;			// per neighbour, if SEQUENCED
+    uint32_t	flags;
+} DLL_HEADER;
+
 typedef struct {
-    /* AS WE USE A RELIABLE DATALINK, WE DON'T NEED ANY OTHER FIELDS */
+    DLL_HEADER	header;
     char        packet[MAX_FRAME_SIZE];
 } DLL_FRAME;
 
+#define	FRAME_HEADER_SIZE	sizeof(DLL_HEADER)
+
+typedef struct {
+    int		neighbour;		// index in neighbours[], or -1
+    CnetTime	free_at;		// our transmitter is busy until
+    bool	heard;			// a sequenced frame has arrived
+    uint32_t	lastseq;		// ... and the latest one's seqno
+    int		nsent;
+} DLL_LINK;
+
+typedef struct {
+    CnetAddr	address;
+    int		primary;		// lowest-numbered link to it
+    int		nlinks;			// in its bundle
+    int		bandwidth;		// of all of them
+
+    uint32_t	nextseq;		// of frames we send
+    uint32_t	expected;		// of frames we receive
+    bool	synced;
+    char	*held[BOND_REORDER];	// indexed by seq % BOND_REORDER
+    size_t	heldlen[BOND_REORDER];
+    int		nheld;
+    CnetTimerID	flush;
+    uint32_t	flushfor;		// the expected seq when it started
 
-/*  down_to_datalink() RECEIVES PACKETS FROM THE NETWORK LAYER (ABOVE) */
+    int		nreordered;		// statistics
+    int		nlost;
+    int		nlate;
+} NEIGHBOUR;
+
+static	DLL_LINK	*links		= NULL;		// [0..nlinks]
+static	NEIGHBOUR	*neighbours	= NULL;
+static	int		nneighbours	= 0;
+
+// -----------------------------------------------------------------
+
+static CnetTime tx_time(int link, size_t length)
+{
+    return ((CnetTime)length * 8000000) / linkinfo[link].bandwidth;
+}
+
+//  A FRAME FROM address ARRIVED ON link, SO link LEADS TO THAT NEIGHBOUR
+static NEIGHBOUR *learn(int link, CnetAddr address)
+{
+    int		n;
+
+    if(links[link].neighbour >= 0 &&
+	    neighbours[links[link].neighbour].address == address)
+	return &neighbours[links[link].neighbour];
+
+    for(n=0 ; n<nneighbours ; ++n)
+	if(neighbours[n].address == address)
+	    break;
+    if(n == nneighbours) {
+	neighbours	= realloc(neighbours, (n+1)*sizeof(NEIGHBOUR));
+	memset(&neighbours[n], 0, sizeof(NEIGHBOUR));
+	neighbours[n].address	= address;
+	neighbours[n].flush	= NULLTIMER;
+	++nneighbours;
+    }
+    links[link].neighbour	= n;
+
+//  EVERY NEIGHBOUR'S BUNDLE MAY HAVE CHANGED
+    for(n=0 ; n<nneighbours ; ++n) {
+	neighbours[n].primary	= 0;
+	neighbours[n].nlinks	= 0;
+	neighbours[n].bandwidth	= 0;
+    }
+    for(int l=1 ; l<=nodeinfo.nlinks ; ++l) {
+	NEIGHBOUR	*nb;
+
+	if(links[l].neighbour < 0)
+	    continue;
+	nb	= &neighbours[links[l].neighbour];
+	if(nb->primary == 0)
+	    nb->primary	= l;
+	++nb->nlinks;
+	nb->bandwidth	+= linkinfo[l].bandwidth;
+    }
+    return &neighbours[links[link].neighbour];
+}
+
+//  THE NEIGHBOUR WHOSE BUNDLE THIS LINK BELONGS TO, OR NULL IF UNKNOWN
+static NEIGHBOUR *bundle_of(int link)
+{
+    return (links[link].neighbour < 0) ? NULL :
+					&neighbours[links[link].neighbour];
+}
+
+// -----------------------------------------------------------------
+
+//  IS THIS LINK PART OF ANOTHER LINK'S BUNDLE (AND SO NOT USED ALONE)?
+bool DLL_bonded(int link)
+{
+    NEIGHBOUR	*nb	= bundle_of(link);
+
+    return nb != NULL && nb->primary != link;
+}
+
+//  THE BANDWIDTH OF A LINK, OR OF ALL THE LINKS IN ITS BUNDLE
+int DLL_bandwidth(int link)
+{
+    NEIGHBOUR	*nb	= bundle_of(link);
+
+    return (nb != NULL) ? nb->bandwidth : linkinfo[link].bandwidth;
+}
+
+//  THE usecs UNTIL ANOTHER FRAME MAY BE SENT ON THIS LINK (OR ITS BUNDLE)
+CnetTime DLL_busyfor(int link)
+{
+    CnetTime	free_at	= links[link].free_at;
+
+    if(links[link].neighbour >= 0)
+	for(int l=1 ; l<=nodeinfo.nlinks ; ++l)
+	    if(links[l].neighbour == links[link].neighbour &&
+		    free_at > links[l].free_at)
+		free_at	= links[l].free_at;
+    return (free_at > nodeinfo.time_in_usec) ?
+		free_at - nodeinfo.time_in_usec : 0;
+}
+
+/*  down_to_datalink() RECEIVES PACKETS FROM THE NETWORK LAYER (ABOVE).
+    A PACKET FOR ANY LINK OF A BUNDLE IS SENT ON WHICHEVER IDLE LINK OF
+    THE BUNDLE WOULD DELIVER IT SOONEST.  (THE NETWORK LAYER SHOULD ONLY
+    USE A BUNDLE'S PRIMARY LINK, BUT MAY HAVE LEARNT ROUTES VIA ITS OTHER
+    LINKS BEFORE THE BUNDLE WAS FOUND.)
+ */
 int down_to_datalink(int link, char *packet, size_t length)
 {
-    //CHECK(CNET_write_physical_reliable(link, (char *)packet, &length));
-    if(CNET_write_physical(link, (char*)packet, &length) < 0){
+    DLL_FRAME	f;
+    NEIGHBOUR	*nb;
+    CnetTime	now	= nodeinfo.time_in_usec;
+
+    length	+= FRAME_HEADER_SIZE;
+    f.header.from	= nodeinfo.address;
+    f.header.seq	= 0;
+    f.header.flags	= 0;
+    if((nb = bundle_of(link)) != NULL) {
+	CnetTime	best	= 0;
+	int		n	= links[link].neighbour;
+
+	for(int l=1 ; l<=nodeinfo.nlinks ; ++l) {
+	    CnetTime	arrives;
+
+	    if(links[l].neighbour != n || links[l].free_at > now)
+		continue;
+	    arrives	= tx_time(l, length) + linkinfo[l].propagationdelay;
+	    if(best == 0 || arrives < best) {
+		best	= arrives;
+		link	= l;
+	    }
+	}
+	f.header.seq	= nb->nextseq++;
+	f.header.flags	= SEQUENCED;
+    }
+    memcpy(f.packet, packet, length - FRAME_HEADER_SIZE);
+
+    //CHECK(CNET_write_physical_reliable(link, (char *)&f, &length));
+    if(CNET_write_physical(link, (char *)&f, &length) < 0){
         if(cnet_errno == ER_TOOBUSY) count_toobusy++;
         else CNET_exit(__FILE__,__func__,__LINE__);
     }
+    else {
+	links[link].free_at	= now + tx_time(link, length);
+	++links[link].nsent;
+    }
     return(0);
 }
 
+// -----------------------------------------------------------------
+
+extern int up_to_network(char *packet, size_t length, int arrived_on);
+
+//  PASS UP EVERY HELD FRAME THAT IS NOW IN ORDER
+static void release(NEIGHBOUR *nb)
+{
+    int		h;
+
+    while(nb->held[h = nb->expected % BOND_REORDER] != NULL) {
+	char	*packet	= nb->held[h];
+
+	nb->held[h]	= NULL;
+	--nb->nheld;
+	++nb->expected;
+	CHECK(up_to_network(packet, nb->heldlen[h], nb->primary));
+	free(packet);
+    }
+}
+
+//  GIVE UP ON EVERY MISSING FRAME BEFORE seq
+static void skip_to(NEIGHBOUR *nb, uint32_t seq)
+{
+    while((int32_t)(seq - nb->expected) > 0) {
+	if(nb->held[nb->expected % BOND_REORDER] != NULL)
+	    release(nb);
+	else {
+	    ++nb->nlost;
+	    ++nb->expected;
+	}
+    }
+    release(nb);
+}
+
+//  THE LONGEST THAT ANY LINK OF THE BUNDLE MAY TAKE TO DELIVER A FRAME
+static CnetTime bundle_delay(NEIGHBOUR *nb)
+{
+    CnetTime	longest	= 0;
+
+    for(int l=1 ; l<=nodeinfo.nlinks ; ++l)
+	if(links[l].neighbour == nb - neighbours &&
+		longest < tx_time(l, sizeof(DLL_FRAME)) +
+				linkinfo[l].propagationdelay)
+	    longest	= tx_time(l, sizeof(DLL_FRAME)) +
+				linkinfo[l].propagationdelay;
+    return longest;
+}
+
+//  EV_TIMER7 - A MISSING FRAME HAS NOT ARRIVED IN TIME
+static EVENT_HANDLER(flush_held)
+{
+    NEIGHBOUR	*nb	= &neighbours[(int)data];
+
+    nb->flush	= NULLTIMER;
+    while(nb->nheld > 0 && nb->held[nb->expected % BOND_REORDER] == NULL) {
+	++nb->nlost;
+	++nb->expected;
+    }
+    release(nb);
+    if(nb->nheld > 0) {
+	nb->flush	= CNET_start_timer(EV_TIMER7, bundle_delay(nb), data);
+	nb->flushfor	= nb->expected;
+    }
+}
+
+//  PUT A SEQUENCED FRAME FROM A NEIGHBOUR BACK IN ORDER
+static void resequence(NEIGHBOUR *nb, int link, uint32_t seq,
+			char *packet, size_t length)
+{
+    uint32_t	oldest	= 0;
+    bool	complete = true;
+
+    links[link].heard	= true;
+    links[link].lastseq	= seq;
+    if(!nb->synced || (int32_t)(nb->expected - seq) > (1 << 30)) {
+	nb->expected	= seq;			// first, or the sender rebooted
+	nb->synced	= true;
+    }
+
+    if((int32_t)(seq - nb->expected) < 0) {	// already given up on
+	++nb->nlate;
+	CHECK(up_to_network(packet, length, nb->primary));
+	return;
+    }
+    if((int32_t)(seq - nb->expected) >= BOND_REORDER)
+	skip_to(nb, seq - BOND_REORDER + 1);
+
+    if(seq == nb->expected) {
+	++nb->expected;
+	CHECK(up_to_network(packet, length, nb->primary));
+	release(nb);
+    }
+    else if(nb->held[seq % BOND_REORDER] == NULL) {
+	nb->held[seq % BOND_REORDER]	= malloc(length);
+	memcpy(nb->held[seq % BOND_REORDER], packet, length);
+	nb->heldlen[seq % BOND_REORDER]	= length;
+	++nb->nheld;
+	++nb->nreordered;
+    }
+
+//  A FRAME OLDER THAN THE LATEST ON EVERY LINK OF THE BUNDLE IS LOST
+    for(int l=1 ; l<=nodeinfo.nlinks ; ++l)
+	if(links[l].neighbour == nb - neighbours) {
+	    if(!links[l].heard) {		// it may yet deliver anything
+		complete	= false;
+		break;
+	    }
+	    if(l == nb->primary || (int32_t)(links[l].lastseq - oldest) < 0)
+		oldest	= links[l].lastseq;
+	}
+    if(nb->nheld > 0 && complete)
+	skip_to(nb, oldest);
+
+//  THE TIMER WAITS FOR THE FIRST MISSING FRAME, WHICH MAY HAVE CHANGED
+    if(nb->flush != NULLTIMER &&
+	    (nb->nheld == 0 || nb->flushfor != nb->expected)) {
+	CNET_stop_timer(nb->flush);
+	nb->flush	= NULLTIMER;
+    }
+    if(nb->nheld > 0 && nb->flush == NULLTIMER) {
+	nb->flush	= CNET_start_timer(EV_TIMER7, bundle_delay(nb),
+					   (CnetData)(nb - neighbours));
+	nb->flushfor	= nb->expected;
+    }
+}
 
 /*  up_to_datalink() RECEIVES FRAMES FROM THE PHYSICAL LAYER (BELOW) AND,
     KNOWING THAT OUR PHYSICAL LAYER IS RELIABLE, IMMEDIATELY SENDS THE
-    PAYLOAD (A PACKET) UP TO THE NETWORK LAYER.
+    PAYLOAD (A PACKET) UP TO THE NETWORK LAYER, AS HAVING ARRIVED ON ITS
+    BUNDLE'S PRIMARY LINK.
  */
 static EVENT_HANDLER(up_to_datalink)
 {
-    extern int up_to_network(char *packet, size_t length, int arrived_on);
-
     DLL_FRAME	f;
+    NEIGHBOUR	*nb;
     size_t	length;
     int		link;
 
     length	= sizeof(DLL_FRAME);
     CHECK(CNET_read_physical(&link, (char *)&f, &length));
+    length	-= FRAME_HEADER_SIZE;
 
-    CHECK(up_to_network(f.packet, length, link));
+    nb	= learn(link, f.header.from);
+    if(f.header.flags & SEQUENCED)
+	resequence(nb, link, f.header.seq, f.packet, length);
+    else
+	CHECK(up_to_network(f.packet, length, nb->primary));
+}
+
+void DLL_showstats(void)
+{
+    printf("\n%9s %6s %6s %10s %10s %8s %8s %8s\n", "neighbour",
+	"links", "first", "bandwidth", "sent", "reorder", "lost", "late");
+    for(int n=0 ; n<nneighbours ; ++n) {
+	NEIGHBOUR	*nb	= &neighbours[n];
+	int		nsent	= 0;
+
+	for(int l=1 ; l<=nodeinfo.nlinks ; ++l)
+	    if(links[l].neighbour == n)
+		nsent	+= links[l].nsent;
+	printf("%9d %6d %6d %10d %10d %8d %8d %8d\n", (int)nb->address,
+		nb->nlinks, nb->primary, nb->bandwidth, nsent,
+		nb->nreordered, nb->nlost, nb->nlate);
+    }
 }
 
 void reboot_DLL(void)
 {
+    links	= calloc(nodeinfo.nlinks+1, sizeof(DLL_LINK));
+    for(int l=0 ; l<=nodeinfo.nlinks ; ++l)
+	links[l].neighbour	= -1;
+    neighbours	= NULL;
+    nneighbours	= 0;
+
     CHECK(CNET_set_handler(EV_PHYSICALREADY,	up_to_datalink, 0));
-    /* NOTHING ELSE TO DO! */
+    CHECK(CNET_set_handler(EV_TIMER7,		flush_held, 0));
     count_toobusy = 0;
 }
@@ -8,3 +8,9 @@ extern int count_toobusy;
 
 extern	int	down_to_datalink(int link, char *packet, size_t length);
 extern	void	reboot_DLL(void);
+
+//  LINKS TO THE SAME NEIGHBOUR ARE BONDED, AND USED AS THE FIRST OF THEM
+extern	bool	DLL_bonded(int link);
+extern	int	DLL_bandwidth(int link);
+extern	CnetTime DLL_busyfor(int link);
+extern	void	DLL_showstats(void);
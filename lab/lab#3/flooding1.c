@@ -4,7 +4,9 @@
 #include "nl_table.h"
 #include "dll_basic.h"
 
-#define	MAXHOPS		4
+#ifndef	MAXHOPS
+#define	MAXHOPS		4		/* may be given with -D, by runsweep */
+#endif
 
 /*  This is an implementation of a very naive flooding algorithm in cnet.
     Whenever a new Network Layer packet requires delivery, it is
@@ -1,10 +1,15 @@
 #include <cnet.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "nl_table.h"
 #include "dll_basic.h"
+#include "linksched.h"
+#include "spantree.h"
 
-#define	MAXHOPS		4
+#ifndef	MAXHOPS
+#define	MAXHOPS		4		/* may be given with -D, by runsweep */
+#endif
 
 /*  This file implements a better flooding algorithm exhibiting slightly
     more "intelligence" than the naive algorithm in flooding1.c
@@ -12,6 +17,8 @@
 
     1) data packets are initially sent on all links.
     2) packets are forwarded on all links except the one on which they arrived.
+       Once the spanning tree (spantree.c) has settled, "all links" means
+       all tree links, so each flood costs N-1 transmissions.
     3) acknowledgement packets are initially sent on the link on which their
        data packet arrived.
 
@@ -19,12 +26,12 @@
     8 nodes in the AUSTRALIA.MAP file, the efficiency is typically about 8%.
  */
 
-typedef enum    	{ NL_DATA, NL_ACK }   NL_PACKETKIND;
+typedef enum    	{ NL_DATA, NL_ACK, NL_TREE }   NL_PACKETKIND;
 
 typedef struct {
     CnetAddr		src;
     CnetAddr		dest;
-    NL_PACKETKIND	kind;      	/* only ever NL_DATA or NL_ACK */
+    NL_PACKETKIND	kind;      	/* NL_DATA, NL_ACK or NL_TREE */
     int			seqno;		/* 0, 1, 2, ... */
     int			hopcount;
     size_t		length;       	/* the length of the msg portion only */
@@ -38,15 +45,60 @@ typedef struct {
 /* ----------------------------------------------------------------------- */
 
 /*  flood2() IS A BASIC ROUTING STRATEGY WHICH TRANSMITS THE OUTGOING PACKET
-    ON EVERY LINK SPECIFIED IN THE BITMAP NAMED links_wanted.
+    ON EVERY LINK SPECIFIED IN THE LINKSET NAMED links_wanted.  PACKETS ARE
+    QUEUED FOR EACH LINK'S FAIR SCHEDULER, WITH NL_ACKs GIVEN PRIORITY.
  */
-static void flood2(char *packet, size_t length, int links_wanted)
+static void flood2(char *packet, size_t length, const LINKSET *links_wanted)
 {
-    int	   link;
+    NL_PACKET	*p	= (NL_PACKET *)packet;
+    int		class	= (p->kind == NL_DATA) ? SCHED_DATA : SCHED_CONTROL;
+    int		link;
 
-    for(link=1 ; link<=nodeinfo.nlinks ; ++link)
-	if( links_wanted & (1<<link) )
-	    CHECK(down_to_datalink(link, packet, length));
+    FOR_EACH_LINK(link, links_wanted)
+	CHECK(schedule_packet(link, packet, length, p->src, p->dest, class));
+}
+
+/*  flood_links_except() RETURNS THE LINKS ON WHICH TO FLOOD, LESS ONE (OR
+    NONE IF 0).  ONCE THE SPANNING TREE HAS SETTLED, ONLY ITS EDGES ARE USED.
+ */
+static LINKSET *flood_links_except(int avoid_link)
+{
+    static LINKSET	links	= LINKSET_INIT;
+
+    if(ST_ready())
+	ST_treelinks(&links);
+    else {
+	LS_clear(&links);
+	LS_addall(&links, nodeinfo.nlinks);
+	for(int link=1 ; link<=nodeinfo.nlinks ; ++link)
+	    if(DLL_bonded(link))		/* carried by its bundle */
+		LS_remove(&links, link);
+    }
+    LS_remove(&links, avoid_link);
+    return &links;
+}
+
+/*  only_link() RETURNS THE SET HOLDING JUST THE ONE LINK */
+static LINKSET *only_link(int link)
+{
+    static LINKSET	links	= LINKSET_INIT;
+
+    LS_clear(&links);
+    LS_add(&links, link);
+    return &links;
+}
+
+/*  send_tree_packet() IS CALLED BY spantree.c TO CARRY A BPDU TO A NEIGHBOUR */
+void send_tree_packet(int link, char *bpdu, size_t length)
+{
+    NL_PACKET	p;
+
+    memset(&p, 0, PACKET_HEADER_SIZE);
+    p.src	= nodeinfo.address;
+    p.kind	= NL_TREE;
+    p.length	= length;
+    memcpy(p.msg, bpdu, length);
+    flood2((char *)&p, PACKET_SIZE(p), only_link(link));
 }
 
 /*  down_to_network() RECEIVES NEW MESSAGES FROM THE APPLICATION LAYER AND
@@ -65,7 +117,7 @@ static EVENT_HANDLER(down_to_network)
     p.hopcount	= 0;
     p.seqno	= NL_nextpackettosend(p.dest);
 
-    flood2((char *)&p, PACKET_SIZE(p), ALL_LINKS);
+    flood2((char *)&p, PACKET_SIZE(p), flood_links_except(0));
 }
 
 /*  up_to_network() IS CALLED FROM THE DATA LINK LAYER (BELOW) TO ACCEPT
@@ -75,6 +127,11 @@ int up_to_network(char *packet, size_t length, int arrived_on)
 {
     NL_PACKET	*p = (NL_PACKET *)packet;
 
+    if(p->kind == NL_TREE) {		/* BPDUs go no further than here */
+	ST_receive(p->msg, p->length, arrived_on);
+	return(0);
+    }
+
     ++p->hopcount;			/* took 1 hop to get here */
 /*  IS THIS PACKET IS FOR ME? */
     if(p->dest == nodeinfo.address) {
@@ -95,7 +152,7 @@ int up_to_network(char *packet, size_t length, int arrived_on)
 		p->hopcount	= 0;
 		p->length	= 0;
 		/* send the NL_ACK via the link on which the NL_DATA arrived */
-		flood2(packet, PACKET_HEADER_SIZE, (1<<arrived_on) );
+		flood2(packet, PACKET_HEADER_SIZE, only_link(arrived_on));
 	    }
 	    break;
 	case NL_ACK:
@@ -104,13 +161,15 @@ int up_to_network(char *packet, size_t length, int arrived_on)
 		CHECK(CNET_enable_application(p->src));
 	    }
 	    break;
+	default:			/* NL_TREE was handled above */
+	    break;
 	}
     }
 /* THIS PACKET IS FOR SOMEONE ELSE */
     else {
 	if(p->hopcount < MAXHOPS) 		/* if not too many hops... */
 	    /* retransmit on all links *except* the one on which it arrived */
-	    flood2(packet, length, ALL_LINKS & ~(1<<arrived_on) );
+	    flood2(packet, length, flood_links_except(arrived_on));
 	else
 	    /* silently drop */;
     }
@@ -122,13 +181,10 @@ int up_to_network(char *packet, size_t length, int arrived_on)
 
 EVENT_HANDLER(reboot_node)
 {
-    if(nodeinfo.nlinks >= 32) {
-	fprintf(stderr,"flood2 flooding will not work here\n");
-	exit(1);
-    }
-
     reboot_DLL();
+    reboot_linksched();
     reboot_NL_table();
+    reboot_spantree();
 
     CHECK(CNET_set_handler(EV_APPLICATIONREADY, down_to_network, 0));
     CNET_enable_application(ALLNODES);
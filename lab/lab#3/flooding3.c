@@ -1,39 +1,112 @@
 #include <cnet.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "nl_table.h"
 #include "dll_basic.h"
+#include "linksched.h"
+#include "pktpool.h"
+#include "spantree.h"
+#include "srcroute.h"
 
-#define	MAXHOPS		4
+#ifndef	MAXHOPS
+#define	MAXHOPS		4		/* may be given with -D, by runsweep */
+#endif
+#ifndef	SOURCEROUTE
+#define	SOURCEROUTE	0		/* 1 to source route packets */
+#endif
+#ifndef	MAXDEFLECT
+#define	MAXDEFLECT	0		/* deflections allowed per packet */
+#endif
+#define	COST_BYTES	1024		/* nominal packet size for link costs */
+#define	NL_TIMEOUT	20000000	/* usecs, before resending */
 
 /*  This file implements a much better flooding algorithm than those in
     both flooding1.c and flooding2.c. As Network Layer packets are processed,
     the information in their headers is used to update the NL table.
 
-    The minimum observed hopcount to each (potential) remote destination
+    Each packet accumulates a path cost: as it arrives over each link, the
+    expected transmission time (ETT) of that link is added.  A link's ETT is
+    the time to send the packet once (from the link's bandwidth and
+    propagation delay) divided by the link's delivery ratio, measured in
+    both directions by the spanning tree's periodic BPDUs.
+
+    The minimum observed path cost to each (potential) remote destination
     is remembered by the NL table, as is the link on which these packets
     arrive. This link is later used to route packets leaving for that node.
 
-    The routine NL_savehopcount() is called for both NL_DATA and NL_ACK
+    The routine NL_savepathcost() is called for both NL_DATA and NL_ACK
     packets, and we even "steal" information from Network Layer packets
     that don't belong to us!
 
     I don't think it's a flooding algorithm any more Toto.
 
     This flooding algorithm exhibits an efficiency which improves over time
-    (as the NL table "learns" more).  Over the 8 nodes in the AUSTRALIA.MAP
-    file, the initial efficiency is the same as that of flooding1.c (about
-    2%) but as the NL table improves, the efficiency rises to over 64%.
+    (as the NL table "learns" more).  Measured by cnetsim, over the 8 nodes
+    in the AUSTRALIA.MAP file (FLOODING3) the efficiency is about 39% after
+    30 seconds, as packets are flooded only on the spanning tree, and rises
+    to about 41% after 10 minutes.  Over WORLD.MAP (WORLD) it rises from
+    about 10% to about 15%.
+
+    Each destination may have a window of unacknowledged packets, sized by
+    AIMD congestion control in the NL table.  Data packets queued behind a
+    congested link are marked (ecn), and the NL_ACK echoes that mark back
+    to the source, which then halves its window for that destination.
+    NL_ACKs are cumulative, and are batched by the receiver (see nl_table.c)
+    so that several NL_DATA packets share each NL_ACK on the reverse path.
+    If no NL_ACK advances the window for NL_TIMEOUT usecs (EV_TIMER8), the
+    window is halved and every unacknowledged packet that the receiver has
+    not selectively acknowledged is resent, so that a lost NL_DATA or
+    NL_ACK cannot leave the window full, and the destination disabled.
+
+    If the environment variable NL_ROUTES names a file of routes precomputed
+    by mkroutes (from this topology file), packets follow their best paths
+    from the start.  Packets for destinations not yet in the NL table are
+    flooded only on the edges of a spanning tree (see spantree.c), once it
+    has settled.  If the topology's nodes may fail (a non-zero nodemtbf),
+    setting NL_SNAPSHOTS to a directory lets a rebooted node reload the
+    routes it had learnt (see nl_table.c).
+
+    Compiled with -D MAXDEFLECT=n (n > 0), when a packet's best link is
+    congested (its queue would delay the packet by more than linksched.c's
+    ECN_DELAY) the packet may instead be deflected onto the least loaded
+    uncongested link whose path to the destination has been seen to be at
+    most one hop longer.  Each packet may be deflected at most MAXDEFLECT
+    times, so deflected packets cannot loop for long, and MAXHOPS still
+    bounds their path.  As a deflected packet may overtake, or be
+    overtaken by, others for the same destination, NL_DATA packets
+    arriving early are held by the destination until the gap before them
+    is filled.
+
+    Compiled with -D SOURCEROUTE=1, NL_DATA and NL_ACK packets are source
+    routed once a path to their destination is known.  A packet for which
+    the source has no path (in srcroute.c's cache) is routed as above,
+    recording in its header the link on which it leaves, and arrives at,
+    each node.  Its destination caches the reverse of the path, and
+    returns the forward path to the source in an NL_RREP.  A source routed
+    packet carries its whole path, and each intermediate node simply sends
+    it on the next link, with no table lookup and no state, and notes the
+    link on which it arrived.  If that link has failed, the packet is
+    routed as above from there, and an NL_RERR is returned along the
+    recorded links, so that the source forgets the path.
 */
 
-typedef enum    	{ NL_DATA, NL_ACK }   NL_PACKETKIND;
+typedef enum    	{ NL_DATA, NL_ACK, NL_TREE, NL_RREP, NL_RERR }
+			NL_PACKETKIND;
 
 typedef struct {
     CnetAddr		src;
     CnetAddr		dest;
-    NL_PACKETKIND	kind;      	/* only ever NL_DATA or NL_ACK */
+    NL_PACKETKIND	kind;      	/* NL_DATA, NL_ACK, NL_TREE ... */
     int			seqno;		/* 0, 1, 2, ... */
     int			hopcount;
+    int			pathcost;	/* usec, the sum of links' ETTs */
+    int			ecn;		/* congestion seen, echoed in NL_ACK */
+    unsigned int	sack;		/* NL_ACK: seqno+2+i also received */
+    int			deflections;	/* times sent off its best link */
+#if	SOURCEROUTE
+    SRROUTE		route;		/* recorded, or to follow */
+#endif
     size_t		length;       	/* the length of the msg portion only */
     char		msg[MAX_MESSAGE_SIZE];
 } NL_PACKET;
@@ -41,32 +114,338 @@ typedef struct {
 #define PACKET_HEADER_SIZE  (sizeof(NL_PACKET) - MAX_MESSAGE_SIZE)
 #define PACKET_SIZE(p)	    (PACKET_HEADER_SIZE + p.length)
 
+typedef struct {
+    CnetAddr		src;
+    char		*early[NL_MAXWINDOW];	/* held until in order */
+} RESEQUENCER;
+
+static	RESEQUENCER	*reseq		= NULL;
+static	int		reseq_size	= 0;
+
+typedef struct {
+    CnetAddr		dest;
+    char		*unacked[NL_MAXWINDOW];	/* copies, for resending */
+    CnetTimerID		timer;
+} RETRANSMITTER;
+
+static	RETRANSMITTER	*retx		= NULL;
+static	int		retx_size	= 0;
+
 
 /* ----------------------------------------------------------------------- */
 
+/*  link_cost() IS THE EXPECTED TIME, IN usecs, TO DELIVER A PACKET OF
+    COST_BYTES OVER THE LINK - ITS ETT.  A FIXED SIZE IS USED SO THAT THE
+    COSTS CARRIED BY SHORT NL_ACKs AND LONG NL_DATA PACKETS CAN BE COMPARED.
+ */
+static int link_cost(int link)
+{
+    CnetTime	once;
+
+    once	= ((CnetTime)COST_BYTES * 8000000) / DLL_bandwidth(link) +
+				linkinfo[link].propagationdelay;
+    return (int)(once / ST_delivery(link));
+}
+
+static	int	ndeflected	= 0;	/* statistics */
+static	int	nundeflected	= 0;	/* wanted deflecting, but could not be */
+static	int	nretransmitted	= 0;	/* NL_DATA resent after a timeout */
+#if	SOURCEROUTE
+static	int	nsrforwarded	= 0;	/* source routed packets sent on */
+static	int	nsrfailed	= 0;	/* ... whose next link had failed */
+#endif
+
+/*  THE TIME, IN usecs, THAT A NEW PACKET WOULD WAIT IN THE LINK'S QUEUE */
+static CnetTime queue_delay(int link)
+{
+    return ((CnetTime)sched_backlog(link) * 8000000) / DLL_bandwidth(link);
+}
+
+/*  deflect_link() CHOOSES A LINK TO CARRY A PACKET FOR dest AROUND ITS
+    CONGESTED BEST LINK, OR RETURNS 0.  THE LINK MUST HAVE BEEN SEEN TO
+    REACH dest IN AT MOST ONE HOP MORE THAN best, WITHIN MAXHOPS, AND MUST
+    ITSELF BE UNCONGESTED, WITH A QUEUE SHORTER THAN best's BY MORE THAN ITS
+    OWN COST.  OF THOSE, THE ONE WITH THE SHORTEST QUEUE IS CHOSEN.
+ */
+static int deflect_link(CnetAddr dest, int hopcount, int best, int avoid_link)
+{
+    int		besthops	= NL_hopsvia(dest, best);
+    int		chosen		= 0;
+
+    for(int link=1 ; link<=nodeinfo.nlinks ; ++link) {
+	int	hops	= NL_hopsvia(dest, link);
+
+	if(link == best || link == avoid_link || DLL_bonded(link) ||
+	   hops == 0 || (besthops != 0 && hops > besthops+1) ||
+	   hopcount + hops > MAXHOPS || sched_congested(link) ||
+	   queue_delay(link) + link_cost(link) >= queue_delay(best))
+	    continue;
+	if(chosen == 0 || queue_delay(chosen) > queue_delay(link))
+	    chosen	= link;
+    }
+    return chosen;
+}
+
+/*  A PACKET DISCOVERING ITS ROUTE RECORDS EACH LINK THAT IT LEAVES ON */
+static void record_link(NL_PACKET *p, int link)
+{
+#if	SOURCEROUTE
+    if(p->route.mode == SR_RECORD) {
+	if(p->route.len < SR_MAXPATH && link < 256)
+	    p->route.out[p->route.len]	= link;
+	else
+	    p->route.mode	= SR_NONE;	/* too far to source route */
+    }
+#endif
+}
+
 /*  flood3() IS A BASIC ROUTING STRATEGY WHICH TRANSMITS THE OUTGOING PACKET
     ON EITHER THE SPECIFIED LINK, OR ALL BEST-KNOWN LINKS WHILE AVOIDING
     ANY OTHER SPECIFIED LINK.
  */
 static void flood3(char *packet, size_t length, int choose_link, int avoid_link)
 {
+    NL_PACKET	*p	= (NL_PACKET *)packet;
+    int		class	= (p->kind == NL_DATA) ? SCHED_DATA : SCHED_CONTROL;
+
 /*  REQUIRED LINK IS PROVIDED - USE IT */
-    if(choose_link != 0)
-	CHECK(down_to_datalink(choose_link, packet, length));
+    if(choose_link != 0) {
+	if(class == SCHED_DATA && sched_congested(choose_link))
+	    p->ecn	= 1;
+	record_link(p, choose_link);
+	CHECK(schedule_packet(choose_link, packet, length,
+				p->src, p->dest, class));
+    }
 
 /*  OTHERWISE, CHOOSE THE BEST KNOWN LINKS, AVOIDING ANY SPECIFIED ONE */
     else {
-	NL_PACKET	*p = (NL_PACKET *)packet;
-	int		links_wanted = NL_linksofminhops(p->dest);
-	int		link;
-
-	for(link=1 ; link<=nodeinfo.nlinks ; ++link) {
-	    if(link == avoid_link)		/* possibly avoid this one */
-		continue;
-	    if( links_wanted & (1<<link) )	/* use this link if wanted */
-		CHECK(down_to_datalink(link, packet, length));
+	static LINKSET	links_wanted	= LINKSET_INIT;
+	int		link, best, alt;
+	bool		known;
+
+	/* an unknown destination is flooded on the spanning tree, if settled */
+	known	= NL_linksofmincost(p->dest, &links_wanted);
+	if(!known && ST_ready())
+	    ST_treelinks(&links_wanted);
+
+	/* deflect around a congested best link, within the packet's budget */
+	if(known && (best = LS_next(&links_wanted, 0)) > 0 &&
+	   (best == avoid_link || sched_congested(best))) {
+	    if(p->deflections < MAXDEFLECT &&
+	       (alt = deflect_link(p->dest, p->hopcount, best, avoid_link)) != 0) {
+		++p->deflections;
+		++ndeflected;
+		LS_clear(&links_wanted);
+		LS_add(&links_wanted, alt);
+	    }
+	    else
+		++nundeflected;
 	}
+	LS_remove(&links_wanted, avoid_link);	/* possibly avoid this one */
+	if(class == SCHED_DATA)
+	    FOR_EACH_LINK(link, &links_wanted)
+		if(sched_congested(link))
+		    p->ecn	= 1;
+	FOR_EACH_LINK(link, &links_wanted) {	/* use each link if wanted */
+	    record_link(p, link);
+	    CHECK(schedule_packet(link, packet, length,
+				    p->src, p->dest, class));
+	}
+    }
+}
+
+#if	SOURCEROUTE
+static void send_route_error(NL_PACKET *failed);
+
+/*  sr_forward() SENDS A SOURCE ROUTED PACKET ON THE NEXT LINK OF ITS ROUTE.
+    IF THAT LINK HAS FAILED, AN NL_RERR IS RETURNED TO THE PACKET'S SOURCE,
+    AND THE PACKET ITSELF IS ROUTED BY flood3() FROM HERE.
+ */
+static void sr_forward(char *packet, size_t length, int avoid_link)
+{
+    NL_PACKET	*p	= (NL_PACKET *)packet;
+    SRROUTE	*r	= &p->route;
+    int		link	= (r->next < r->len) ? r->out[r->next] : 0;
+    int		class	= (p->kind == NL_DATA) ? SCHED_DATA : SCHED_CONTROL;
+
+    if(!SR_usable(link)) {
+	++nsrfailed;
+	if(p->kind == NL_DATA || p->kind == NL_ACK) {
+	    send_route_error(p);
+	    r->mode	= SR_NONE;
+	    flood3(packet, length, 0, avoid_link);
+	}
+	return;				/* an NL_RREP or NL_RERR is lost */
+    }
+    ++r->next;
+    if(class == SCHED_DATA && sched_congested(link))
+	p->ecn	= 1;
+    CHECK(schedule_packet(link, packet, length, p->src, p->dest, class));
+}
+
+/*  send_route_error() TELLS THE SOURCE OF A PACKET THAT ITS PATH HAS FAILED,
+    BY RETRACING THE LINKS THAT THE PACKET TOOK TO REACH US
+ */
+static void send_route_error(NL_PACKET *failed)
+{
+    NL_PACKET	p;
+
+    if(failed->route.next == 0) {	/* our own cached path failed */
+	SR_invalidate(failed->dest);
+	return;
     }
+    memset(&p, 0, PACKET_HEADER_SIZE);
+    p.src	= nodeinfo.address;
+    p.dest	= failed->src;
+    p.kind	= NL_RERR;
+    p.length	= sizeof(CnetAddr);
+    memcpy(p.msg, &failed->dest, sizeof(CnetAddr));
+    SR_reverse(&failed->route, failed->route.next, &p.route);
+    sr_forward((char *)&p, PACKET_SIZE(p), 0);
+}
+
+/*  send_route_reply() RETURNS THE PATH RECORDED BY A PACKET TO ITS SOURCE,
+    ALONG THE REVERSE OF THAT PATH, WHICH WE CACHE OURSELVES
+ */
+static void send_route_reply(NL_PACKET *data)
+{
+    NL_PACKET	p;
+
+    memset(&p, 0, PACKET_HEADER_SIZE);
+    p.src	= nodeinfo.address;
+    p.dest	= data->src;
+    p.kind	= NL_RREP;
+    p.length	= data->route.len;
+    memcpy(p.msg, data->route.out, data->route.len);
+    SR_reverse(&data->route, data->route.len, &p.route);
+    SR_learn(p.dest, p.route.out, p.route.len);
+    sr_forward((char *)&p, PACKET_SIZE(p), 0);
+}
+#endif
+
+//  GIVEN A SOURCE ADDRESS, LOCATE OR CREATE ITS RESEQUENCER
+static int find_reseq(CnetAddr src)
+{
+    for(int r=0 ; r<reseq_size ; ++r)
+	if(reseq[r].src == src)
+	    return r;
+
+    reseq	= realloc(reseq, (reseq_size+1)*sizeof(RESEQUENCER));
+    memset(&reseq[reseq_size], 0, sizeof(RESEQUENCER));
+    reseq[reseq_size].src	= src;
+    return reseq_size++;
+}
+
+/*  deliver_early() PASSES UP ANY HELD PACKETS THAT ARE NOW IN ORDER */
+static void deliver_early(CnetAddr src)
+{
+    int		r	= find_reseq(src);
+    char	*pkt;
+
+    while((pkt = reseq[r].early[NL_packetexpected(src) % NL_MAXWINDOW]) != NULL) {
+	NL_PACKET	*p	= (NL_PACKET *)pkt;
+	size_t		length	= p->length;
+
+	reseq[r].early[NL_packetexpected(src) % NL_MAXWINDOW]	= NULL;
+	CHECK(CNET_write_application(p->msg, &length));
+	inc_NL_packetexpected(src);
+	pkt_release(pkt);
+    }
+}
+
+//  GIVEN A DESTINATION ADDRESS, LOCATE OR CREATE ITS RETRANSMITTER
+static int find_retx(CnetAddr dest)
+{
+    for(int r=0 ; r<retx_size ; ++r)
+	if(retx[r].dest == dest)
+	    return r;
+
+    retx	= realloc(retx, (retx_size+1)*sizeof(RETRANSMITTER));
+    memset(&retx[retx_size], 0, sizeof(RETRANSMITTER));
+    retx[retx_size].dest	= dest;
+    retx[retx_size].timer	= NULLTIMER;
+    return retx_size++;
+}
+
+/*  send_data() SENDS A NEW OR RESENT NL_DATA PACKET FROM THIS NODE */
+static void send_data(NL_PACKET *p)
+{
+    p->hopcount		= 0;
+    p->pathcost		= 0;
+    p->ecn		= 0;
+    p->deflections	= 0;
+#if	SOURCEROUTE
+    memset(&p->route, 0, sizeof(p->route));
+    if(SR_lookup(p->dest, &p->route))
+	sr_forward((char *)p, PACKET_SIZE((*p)), 0);
+    else {
+	p->route.mode	= SR_RECORD;		/* discover a route */
+	flood3((char *)p, PACKET_SIZE((*p)), 0, 0);
+    }
+#else
+    flood3((char *)p, PACKET_SIZE((*p)), 0, 0);
+#endif
+}
+
+/*  EV_TIMER8 - NO NL_ACK HAS ADVANCED THE WINDOW TO dest FOR NL_TIMEOUT.
+    HALVE THE WINDOW, AND RESEND EACH PACKET NOT SELECTIVELY ACKNOWLEDGED
+ */
+static EVENT_HANDLER(retransmit)
+{
+    CnetAddr	dest	= (CnetAddr)data;
+    int		r	= find_retx(dest);
+    int		first	= NL_ackexpected(dest);
+    NL_PACKET	p;
+
+    NL_congestion(dest);
+    for(int s=first ; s<first + NL_inflight(dest) ; ++s) {
+	char	*pkt	= retx[r].unacked[s % NL_MAXWINDOW];
+
+	if(pkt == NULL || NL_issacked(dest, s))
+	    continue;
+	memcpy(&p, pkt, pkt_length(pkt));
+	++nretransmitted;
+	send_data(&p);
+    }
+    retx[r].timer	= CNET_start_timer(EV_TIMER8, NL_TIMEOUT, data);
+}
+
+/*  send_tree_packet() IS CALLED BY spantree.c TO CARRY A BPDU TO A NEIGHBOUR */
+void send_tree_packet(int link, char *bpdu, size_t length)
+{
+    NL_PACKET	p;
+
+    memset(&p, 0, PACKET_HEADER_SIZE);
+    p.src	= nodeinfo.address;
+    p.kind	= NL_TREE;
+    p.length	= length;
+    memcpy(p.msg, bpdu, length);
+    flood3((char *)&p, PACKET_SIZE(p), link, 0);
+}
+
+/*  send_NL_ack() IS CALLED BY nl_table.c WHEN A (BATCHED) NL_ACK IS DUE */
+static void send_NL_ack(CnetAddr dest, int link, bool ecn)
+{
+    NL_PACKET	p;
+
+    p.src	= nodeinfo.address;
+    p.dest	= dest;
+    p.kind	= NL_ACK;
+    p.seqno	= NL_packetexpected(dest) - 1;	/* all packets before this */
+    p.hopcount	= 0;
+    p.pathcost	= 0;
+    p.ecn	= ecn;
+    p.sack	= NL_sackbits(dest);
+    p.deflections	= 0;
+    p.length	= 0;
+#if	SOURCEROUTE
+    memset(&p.route, 0, sizeof(p.route));
+    if(SR_lookup(dest, &p.route)) {
+	sr_forward((char *)&p, PACKET_HEADER_SIZE, 0);
+	return;
+    }
+#endif
+    flood3((char *)&p, PACKET_HEADER_SIZE, link, 0);
 }
 
 /*  down_to_network() RECEIVES NEW MESSAGES FROM THE APPLICATION LAYER AND
@@ -75,17 +454,36 @@ static void flood3(char *packet, size_t length, int choose_link, int avoid_link)
 static EVENT_HANDLER(down_to_network)
 {
     NL_PACKET	p;
+    int		r;
 
     p.length	= sizeof(p.msg);
     CHECK(CNET_read_application(&p.dest, p.msg, &p.length));
-    CNET_disable_application(p.dest);
 
     p.src	= nodeinfo.address;
     p.kind	= NL_DATA;
-    p.hopcount	= 0;
+    p.sack	= 0;
     p.seqno	= NL_nextpackettosend(p.dest);
 
-    flood3((char *)&p, PACKET_SIZE(p), 0, 0);
+/*  KEEP A COPY FOR RESENDING, AND TIME THE OLDEST UNACKNOWLEDGED PACKET */
+    r	= find_retx(p.dest);
+    retx[r].unacked[p.seqno % NL_MAXWINDOW]	= pkt_copy(&p, PACKET_SIZE(p));
+    if(retx[r].timer == NULLTIMER)
+	retx[r].timer	= CNET_start_timer(EV_TIMER8, NL_TIMEOUT,
+						(CnetData)p.dest);
+    send_data(&p);
+
+    if(NL_inflight(p.dest) >= NL_window(p.dest))	/* window is full */
+	CNET_disable_application(p.dest);
+}
+
+/*  A SOURCE ROUTED PACKET'S HOPS AND COST ARE NOT COUNTED ON ITS WAY */
+static bool source_routed(NL_PACKET *p)
+{
+#if	SOURCEROUTE
+    return p->route.mode == SR_ROUTED;
+#else
+    return false;
+#endif
 }
 
 /*  up_to_network() IS CALLED FROM THE DATA LINK LAYER (BELOW) TO ACCEPT
@@ -95,44 +493,115 @@ int up_to_network(char *packet, size_t length, int arrived_on_link)
 {
     NL_PACKET	*p = (NL_PACKET *)packet;
 
+    if(p->kind == NL_TREE) {		/* BPDUs go no further than here */
+	ST_receive(p->msg, p->length, arrived_on_link);
+	return(0);
+    }
+
+#if	SOURCEROUTE
+    if(p->route.mode == SR_ROUTED && p->route.next > 0) {
+	p->route.back[p->route.next-1]	= arrived_on_link;
+	if(p->dest != nodeinfo.address) {	/* no lookup, and no state */
+	    ++nsrforwarded;
+	    sr_forward(packet, length, arrived_on_link);
+	    return(0);
+	}
+    }
+    else if(p->route.mode == SR_RECORD) {
+	if(arrived_on_link < 256)
+	    p->route.back[p->route.len++]	= arrived_on_link;
+	else
+	    p->route.mode	= SR_NONE;
+    }
+#endif
+
     ++p->hopcount;			/* took 1 hop to get here */
+    p->pathcost	+= link_cost(arrived_on_link);
 /*  IS THIS PACKET IS FOR ME? */
     if(p->dest == nodeinfo.address) {
 	switch (p->kind) {
-	case NL_DATA:
-	    if(p->seqno == NL_packetexpected(p->src)) {
-		CnetAddr	tmpaddr;
+	case NL_DATA: {
+	    int	expected	= NL_packetexpected(p->src);
 
+	    if(p->seqno == expected) {
 		length		= p->length;
 		CHECK(CNET_write_application(p->msg, &length));
 		inc_NL_packetexpected(p->src);
+		deliver_early(p->src);
 
-		NL_savehopcount(p->src, p->hopcount, arrived_on_link);
-
-		tmpaddr	 	= p->src;  /* swap src and dest addresses */
-		p->src	 	= p->dest;
-		p->dest	 	= tmpaddr;
+		if(!source_routed(p))
+		    NL_savepathcost(p->src, p->hopcount, p->pathcost,
+						arrived_on_link);
+		/* the batched NL_ACK is cumulative, and echoes p->ecn */
+		NL_ackowed(p->src, arrived_on_link, p->ecn, false);
+	    }
+	    /* a duplicate, resent because our NL_ACK was lost, is
+	       acknowledged at once, but at most once per NL_ACKHOLD */
+	    else if(p->seqno < expected)
+		NL_duplicate(p->src, arrived_on_link);
+	    /* hold a (deflected) packet that arrived early */
+	    else if(p->seqno > expected && p->seqno < expected + NL_MAXWINDOW) {
+		int	r	= find_reseq(p->src);
 
-		p->kind	 	= NL_ACK;
-		p->hopcount	= 0;
-		p->length	= 0;
-		flood3(packet, PACKET_HEADER_SIZE, arrived_on_link, 0);
+		if(reseq[r].early[p->seqno % NL_MAXWINDOW] == NULL) {
+		    reseq[r].early[p->seqno % NL_MAXWINDOW] =
+					pkt_copy(packet, length);
+		    NL_outoforder(p->src, p->seqno);
+		}
 	    }
+#if	SOURCEROUTE
+	    if(p->route.mode == SR_RECORD)
+		send_route_reply(p);
+#endif
 	    break;
+	}
 
-	case NL_ACK:
-	    if(p->seqno == NL_ackexpected(p->src)) {
-		inc_NL_ackexpected(p->src);
-		NL_savehopcount(p->src, p->hopcount, arrived_on_link);
-		CHECK(CNET_enable_application(p->src));
+	case NL_ACK: {
+	    int	first	= NL_ackexpected(p->src);
+	    int	nacked	= NL_ackreceived(p->src, p->seqno, p->sack);
+
+	    if(nacked > 0) {
+		int	r	= find_retx(p->src);
+
+		if(!source_routed(p))
+		    NL_savepathcost(p->src, p->hopcount, p->pathcost,
+						arrived_on_link);
+		for(int s=first ; s<first + nacked ; ++s) {
+		    pkt_release(retx[r].unacked[s % NL_MAXWINDOW]);
+		    retx[r].unacked[s % NL_MAXWINDOW]	= NULL;
+		}
+		CNET_stop_timer(retx[r].timer);
+		retx[r].timer	= (NL_inflight(p->src) > 0) ?
+			CNET_start_timer(EV_TIMER8, NL_TIMEOUT,
+					 (CnetData)p->src) : NULLTIMER;
 	    }
+	    if(p->ecn)
+		NL_congestion(p->src);
+	    if(NL_inflight(p->src) < NL_window(p->src))
+		CHECK(CNET_enable_application(p->src));
+	    break;
+	}
+#if	SOURCEROUTE
+	case NL_RREP:
+	    SR_learn(p->src, (unsigned char *)p->msg, p->length);
+	    break;
+	case NL_RERR: {
+	    CnetAddr	dest;
+
+	    memcpy(&dest, p->msg, sizeof(CnetAddr));
+	    SR_invalidate(dest);
+	    break;
+	}
+#endif
+	default:			/* NL_TREE was handled above */
 	    break;
 	}
     }
 /* THIS PACKET IS FOR SOMEONE ELSE */
     else {
 	if(p->hopcount < MAXHOPS) {		/* if not too many hops... */
-	    NL_savehopcount(p->src, p->hopcount, arrived_on_link);
+	    NL_savepathcost(p->src, p->hopcount, p->pathcost,
+						arrived_on_link);
 	    /* retransmit on best links *except* the one on which it arrived */
 	    flood3(packet, length, 0, arrived_on_link);
 	}
@@ -143,18 +612,36 @@ int up_to_network(char *packet, size_t length, int arrived_on_link)
 }
 
 
+static EVENT_HANDLER(periodic_events)
+{
+    printf("\n%s: %d packets deflected, %d could not be, %d resent\n",
+		nodeinfo.nodename, ndeflected, nundeflected, nretransmitted);
+#if	SOURCEROUTE
+    printf("%s: %d source routed packets forwarded, %d found a failed link\n",
+		nodeinfo.nodename, nsrforwarded, nsrfailed);
+    SR_showcache();
+#endif
+    sched_showstats();
+}
+
+
 /* ----------------------------------------------------------------------- */
 
 EVENT_HANDLER(reboot_node)
 {
-    if(nodeinfo.nlinks > 32) {
-	fprintf(stderr,"flood3 flooding will not work here\n");
-	exit(1);
-    }
-
     reboot_DLL();
+    reboot_linksched();
     reboot_NL_table();
+    NL_loadroutes(getenv("NL_ROUTES"));	/* precomputed by mkroutes */
+    NL_snapshots(getenv("NL_SNAPSHOTS"));	/* if nodes may reboot */
+    reboot_spantree();
+#if	SOURCEROUTE
+    reboot_srcroute();
+#endif
+    NL_ackbatching(send_NL_ack);
 
+    CHECK(CNET_set_handler(EV_TIMER8, retransmit, 0));
     CHECK(CNET_set_handler(EV_APPLICATIONREADY, down_to_network, 0));
     CHECK(CNET_enable_application(ALLNODES));
+    CHECK(CNET_set_handler(EV_PERIODIC, periodic_events, 0));
 }
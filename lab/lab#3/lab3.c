@@ -4,8 +4,20 @@
 
 #include "nl_table.h"
 #include "dll_basic.h"
-
-#define	MAXHOPS		4
+#include "linksched.h"
+#include "spantree.h"
+#include "pktpool.h"
+#include "twheel.h"
+
+#ifndef	MAXHOPS
+#define	MAXHOPS		4		/* may be given with -D, by runsweep */
+#endif
+#ifndef	RETX_ROUTED
+#define	RETX_ROUTED	2		/* timeouts resent on the best link */
+#endif
+#ifndef	RETX_MULTI
+#define	RETX_MULTI	1		/* ... then on all links, then flooded */
+#endif
 
 /*  This file implements a better flooding algorithm exhibiting slightly
     more "intelligence" than the naive algorithm in flooding1.c
@@ -13,44 +25,63 @@
 
     1) data packets are initially sent on all links.
     2) packets are forwarded on all links except the one on which they arrived.
+       Once the spanning tree (spantree.c) has settled, "all links" means
+       all tree links, so each flood costs N-1 transmissions.
     3) acknowledgement packets are initially sent on the link on which their
        data packet arrived.
+    4) each destination may have a window of unacknowledged packets, sized
+       by AIMD congestion control (see nl_table.c).  Unacknowledged packets
+       are resent, go-back-N, on timeout.  The timeouts are logical
+       timers on the node's timing wheel (twheel.c), so that restarting
+       one on every NL_ACK costs the simulator no events.  Data queued
+       behind a congested link is marked (ecn), and the mark is echoed
+       back in the NL_ACK.
+    5) NL_ACKs are cumulative and batched by the receiver (see nl_table.c).
+       Packets arriving early are held until the gap before them is filled,
+       and are reported in the NL_ACK's selective bitmap so that the
+       sender's timeout does not resend them.
+    6) every packet teaches the NL table the link on which its source is
+       fewest hops away.  For the first RETX_ROUTED consecutive timeouts
+       to a destination, retransmissions are sent only along these best
+       links, hop by hop (NL_ROUTED).  For the next RETX_MULTI they leave
+       on all of the source's links, but are then routed (NL_MULTI), and
+       only after that are they flooded like new packets (NL_FLOODED).
+       A lost packet to a well-known destination then costs one
+       transmission per hop of its path, not one per link of the network.
 
     This algorithm exhibits better efficiency than flooding1.c .  Over the
     8 nodes in the AUSTRALIA.MAP file, the efficiency is typically about 8%.
  */
 
-typedef enum    	{ NL_DATA, NL_ACK }   NL_PACKETKIND;
+typedef enum    	{ NL_DATA, NL_ACK, NL_TREE }   NL_PACKETKIND;
+typedef enum		{ NL_FIRST, NL_ROUTED, NL_MULTI, NL_FLOODED } NL_RETX;
 
 typedef struct {
     CnetAddr		src;
     CnetAddr		dest;
-    NL_PACKETKIND	kind;      	/* only ever NL_DATA or NL_ACK */
+    NL_PACKETKIND	kind;      	/* NL_DATA, NL_ACK or NL_TREE */
     int			seqno;		/* 0, 1, 2, ... */
     int			hopcount;
+    int			ecn;		/* congestion seen, echoed in NL_ACK */
+    unsigned int	sack;		/* NL_ACK: seqno+2+i also received */
+    NL_RETX		retx;		/* how a retransmission is forwarded */
     size_t		length;       	/* the length of the msg portion only */
     char		msg[MAX_MESSAGE_SIZE];
 } NL_PACKET;
 
-typedef struct {
-    CnetAddr	address;		// ... of remote node
-    int		ackexpected;		// packet sequence numbers to/from node
-    int		nextpackettosend;
-    int		packetexpected;
-
-    int		minhops;		// minimum known hops to remote node
-    int		minhop_link;		// link via which minhops path observed
-} NLTABLE;
-
-static	NLTABLE	*NL_table	= NULL;
-static	int	NL_table_size	= 0;
-
 typedef struct {
     CnetAddr dest;
-    CnetTimerID last_timer;
-    NL_PACKET last_pkt;
+    TW_TIMER last_timer;	/* runs while any packet is unacknowledged */
+    char *pkts[NL_MAXWINDOW];	/* pooled copies of unacknowledged packets,
+				   indexed by seqno % NL_MAXWINDOW */
+    char *early[NL_MAXWINDOW];	/* packets from dest that arrived out of
+				   order, awaiting delivery */
+    int failures;		/* consecutive timeouts without an NL_ACK */
+    int nretx[NL_FLOODED+1];	/* packets resent, by NL_RETX */
 } TIMEOUT_ENTRY;
 
+#define	NL_TIMEOUT	80000000	/* usecs, before resending */
+
 #define PACKET_HEADER_SIZE  (sizeof(NL_PACKET) - MAX_MESSAGE_SIZE)
 #define PACKET_SIZE(p)	    (PACKET_HEADER_SIZE + p.length)
 
@@ -61,6 +92,8 @@ static TIMEOUT_ENTRY *timeout;
 static int index;
 static int timeoutindex;
 
+static void timeout_events(TW_TIMER timer, CnetData data);
+
 /*code copied from nl_table.c*/
 static int find_address_timeout(CnetAddr address)
 {
@@ -76,81 +109,35 @@ static int find_address_timeout(CnetAddr address)
     return timeout_table_size++;
 }
 
-static int find_address(CnetTimerID timer)
-{
-    for(int i = 0; i < timeout_table_size; i++){
-        if(timeout[i].last_timer == timer)
-            return i;
-    }
-    return -1;
-}
-
-/*code copied from nl_table.c*/
-//-------------------------------------------------------------------
-//  FIND THE LINK ON WHICH PACKETS OF MINIMUM HOP COUNT WERE OBSERVED.
-//  IF THE BEST LINK IS UNKNOWN, WE RETURN ALL_LINKS.
-
-int NL_linksofminhops(CnetAddr address) {
-    int	t	= find_address_timeout(address);
-    int link	= NL_table[t].minhop_link;
-    return (link == 0) ? ALL_LINKS : (1 << link);
-}
-
-static	bool	given_stats	= false;
-
-void NL_savehopcount(CnetAddr address, int hops, int link)
-{
-    int	t	= find_address_timeout(address);
-
-    if(NL_table[t].minhops > hops) {
-	NL_table[t].minhops	= hops;
-	NL_table[t].minhop_link	= link;
-	given_stats		= true;
-    }
-}
-
-// -----------------------------------------------------------------
-//print the contents of NL_Table
-void DEBUG0_Events()
-{
-    printf("\n%13s %13s %13s %13s","destination", "ackexpected", "nextpkttosend", "pktexpected");
-    if(given_stats==true) printf(" %8s %8s\n", "minhops", "minhop_link");
-    for(int t=0 ; t<NL_table_size ; ++t)
-    	if(NL_table[t].address != nodeinfo.address) {
-        	printf("%13d %13d %13d %13d",(int)NL_table[t].address, NL_table[t].ackexpected,NL_table[t].nextpackettosend, NL_table[t].packetexpected);
-        if(NL_table[t].minhop_link != 0) printf(" %8d %8d\n", NL_table[t].minhops,NL_table[t].minhop_link);
-    }
-}
-
 //TIMERS info
 void DEBUG1_Events()
 {
-    NL_PACKET p;
+    NL_PACKET *p;
     char *packet_kind;
-    for(int i=0; i < timeout_table_size; i++){
-        p = timeout[i].last_pkt;
-            if (p.kind == NL_DATA){
-                packet_kind = "NL_DATA\0";
-                break;
-	    }
-            if (p.kind == NL_ACK){
-                packet_kind = "NL_ACK\0";
-                break;
-	    }
-            else{
-                packet_kind = "NEITHER\0";
-                break;
-	    }
+    for(int i=0; i < timeout_table_size; i++)
+      for(int w=0; w < NL_MAXWINDOW; w++){
+        p = (NL_PACKET *)timeout[i].pkts[w];
+        if (p == NULL)
+            continue;
+        if (p->kind == NL_DATA)
+            packet_kind = "NL_DATA";
+        else if (p->kind == NL_ACK)
+            packet_kind = "NL_ACK";
+        else if (p->kind == NL_TREE)
+            packet_kind = "NL_TREE";
+        else
+            packet_kind = "NEITHER";
 	printf("\n\t Node name: %s.", nodeinfo.nodename);
     	printf("\n\t Node address: %d.", nodeinfo.address);
     	printf("\n\t count_toobusy = %d", count_toobusy);
         printf("\n\t Table Entry: %d", i);
 	printf("\n\t Packet timer ID = %d", timeout[i].last_timer);
-	printf("\n\t Packet seqno = %d", p.seqno);
-        printf("\n\t Packet source = %d", p.src);
-        printf("\n\t Packet destination = %d", p.dest);
+	printf("\n\t Packet seqno = %d", p->seqno);
+        printf("\n\t Packet source = %d", p->src);
+        printf("\n\t Packet destination = %d", p->dest);
         printf("\n\t Packet kind = %s", packet_kind);
-        printf("\n\t Packet length = %d", p.length);
+        printf("\n\t Packet length = %d", (int)p->length);
+        printf("\n\t Buffer size = %d", (int)pkt_length(timeout[i].pkts[w]));
     }
 }
 
@@ -159,15 +146,125 @@ void DEBUG1_Events()
     Following code transfers from flooding2.c
 
     flood2() IS A BASIC ROUTING STRATEGY WHICH TRANSMITS THE OUTGOING PACKET
-    ON EVERY LINK SPECIFIED IN THE BITMAP NAMED links_wanted.
+    ON EVERY LINK SPECIFIED IN THE LINKSET NAMED links_wanted.
  */
-static void flood2(char *packet, size_t length, int links_wanted)
+static void flood2(char *packet, size_t length, const LINKSET *links_wanted)
 {
-    int	   link;
+    NL_PACKET	*p	= (NL_PACKET *)packet;
+    int		class	= (p->kind == NL_DATA) ? SCHED_DATA : SCHED_CONTROL;
+    int		link;
+
+    /* mark data that will queue behind a congested link */
+    if(class == SCHED_DATA)
+	FOR_EACH_LINK(link, links_wanted)
+	    if(sched_congested(link))
+		p->ecn	= 1;
+
+    FOR_EACH_LINK(link, links_wanted)
+	CHECK(schedule_packet(link, packet, length, p->src, p->dest, class));
+}
 
-    for(link=1 ; link<=nodeinfo.nlinks ; ++link)
-	if( links_wanted & (1<<link) )
-	    CHECK(down_to_datalink(link, packet, length));
+/*  flood_links_except() RETURNS THE LINKS ON WHICH TO FLOOD, LESS ONE (OR
+    NONE IF 0).  ONCE THE SPANNING TREE HAS SETTLED, ONLY ITS EDGES ARE USED.
+ */
+static LINKSET *flood_links_except(int avoid_link)
+{
+    static LINKSET	links	= LINKSET_INIT;
+
+    if(ST_ready())
+	ST_treelinks(&links);
+    else {
+	LS_clear(&links);
+	LS_addall(&links, nodeinfo.nlinks);
+	for(int link=1 ; link<=nodeinfo.nlinks ; ++link)
+	    if(DLL_bonded(link))		/* carried by its bundle */
+		LS_remove(&links, link);
+    }
+    LS_remove(&links, avoid_link);
+    return &links;
+}
+
+/*  only_link() RETURNS THE SET HOLDING JUST THE ONE LINK */
+static LINKSET *only_link(int link)
+{
+    static LINKSET	links	= LINKSET_INIT;
+
+    LS_clear(&links);
+    LS_add(&links, link);
+    return &links;
+}
+
+/*  route_links_except() RETURNS THE BEST KNOWN LINK TOWARDS dest, UNLESS
+    IT IS THE ONE TO AVOID.  AN UNKNOWN DESTINATION IS FLOODED.
+ */
+static LINKSET *route_links_except(CnetAddr dest, int avoid_link)
+{
+    static LINKSET	links	= LINKSET_INIT;
+
+    if(!NL_linksofmincost(dest, &links))
+	return flood_links_except(avoid_link);
+    LS_remove(&links, avoid_link);
+    return &links;
+}
+
+/*  all_links() RETURNS THE SET OF ALL OF THIS NODE'S LINKS */
+static LINKSET *all_links(void)
+{
+    static LINKSET	links	= LINKSET_INIT;
+
+    LS_clear(&links);
+    LS_addall(&links, nodeinfo.nlinks);
+    for(int link=1 ; link<=nodeinfo.nlinks ; ++link)
+	if(DLL_bonded(link))
+	    LS_remove(&links, link);
+    return &links;
+}
+
+/*  send_tree_packet() IS CALLED BY spantree.c TO CARRY A BPDU TO A NEIGHBOUR */
+void send_tree_packet(int link, char *bpdu, size_t length)
+{
+    NL_PACKET	p;
+
+    memset(&p, 0, PACKET_HEADER_SIZE);
+    p.src	= nodeinfo.address;
+    p.kind	= NL_TREE;
+    p.length	= length;
+    memcpy(p.msg, bpdu, length);
+    flood2((char *)&p, PACKET_SIZE(p), only_link(link));
+}
+
+/*  send_NL_ack() IS CALLED BY nl_table.c WHEN A (BATCHED) NL_ACK IS DUE */
+static void send_NL_ack(CnetAddr dest, int link, bool ecn)
+{
+    NL_PACKET	p;
+
+    p.src	= nodeinfo.address;
+    p.dest	= dest;
+    p.kind	= NL_ACK;
+    p.seqno	= NL_packetexpected(dest) - 1;	/* all packets before this */
+    p.hopcount	= 0;
+    p.ecn	= ecn;
+    p.sack	= NL_sackbits(dest);
+    p.retx	= NL_FIRST;
+    p.length	= 0;
+    flood2((char *)&p, PACKET_HEADER_SIZE, only_link(link));
+}
+
+/*  deliver_early() PASSES UP ANY HELD PACKETS THAT ARE NOW IN ORDER */
+static void deliver_early(CnetAddr src)
+{
+    int		e	= find_address_timeout(src);
+    char	*pkt;
+
+    while((pkt = timeout[e].early[NL_packetexpected(src) % NL_MAXWINDOW]) != NULL) {
+	NL_PACKET	*p	= (NL_PACKET *)pkt;
+	size_t		length	= p->length;
+
+	timeout[e].early[NL_packetexpected(src) % NL_MAXWINDOW]	= NULL;
+	CHECK(CNET_write_application(p->msg, &length));
+	inc_NL_packetexpected(src);
+	pkt_release(pkt);
+    }
 }
 
 /*  down_to_network() RECEIVES NEW MESSAGES FROM THE APPLICATION LAYER AND
@@ -179,19 +276,30 @@ static EVENT_HANDLER(down_to_network)
 
     p.length	= sizeof(p.msg);
     CHECK(CNET_read_application(&p.dest, p.msg, &p.length));
-    CHECK(CNET_disable_application(p.dest));
 
     p.src	= nodeinfo.address;
     p.kind	= NL_DATA;
     p.hopcount	= 0;
+    p.ecn	= 0;
+    p.sack	= 0;
+    p.retx	= NL_FIRST;
     p.seqno	= NL_nextpackettosend(p.dest);
 
-    flood2((char *)&p, PACKET_SIZE(p), ALL_LINKS);
-
-    //Add timer
+    //Keep only PACKET_SIZE(p) bytes for retransmission, before flood2 marks p
     timeoutindex = find_address_timeout(p.dest);
-    memmove(&(timeout[timeoutindex].last_pkt), &p, sizeof(NL_PACKET));
-    timeout[timeoutindex].last_timer = CNET_start_timer(EV_TIMER1, 80000000, 0);
+    timeout[timeoutindex].pkts[p.seqno % NL_MAXWINDOW] =
+				pkt_copy(&p, PACKET_SIZE(p));
+
+    flood2((char *)&p, PACKET_SIZE(p), flood_links_except(0));
+
+    //Add timer for the oldest unacknowledged packet
+    if(timeout[timeoutindex].last_timer == TW_NULLTIMER)
+        timeout[timeoutindex].last_timer = tw_start(NL_TIMEOUT, timeout_events,
+						    (CnetData)p.dest);
+
+    //Stop this destination once its congestion window is full
+    if(NL_inflight(p.dest) >= NL_window(p.dest))
+        CHECK(CNET_disable_application(p.dest));
 }
 
 /*  up_to_network() IS CALLED FROM THE DATA LINK LAYER (BELOW) TO ACCEPT
@@ -201,84 +309,152 @@ int up_to_network(char *packet, size_t length, int arrived_on)
 {
     NL_PACKET	*p = (NL_PACKET *)packet;
 
+    if(p->kind == NL_TREE) {		/* BPDUs go no further than here */
+	ST_receive(p->msg, p->length, arrived_on);
+	return(0);
+    }
+
     ++p->hopcount;			/* took 1 hop to get here */
+    NL_savepathcost(p->src, p->hopcount, p->hopcount, arrived_on);
 /*  IS THIS PACKET IS FOR ME? */
     if(p->dest == nodeinfo.address) {
 	switch (p->kind) {
-	case NL_DATA:
-	    if(p->seqno == NL_packetexpected(p->src)) {
-		  CnetAddr	tmpaddr;
+	case NL_DATA: {
+	    int expected = NL_packetexpected(p->src);
 
+	    if(p->seqno == expected) {
 		  length		= p->length;
 		  CHECK(CNET_write_application(p->msg, &length));
 		  inc_NL_packetexpected(p->src);
-
-		  tmpaddr		= p->src; /* swap src and dest addresses */
-		  p->src		= p->dest;
-		  p->dest		= tmpaddr;
-
-		  p->kind		= NL_ACK;
-		  p->hopcount	= 0;
-		  p->length	= 0;
-		  /* send the NL_ACK via the link on which the NL_DATA arrived */
-		  flood2(packet, PACKET_HEADER_SIZE, (1<<arrived_on) );
+		  deliver_early(p->src);
 	    }
+	    /* hold a packet that arrived early, until the gap is filled */
+	    else if(p->seqno > expected && p->seqno < expected + NL_MAXWINDOW) {
+		  index = find_address_timeout(p->src);
+		  if(timeout[index].early[p->seqno % NL_MAXWINDOW] == NULL) {
+		      timeout[index].early[p->seqno % NL_MAXWINDOW] =
+					pkt_copy(packet, length);
+		      NL_outoforder(p->src, p->seqno);
+		  }
+	    }
+	    /* in-order packets are acknowledged in batches, but an early
+	       packet is acknowledged at once, so that a lost packet is
+	       repaired quickly, and a duplicate (our NL_ACK was lost) at most
+	       once per NL_ACKHOLD.  The NL_ACK returns via the link on which
+	       the NL_DATA arrived, and echoes p->ecn */
+	    if(p->seqno < expected)
+		NL_duplicate(p->src, arrived_on);
+	    else
+		NL_ackowed(p->src, arrived_on, p->ecn, p->seqno > expected);
 	    break;
-	case NL_ACK:
-	    if(p->seqno == NL_ackexpected(p->src)) {
-		  inc_NL_ackexpected(p->src);
-		  CHECK(CNET_enable_application(p->src));
+	}
+	case NL_ACK: {
+	    int first	= NL_ackexpected(p->src);
+	    int nacked	= NL_ackreceived(p->src, p->seqno, p->sack);
+
+	    if(p->ecn)
+		  NL_congestion(p->src);
+	    if(nacked > 0) {
           index = find_address_timeout(p->src);
-          CNET_stop_timer(timeout[index].last_timer);
+          for(int s = first; s < first + nacked; s++) {
+              pkt_release(timeout[index].pkts[s % NL_MAXWINDOW]);
+              timeout[index].pkts[s % NL_MAXWINDOW] = NULL;
+          }
+          timeout[index].failures = 0;
+          tw_stop(timeout[index].last_timer);
+          timeout[index].last_timer = (NL_inflight(p->src) > 0) ?
+                tw_start(NL_TIMEOUT, timeout_events, (CnetData)p->src) :
+                TW_NULLTIMER;
 	    }
+	    if(NL_inflight(p->src) < NL_window(p->src))
+		  CHECK(CNET_enable_application(p->src));
+	    break;
+	}
+	default:			/* NL_TREE was handled above */
 	    break;
 	}
     }
 /* THIS PACKET IS FOR SOMEONE ELSE */
     else {
-	   if(p->hopcount < MAXHOPS) 		/* if not too many hops... */
-	    /* retransmit on all links *except* the one on which it arrived */
-	       flood2(packet, length, ALL_LINKS & ~(1<<arrived_on) );
-	   else
+	   if(p->hopcount >= MAXHOPS)		/* if too many hops... */
 	    /* silently drop */;
+	   else if(p->retx == NL_ROUTED || p->retx == NL_MULTI)
+	    /* a retransmission follows our best link to its destination */
+	       flood2(packet, length, route_links_except(p->dest, arrived_on));
+	   else
+	    /* retransmit on all links *except* the one on which it arrived */
+	       flood2(packet, length, flood_links_except(arrived_on));
     }
     return(0);
 }
 /*--------------------------------------------------------------------------------*/
 
-/* Event Handler*/
-EVENT_HANDLER(show_NL_table)
-{
-    DEBUG0_Events();
-}
-
-void reboot_NL_table()
-{
-    CHECK(CNET_set_handler(EV_DEBUG0, show_NL_table, 0));
-    CHECK(CNET_set_debug_string(EV_DEBUG0, "NL info"));
-
-    NL_table		= calloc(1, sizeof(NLTABLE));
-    NL_table_size	= 0;
-}
-
 EVENT_HANDLER(timers_events)
 {
     CNET_clear();
     DEBUG1_Events();
 }
 
-EVENT_HANDLER(timeout_events)
+/* Go-back-N: resend every unacknowledged packet, after halving the window,
+   skipping any that the receiver has selectively acknowledged.  The more
+   consecutive timeouts to this destination, the more widely they are sent */
+static void timeout_events(TW_TIMER timer, CnetData data)
+{
+    CnetAddr dest = (CnetAddr)data;
+    int first = NL_ackexpected(dest);
+    NL_RETX retx;
+    LINKSET *links;
+
+    timeoutindex = find_address_timeout(dest);
+    NL_congestion(dest);
+    timeout[timeoutindex].last_timer = tw_start(NL_TIMEOUT, timeout_events, data);
+
+    int failures = ++timeout[timeoutindex].failures;
+    if(failures <= RETX_ROUTED) {
+        retx = NL_ROUTED;
+        links = route_links_except(dest, 0);
+    }
+    else if(failures <= RETX_ROUTED + RETX_MULTI) {
+        retx = NL_MULTI;
+        links = all_links();
+    }
+    else {
+        retx = NL_FLOODED;
+        links = flood_links_except(0);
+    }
+    for(int s = first; s < first + NL_inflight(dest); s++) {
+        char *pkt = timeout[timeoutindex].pkts[s % NL_MAXWINDOW];
+
+        if(NL_issacked(dest, s))	/* the receiver already holds it */
+            continue;
+        ((NL_PACKET *)pkt)->ecn = 0;
+        ((NL_PACKET *)pkt)->retx = retx;
+        ++timeout[timeoutindex].nretx[retx];
+        flood2(pkt, pkt_length(pkt), links);
+    }
+}
+
+//  RETRANSMISSIONS TO EACH DESTINATION, BY HOW WIDELY THEY WERE SENT
+static void retx_showstats(void)
 {
-    timeoutindex = find_address(timer);
-    NL_PACKET p = timeout[timeoutindex].last_pkt;
-    timeout[timeoutindex].last_timer = CNET_start_timer(EV_TIMER1, 80000000, 0);
-    flood2((char *)&p, PACKET_SIZE(p), ALL_LINKS);
+    printf("\n%11s %8s %8s %8s %8s\n",
+		"destination", "failures", "routed", "multi", "flooded");
+    for(int t=0 ; t<timeout_table_size ; ++t)
+	printf("%11d %8d %8d %8d %8d\n", (int)timeout[t].dest,
+		timeout[t].failures, timeout[t].nretx[NL_ROUTED],
+		timeout[t].nretx[NL_MULTI], timeout[t].nretx[NL_FLOODED]);
 }
 
 EVENT_HANDLER(periodic_events)
 {
-    DEBUG0_Events();
+    NL_showtable();
+    ST_show();
     DEBUG1_Events();
+    sched_showstats();
+    pkt_report();
+    tw_showstats();
+    retx_showstats();
+    DLL_showstats();
 }
 
 
@@ -286,18 +462,18 @@ EVENT_HANDLER(periodic_events)
 
 EVENT_HANDLER(reboot_node)
 {
-    if(nodeinfo.nlinks >= 32) {
-	fprintf(stderr,"flood2 flooding will not work here\n");
-	exit(1);
-    }
     reboot_DLL();
+    reboot_linksched();
     reboot_NL_table();
+    NL_snapshots(getenv("NL_SNAPSHOTS"));	// if nodes may reboot
+    reboot_spantree();
+    reboot_twheel();
+    NL_ackbatching(send_NL_ack);
 
     CHECK(CNET_set_handler(EV_APPLICATIONREADY, down_to_network, 0));
     CNET_enable_application(ALLNODES);
 
     CHECK(CNET_set_handler(EV_PERIODIC, periodic_events, 0));
-    CHECK(CNET_set_handler(EV_TIMER1, timeout_events, 0));
     CHECK(CNET_set_handler(EV_DEBUG1, timers_events, 0));
     CHECK(CNET_set_debug_string( EV_DEBUG1, "TIMERS info"));
 }
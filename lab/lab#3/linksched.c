@@ -0,0 +1,276 @@
+#include <cnet.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "linksched.h"
+#include "dll_basic.h"
+#include "pktpool.h"
+
+/*  THIS FILE PROVIDES A SCHEDULER BETWEEN THE NETWORK LAYER AND
+    down_to_datalink() FOR EACH OUTGOING LINK.  WITHOUT IT, FORWARDED AND
+    LOCALLY GENERATED PACKETS ARE WRITTEN TO A LINK IN WHATEVER ORDER THEY
+    APPEAR, SO ONE CHATTY SOURCE CAN STARVE ALL OTHERS, AND ANY PACKET
+    WRITTEN WHILE THE LINK IS STILL BUSY IS LOST WITH ER_TOOBUSY.
+
+    Each link holds its waiting packets (as pooled buffers) in two classes:
+
+    1) SCHED_CONTROL packets (NL_ACKs and the like) wait in one FIFO queue
+       and are always sent before any data;
+    2) SCHED_DATA packets wait in a queue per (src, dest) flow, and the
+       backlogged flows are served by deficit round robin: each time a
+       flow's turn comes it earns QUANTUM bytes of credit, and may send
+       packets while its credit covers them.  Each flow may hold at most
+       FLOW_QLIMIT packets, so an overloaded flow loses its own packets
+       rather than delaying everyone else's.  As a link may carry a great
+       many flows, all of its data packets together may hold at most
+       LINK_QLIMIT bytes; beyond that, the newest packet of the longest
+       flow is dropped to make room, so a link's memory stays bounded
+       and the flows with the most waiting pay for the overload.
+
+    A packet is only passed to down_to_datalink() once the previous one
+    has left the link or, for a bundle of bonded links, once any of them
+    is free (see DLL_busyfor() in dll_basic.c).
+ */
+
+#define	QUANTUM		2048		// bytes of credit per round
+#define	FLOW_QLIMIT	8		// packets per data flow
+#define	LINK_QLIMIT	(4*MAX_MESSAGE_SIZE)	// bytes of data per link
+#define	CONTROL_QLIMIT	64		// packets in the control class
+#define	ECN_DELAY	500000		// usec of queued data means congested
+
+typedef struct {
+    CnetAddr	src;
+    CnetAddr	dest;
+    char	*pkts[FLOW_QLIMIT];	// circular queue of pooled buffers
+    int		head;
+    int		qlen;
+    size_t	deficit;
+} FLOW;
+
+typedef struct {
+    bool	busy;			// a packet is being transmitted
+    size_t	backlog;		// bytes waiting, in both classes
+    size_t	databacklog;		// ... in the data class
+
+    char	*control[CONTROL_QLIMIT];
+    int		chead;
+    int		clen;
+
+    FLOW	*flows;			// only the backlogged flows, in
+    int		nflows;			// round robin order
+    int		current;
+
+    int		nsent;			// statistics
+    int		ndropped;
+    size_t	maxbacklog;
+} LINKSCHED;
+
+static	LINKSCHED	*sched	= NULL;
+
+// -----------------------------------------------------------------
+
+//  FIND, OR APPEND, THE BACKLOGGED FLOW FOR THIS (src, dest) PAIR
+static FLOW *find_flow(LINKSCHED *ls, CnetAddr src, CnetAddr dest)
+{
+    FLOW	*f;
+
+    for(int i=0 ; i<ls->nflows ; ++i)
+	if(ls->flows[i].src == src && ls->flows[i].dest == dest)
+	    return &ls->flows[i];
+
+    ls->flows	= realloc(ls->flows, (ls->nflows+1)*sizeof(FLOW));
+    f		= &ls->flows[ls->nflows++];
+    memset(f, 0, sizeof(FLOW));
+    f->src	= src;
+    f->dest	= dest;
+    if(ls->nflows == 1)			// sole flow gets the first turn
+	f->deficit	= QUANTUM;
+    return f;
+}
+
+//  A FLOW HAS EMPTIED - REMOVE IT, PASSING THE TURN ON IF IT WAS CURRENT
+static void remove_flow(LINKSCHED *ls, int i)
+{
+    memmove(&ls->flows[i], &ls->flows[i+1],
+		(ls->nflows - i - 1) * sizeof(FLOW));
+    if(--ls->nflows == 0) {
+	ls->current	= 0;
+	return;
+    }
+    if(i < ls->current)
+	--ls->current;
+    else if(i == ls->current) {
+	ls->current	%= ls->nflows;
+	ls->flows[ls->current].deficit	+= QUANTUM;
+    }
+}
+
+/*  MAKE ROOM FOR A NEW DATA PACKET OF length BYTES FOR (src, dest) BY
+    DROPPING THE NEWEST PACKETS OF THE LONGEST FLOWS.  RETURNS false IF
+    THE NEW PACKET'S OWN FLOW WOULD BE THE LONGEST, AND SO IT IS DROPPED.
+ */
+static bool make_room(LINKSCHED *ls, size_t length, CnetAddr src, CnetAddr dest)
+{
+    while(ls->databacklog + length > LINK_QLIMIT) {
+	int	longest	= -1, most = 1;
+	FLOW	*f;
+	char	*buf;
+
+	for(int i=0 ; i<ls->nflows ; ++i)
+	    if(ls->flows[i].src == src && ls->flows[i].dest == dest)
+		most	= ls->flows[i].qlen + 1;
+	for(int i=0 ; i<ls->nflows ; ++i)
+	    if(ls->flows[i].qlen > most) {
+		most	= ls->flows[i].qlen;
+		longest	= i;
+	    }
+	if(longest < 0)
+	    return false;
+
+	f	= &ls->flows[longest];
+	buf	= f->pkts[(f->head + f->qlen - 1) % FLOW_QLIMIT];
+	ls->backlog	-= pkt_length(buf);
+	ls->databacklog	-= pkt_length(buf);
+	++ls->ndropped;
+	pkt_release(buf);
+	if(--f->qlen == 0)
+	    remove_flow(ls, longest);
+    }
+    return true;
+}
+
+//  CHOOSE THE NEXT DATA PACKET BY DEFICIT ROUND ROBIN
+static char *next_data_packet(LINKSCHED *ls)
+{
+    while(ls->nflows > 0) {
+	FLOW	*f	= &ls->flows[ls->current];
+	char	*buf	= f->pkts[f->head];
+	size_t	size	= pkt_length(buf);
+
+	if(f->deficit >= size) {
+	    f->deficit	-= size;
+	    f->head	= (f->head + 1) % FLOW_QLIMIT;
+	    if(--f->qlen == 0)
+		remove_flow(ls, ls->current);
+	    return buf;
+	}
+//  NOT ENOUGH CREDIT - THE NEXT FLOW TAKES ITS TURN AND EARNS A QUANTUM
+	ls->current	= (ls->current + 1) % ls->nflows;
+	ls->flows[ls->current].deficit	+= QUANTUM;
+    }
+    return NULL;
+}
+
+//  IF THERE IS A WAITING PACKET, SEND IT AND TIME ITS TRANSMISSION
+static void transmit_next(int link)
+{
+    LINKSCHED	*ls	= &sched[link];
+    char	*buf;
+    size_t	length;
+
+    if(ls->clen > 0) {
+	buf		= ls->control[ls->chead];
+	ls->chead	= (ls->chead + 1) % CONTROL_QLIMIT;
+	--ls->clen;
+    }
+    else if((buf = next_data_packet(ls)) != NULL)
+	ls->databacklog	-= pkt_length(buf);
+
+    if(buf == NULL) {
+	ls->busy	= false;
+	return;
+    }
+
+    length	= pkt_length(buf);
+    ls->backlog	-= length;
+    ++ls->nsent;
+    CHECK(down_to_datalink(link, buf, length));
+    pkt_release(buf);
+
+    ls->busy	= true;
+    CNET_start_timer(EV_TIMER2, DLL_busyfor(link) + 1, (CnetData)link);
+}
+
+//  EV_TIMER2 - THE PREVIOUS PACKET HAS LEFT THIS LINK
+static EVENT_HANDLER(link_idle)
+{
+    transmit_next((int)data);
+}
+
+// -----------------------------------------------------------------
+
+/*  schedule_packet() IS CALLED BY THE NETWORK LAYER INSTEAD OF
+    down_to_datalink().  IT TAKES A POOLED COPY OF THE PACKET, SO THE
+    CALLER MAY REUSE ITS OWN BUFFER IMMEDIATELY.
+ */
+int schedule_packet(int link, char *packet, size_t length,
+		    CnetAddr src, CnetAddr dest, int class)
+{
+    LINKSCHED	*ls	= &sched[link];
+
+    if(class == SCHED_CONTROL) {
+	if(ls->clen == CONTROL_QLIMIT) {
+	    ++ls->ndropped;
+	    return(0);
+	}
+	ls->control[(ls->chead + ls->clen) % CONTROL_QLIMIT] =
+				pkt_copy(packet, length);
+	++ls->clen;
+    }
+    else {
+	FLOW	*f;
+
+	if(!make_room(ls, length, src, dest)) {
+	    ++ls->ndropped;
+	    return(0);
+	}
+	f	= find_flow(ls, src, dest);
+	if(f->qlen == FLOW_QLIMIT) {
+	    ++ls->ndropped;
+	    return(0);
+	}
+	f->pkts[(f->head + f->qlen) % FLOW_QLIMIT] = pkt_copy(packet, length);
+	++f->qlen;
+	ls->databacklog	+= length;
+    }
+
+    ls->backlog	+= length;
+    if(ls->maxbacklog < ls->backlog)
+	ls->maxbacklog	= ls->backlog;
+    if(!ls->busy)
+	transmit_next(link);
+    return(0);
+}
+
+//  THE NUMBER OF BYTES WAITING TO BE SENT ON THIS LINK
+size_t sched_backlog(int link)
+{
+    return sched[link].backlog;
+}
+
+//  WOULD A NEW PACKET WAIT MORE THAN ECN_DELAY BEFORE BEING SENT?
+bool sched_congested(int link)
+{
+    return ((CnetTime)sched[link].backlog * 8000000) /
+		DLL_bandwidth(link) > ECN_DELAY;
+}
+
+void sched_showstats(void)
+{
+    printf("\n%6s %8s %8s %8s %10s %10s\n",
+		"link", "sent", "dropped", "flows", "backlog", "maxbacklog");
+    for(int link=1 ; link<=nodeinfo.nlinks ; ++link) {
+	LINKSCHED	*ls	= &sched[link];
+
+	printf("%6d %8d %8d %8d %10d %10d\n", link,
+		ls->nsent, ls->ndropped, ls->nflows,
+		(int)ls->backlog, (int)ls->maxbacklog);
+    }
+}
+
+void reboot_linksched(void)
+{
+    sched	= calloc(nodeinfo.nlinks+1, sizeof(LINKSCHED));
+
+    CHECK(CNET_set_handler(EV_TIMER2, link_idle, 0));
+}
@@ -0,0 +1,13 @@
+#include <cnet.h>
+
+/* ------- DECLARATIONS FOR A FAIR SCHEDULER ON EACH OUTGOING LINK ------- */
+
+#define	SCHED_CONTROL	0		// ACKs and control: strict priority
+#define	SCHED_DATA	1		// data: deficit round robin per flow
+
+extern	void	reboot_linksched(void);
+extern	int	schedule_packet(int link, char *packet, size_t length,
+				CnetAddr src, CnetAddr dest, int class);
+extern	size_t	sched_backlog(int link);
+extern	bool	sched_congested(int link);
+extern	void	sched_showstats(void);
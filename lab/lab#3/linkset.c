@@ -0,0 +1,147 @@
+#include <cnet.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "linkset.h"
+
+/*  THIS FILE PROVIDES A SET OF LINK NUMBERS, REPLACING THE EARLIER "TRICK"
+    OF HOLDING A BITMAP OF LINKS IN A SINGLE int (WHICH LIMITED NODES TO
+    AT MOST 32 LINKS).
+
+    Links 0..63 are held in one 64-bit word, so the common case needs no
+    memory allocation at all.  Nodes with more links than that (core
+    routers, LAN-attached hubs) extend the set with further words taken
+    from the heap.  Iteration with LS_next() or FOR_EACH_LINK() skips
+    whole words of unset links, and finds each set link with a single
+    count-trailing-zeros instruction.
+ */
+
+#define	BITS		64
+#define	BIT(n)		((uint64_t)1 << (n))
+#define	CTZ(w)		__builtin_ctzll(w)
+#define	POPCOUNT(w)	__builtin_popcountll(w)
+
+// -----------------------------------------------------------------
+
+//  ENSURE THAT more[] CAN HOLD THE GIVEN LINK NUMBER
+static void grow(LINKSET *set, int link)
+{
+    int	need	= (link - BITS) / BITS + 1;
+
+    if(need > set->nmore) {
+	set->more	= realloc(set->more, need * sizeof(uint64_t));
+	memset(&set->more[set->nmore], 0, (need-set->nmore)*sizeof(uint64_t));
+	set->nmore	= need;
+    }
+}
+
+//  EMPTY THE SET, BUT KEEP ANY more[] WORDS FOR REUSE
+void LS_clear(LINKSET *set)
+{
+    set->word	= 0;
+    if(set->nmore > 0)
+	memset(set->more, 0, set->nmore * sizeof(uint64_t));
+}
+
+void LS_free(LINKSET *set)
+{
+    free(set->more);
+    set->word	= 0;
+    set->more	= NULL;
+    set->nmore	= 0;
+}
+
+void LS_add(LINKSET *set, int link)
+{
+    if(link < BITS)
+	set->word	|= BIT(link);
+    else {
+	grow(set, link);
+	set->more[(link-BITS) / BITS]	|= BIT((link-BITS) % BITS);
+    }
+}
+
+void LS_remove(LINKSET *set, int link)
+{
+    if(link < BITS)
+	set->word	&= ~BIT(link);
+    else if((link-BITS) / BITS < set->nmore)
+	set->more[(link-BITS) / BITS]	&= ~BIT((link-BITS) % BITS);
+}
+
+//  ADD ALL OF LINKS 1..nlinks (BUT NEVER THE LOOPBACK LINK, 0)
+void LS_addall(LINKSET *set, int nlinks)
+{
+    if(nlinks < BITS-1)
+	set->word	|= (BIT(nlinks+1) - 1) & ~BIT(0);
+    else {
+	set->word	|= ~BIT(0);
+	if(nlinks < BITS)
+	    return;
+	grow(set, nlinks);
+	for(int w=0 ; w < (nlinks-BITS) / BITS ; ++w)
+	    set->more[w]	= ~(uint64_t)0;
+	set->more[(nlinks-BITS) / BITS]	|=
+			(BIT((nlinks-BITS) % BITS) << 1) - 1;
+    }
+}
+
+void LS_copy(LINKSET *to, const LINKSET *from)
+{
+    LS_clear(to);
+    to->word	= from->word;
+    if(from->nmore > 0) {
+	grow(to, BITS * from->nmore + BITS - 1);
+	memcpy(to->more, from->more, from->nmore * sizeof(uint64_t));
+    }
+}
+
+bool LS_contains(const LINKSET *set, int link)
+{
+    if(link < BITS)
+	return (set->word & BIT(link)) != 0;
+    if((link-BITS) / BITS >= set->nmore)
+	return false;
+    return (set->more[(link-BITS) / BITS] & BIT((link-BITS) % BITS)) != 0;
+}
+
+bool LS_isempty(const LINKSET *set)
+{
+    if(set->word != 0)
+	return false;
+    for(int w=0 ; w<set->nmore ; ++w)
+	if(set->more[w] != 0)
+	    return false;
+    return true;
+}
+
+int LS_count(const LINKSET *set)
+{
+    int	n	= POPCOUNT(set->word);
+
+    for(int w=0 ; w<set->nmore ; ++w)
+	n	+= POPCOUNT(set->more[w]);
+    return n;
+}
+
+//  RETURN THE SMALLEST LINK IN THE SET GREATER THAN link, OR 0 IF NONE
+int LS_next(const LINKSET *set, int link)
+{
+    int		from	= link + 1;
+    uint64_t	w;
+
+    if(from < BITS) {
+	w	= set->word & (~(uint64_t)0 << from);
+	if(w != 0)
+	    return CTZ(w);
+	from	= BITS;
+    }
+    for(int i=(from-BITS) / BITS ; i<set->nmore ; ++i) {
+	w	= set->more[i];
+	if(i == (from-BITS) / BITS)
+	    w	&= ~(uint64_t)0 << ((from-BITS) % BITS);
+	if(w != 0)
+	    return BITS + i*BITS + CTZ(w);
+    }
+    return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef LINKSET_H
+#define LINKSET_H
+
+#include <cnet.h>
+#include <stdint.h>
+
+/* ------- DECLARATIONS FOR A SET OF LINK NUMBERS OF ANY SIZE -------- */
+
+//  LINKS 0..63 LIVE IN A SINGLE WORD; ONLY NODES WITH MORE LINKS THAN
+//  THAT NEED THE (HEAP ALLOCATED) WORDS IN more[].
+typedef struct {
+    uint64_t	word;
+    uint64_t	*more;
+    int		nmore;
+} LINKSET;
+
+#define	LINKSET_INIT	{ 0, NULL, 0 }
+
+//  VISIT EACH LINK IN THE SET, IN INCREASING ORDER, SKIPPING UNSET LINKS
+#define	FOR_EACH_LINK(link, set)	\
+	for(link = LS_next(set, 0) ; link > 0 ; link = LS_next(set, link))
+
+extern	void	LS_clear(LINKSET *set);
+extern	void	LS_free(LINKSET *set);
+extern	void	LS_add(LINKSET *set, int link);
+extern	void	LS_remove(LINKSET *set, int link);
+extern	void	LS_addall(LINKSET *set, int nlinks);
+extern	void	LS_copy(LINKSET *to, const LINKSET *from);
+
+extern	bool	LS_contains(const LINKSET *set, int link);
+extern	bool	LS_isempty(const LINKSET *set);
+extern	int	LS_count(const LINKSET *set);
+extern	int	LS_next(const LINKSET *set, int link);
+
+#endif
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "topology.h"
+#include "routefile.h"
+
+/*  mkroutes READS A cnet TOPOLOGY FILE, COMPUTES THE SHORTEST PATHS BETWEEN
+    ALL PAIRS OF NODES, AND WRITES EACH NODE'S NEXT-HOP LINK FOR EVERY
+    DESTINATION ADDRESS TO A COMPACT BINARY FILE (SEE routefile.h).
+
+    Usage:	mkroutes [-h] [-o outfile] topologyfile
+
+    The cost of each link is the time to send a COST_BYTES packet over it -
+    its transmission time plus its propagation delay - or, with -h, simply
+    one hop.  Paths are found with the Floyd-Warshall algorithm.
+
+    Setting the environment variable NL_ROUTES to the name of the output
+    file, before running cnet, lets flooding3.c route every packet on its
+    best path from the very start of the simulation:
+
+	mkroutes -o WORLD.routes WORLD
+	NL_ROUTES=WORLD.routes cnet WORLD
+ */
+
+#define	COST_BYTES	1024
+#define	INFINITE	(1e30)
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [-h] [-o outfile] topologyfile\n", argv0);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    TOPOLOGY	topo;
+    const char	*outfile	= "routes.bin";
+    int		hopsonly	= 0;
+    int		opt, N;
+    double	*cost;
+    uint16_t	*nexthop;		// [from*N + to] = link at from
+    uint32_t	maxaddress	= 0;
+    FILE	*fp;
+    ROUTEHEADER	hdr;
+
+    while((opt = getopt(argc, argv, "ho:")) != -1) {
+	switch (opt) {
+	case 'h' :	hopsonly	= 1;		break;
+	case 'o' :	outfile		= optarg;	break;
+	default :	usage(argv[0]);
+	}
+    }
+    if(optind != argc-1)
+	usage(argv[0]);
+    if(topo_read(argv[optind], &topo) != 0)
+	exit(EXIT_FAILURE);
+
+    N		= topo.nnodes;
+    cost	= malloc((size_t)N * N * sizeof(double));
+    nexthop	= calloc((size_t)N * N, sizeof(uint16_t));
+
+//  START WITH THE DIRECT LINKS (KEEPING THE CHEAPER OF ANY PARALLEL LINKS)
+    for(int i=0 ; i<N*N ; ++i)
+	cost[i]	= INFINITE;
+    for(int i=0 ; i<N ; ++i)
+	cost[i*N + i]	= 0.0;
+    for(int l=0 ; l<topo.nlinks ; ++l) {
+	TOPOLINK	*tl	= &topo.links[l];
+	double		c;
+
+	c	= hopsonly ? 1.0 :
+		  (double)COST_BYTES * 8000000 / tl->bandwidth + tl->delay;
+	if(c < cost[tl->from*N + tl->to]) {
+	    cost[tl->from*N + tl->to]		= c;
+	    cost[tl->to*N + tl->from]		= c;
+	    nexthop[tl->from*N + tl->to]	= tl->fromlink;
+	    nexthop[tl->to*N + tl->from]	= tl->tolink;
+	}
+    }
+
+//  FLOYD-WARSHALL - A PATH VIA k KEEPS THE FIRST LINK OF THE PATH TO k
+    for(int k=0 ; k<N ; ++k)
+	for(int i=0 ; i<N ; ++i) {
+	    if(cost[i*N + k] >= INFINITE)
+		continue;
+	    for(int j=0 ; j<N ; ++j)
+		if(cost[i*N + k] + cost[k*N + j] < cost[i*N + j]) {
+		    cost[i*N + j]	= cost[i*N + k] + cost[k*N + j];
+		    nexthop[i*N + j]	= nexthop[i*N + k];
+		}
+	}
+
+    for(int n=0 ; n<N ; ++n)
+	if((uint32_t)topo.nodes[n].address > maxaddress)
+	    maxaddress	= topo.nodes[n].address;
+
+    if((fp = fopen(outfile, "wb")) == NULL) {
+	perror(outfile);
+	exit(EXIT_FAILURE);
+    }
+    memcpy(hdr.magic, ROUTE_MAGIC, sizeof(hdr.magic));
+    hdr.version		= ROUTE_VERSION;
+    hdr.nnodes		= N;
+    hdr.maxaddress	= maxaddress;
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+
+    for(int i=0 ; i<N ; ++i) {
+	ROUTENODE	rn;
+	uint16_t	*row	= calloc(maxaddress+1, sizeof(uint16_t));
+
+	memset(&rn, 0, sizeof(rn));
+	snprintf(rn.name, sizeof(rn.name), "%s", topo.nodes[i].name);
+	rn.address	= topo.nodes[i].address;
+	for(int j=0 ; j<N ; ++j)
+	    row[topo.nodes[j].address]	= nexthop[i*N + j];
+	fwrite(&rn, sizeof(rn), 1, fp);
+	fwrite(row, sizeof(uint16_t), maxaddress+1, fp);
+	free(row);
+    }
+    if(fclose(fp) != 0) {
+	perror(outfile);
+	exit(EXIT_FAILURE);
+    }
+
+    printf("%s: %d nodes, %d links, routes written to %s\n",
+		argv[optind], N, topo.nlinks, outfile);
+    free(cost);
+    free(nexthop);
+    topo_free(&topo);
+    return 0;
+}
@@ -0,0 +1,471 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "topology.h"
+
+/*  mktopo WRITES A cnet TOPOLOGY FILE, IN THE FORMAT OF N10, N15 AND N20,
+    OF A RANDOM NETWORK OF ANY SIZE, SO THAT THE ROUTING PROTOCOLS MAY BE
+    RUN ON NETWORKS FAR LARGER THAN WORLD.
+
+    Usage:	mktopo [-m model] [-n nodes] [-d degree] [-S seed]
+		       [-b bandwidth] [-p delay] [-l loss]
+		       [-c "sources"] [-o outfile]
+
+    The models are:
+
+	geometric	nodes placed at random, each linked to every node
+			within the distance that gives the mean degree
+	waxman		nodes placed at random, each pair linked with a
+			probability falling exponentially with their distance
+	grid		a square grid, each node linked to those beside it
+			(the degree is ignored)
+	scalefree	each node, in turn, linked to degree/2 earlier nodes
+			(on average), each chosen in proportion to its degree
+			(the Barabasi-Albert model)
+
+    Nodes are placed 100 units apart, on average, and a network that is
+    not connected has each of its smaller parts joined to the largest by
+    their closest pair of nodes.  Each link's bandwidth, propagation delay
+    and probframeloss are drawn from their distribution, which is one of:
+
+	VALUE		for every link, e.g. 56Kbps or 10ms
+	LOW:HIGH	uniformly between the two
+	exp:MEAN	exponentially, with the mean
+	dist:VALUE	VALUE for every 100 units of the link's length
+
+    A distribution of one value is written as the WAN default, and the
+    others with each link.  By default every link is as N20's, so
+
+	mktopo -m waxman -n 1000 -p 10ms:200ms -o W1000
+
+    writes 1000 nodes with links of 56Kbps, delayed by 10 to 200ms.
+ */
+
+#define	SPACING		100		// mean distance between neighbours
+#define	WAXMAN_ALPHA	0.15		// the Waxman model's link length
+
+typedef enum { D_CONSTANT, D_UNIFORM, D_EXPONENTIAL, D_DISTANCE } DISTKIND;
+
+typedef struct {
+    DISTKIND	kind;
+    double	a, b;			// the value, range, mean or unit
+} DIST;
+
+typedef struct {
+    int		from, to;
+    int64_t	bandwidth, delay;
+    int		loss;
+} EDGE;
+
+typedef struct {
+    int		x, y;
+    int		*edges;			// indices in edges[], in link order
+    int		nedges;
+} VERTEX;
+
+static	VERTEX	*vertices;
+static	int	nvertices;
+static	EDGE	*edges		= NULL;
+static	int	nedges		= 0;
+
+// -----------------------------------------------------------------
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [-m geometric|waxman|grid|scalefree] "
+		    "[-n nodes] [-d degree] [-S seed]\n"
+		    "\t[-b bandwidth] [-p delay] [-l loss] "
+		    "[-c \"sources\"] [-o outfile]\n", argv0);
+    exit(EXIT_FAILURE);
+}
+
+static int64_t parse_loss(const char *value)
+{
+    return atoll(value);
+}
+
+//  PARSE A DISTRIBUTION, WITH ITS VALUES IN THE UNITS THAT parse READS
+static DIST parse_dist(const char *arg, int64_t (*parse)(const char *),
+		       const char *argv0)
+{
+    DIST	d;
+    const char	*colon	= strchr(arg, ':');
+
+    memset(&d, 0, sizeof(d));
+    if(colon == NULL) {
+	d.kind	= D_CONSTANT;
+	d.a	= parse(arg);
+    }
+    else if(strncmp(arg, "exp:", 4) == 0) {
+	d.kind	= D_EXPONENTIAL;
+	d.a	= parse(colon+1);
+    }
+    else if(strncmp(arg, "dist:", 5) == 0) {
+	d.kind	= D_DISTANCE;
+	d.a	= parse(colon+1);
+    }
+    else {
+	d.kind	= D_UNIFORM;
+	d.a	= parse(arg);
+	d.b	= parse(colon+1);
+	if(d.b < d.a)
+	    usage(argv0);
+    }
+    return d;
+}
+
+static int64_t draw(const DIST *d, double length)
+{
+    switch (d->kind) {
+    case D_UNIFORM :	return llround(d->a + drand48() * (d->b - d->a));
+    case D_EXPONENTIAL:	return llround(-d->a * log(1.0 - drand48()));
+    case D_DISTANCE :	return llround(d->a * length / SPACING);
+    default :		return llround(d->a);
+    }
+}
+
+static double distance(int a, int b)
+{
+    double	dx	= vertices[a].x - vertices[b].x;
+    double	dy	= vertices[a].y - vertices[b].y;
+
+    return sqrt(dx*dx + dy*dy);
+}
+
+static void add_edge(int from, int to)
+{
+    VERTEX	*v;
+
+    edges	= realloc(edges, (nedges+1) * sizeof(EDGE));
+    memset(&edges[nedges], 0, sizeof(EDGE));
+    edges[nedges].from	= from;
+    edges[nedges].to	= to;
+
+    v		= &vertices[from];
+    v->edges	= realloc(v->edges, (v->nedges+1) * sizeof(int));
+    v->edges[v->nedges++]	= nedges;
+    v		= &vertices[to];
+    v->edges	= realloc(v->edges, (v->nedges+1) * sizeof(int));
+    v->edges[v->nedges++]	= nedges;
+    ++nedges;
+}
+
+static int linked(int a, int b)
+{
+    for(int e=0 ; e<vertices[a].nedges ; ++e) {
+	EDGE	*ep	= &edges[vertices[a].edges[e]];
+
+	if(ep->from == b || ep->to == b)
+	    return 1;
+    }
+    return 0;
+}
+
+static void place_randomly(void)
+{
+    int		side	= (int)(SPACING * sqrt(nvertices));
+
+    for(int n=0 ; n<nvertices ; ++n) {
+	vertices[n].x	= SPACING/2 + (int)(drand48() * side);
+	vertices[n].y	= SPACING/2 + (int)(drand48() * side);
+    }
+}
+
+// -----------------------------------------------------------------
+
+//  THE NUMBER OF PAIRS WITHIN radius OF EACH OTHER
+static long count_within(double radius)
+{
+    long	count	= 0;
+
+    for(int a=0 ; a<nvertices ; ++a)
+	for(int b=a+1 ; b<nvertices ; ++b)
+	    if(distance(a, b) <= radius)
+		++count;
+    return count;
+}
+
+//  FIND THE RADIUS GIVING degree, BY BISECTION, AND LINK ALL WITHIN IT
+static void geometric(double degree)
+{
+    long	wanted	= (long)(nvertices * degree / 2);
+    double	lo	= 0.0;
+    double	hi	= 2.0 * SPACING * sqrt(nvertices);
+
+    place_randomly();
+    for(int i=0 ; i<40 && hi-lo > 0.5 ; ++i) {
+	double	mid	= (lo + hi) / 2;
+
+	if(count_within(mid) < wanted)
+	    lo	= mid;
+	else
+	    hi	= mid;
+    }
+    for(int a=0 ; a<nvertices ; ++a)
+	for(int b=a+1 ; b<nvertices ; ++b)
+	    if(distance(a, b) <= hi)
+		add_edge(a, b);
+}
+
+//  LINK a AND b WITH PROBABILITY beta * exp(-d / (alpha * L)), WHERE L IS
+//  THE LONGEST DISTANCE, AND beta IS CHOSEN TO GIVE THE MEAN degree
+static void waxman(double degree)
+{
+    double	L	= SPACING * sqrt(2.0 * nvertices);
+    double	sum	= 0.0, beta;
+
+    place_randomly();
+    for(int a=0 ; a<nvertices ; ++a)
+	for(int b=a+1 ; b<nvertices ; ++b)
+	    sum	+= exp(-distance(a, b) / (WAXMAN_ALPHA * L));
+    beta	= (nvertices * degree / 2) / sum;
+    if(beta > 1.0)
+	beta	= 1.0;
+    for(int a=0 ; a<nvertices ; ++a)
+	for(int b=a+1 ; b<nvertices ; ++b)
+	    if(drand48() < beta * exp(-distance(a, b) / (WAXMAN_ALPHA * L)))
+		add_edge(a, b);
+}
+
+static void grid(void)
+{
+    int		cols	= (int)ceil(sqrt(nvertices));
+
+    for(int n=0 ; n<nvertices ; ++n) {
+	vertices[n].x	= SPACING/2 + (n % cols) * SPACING;
+	vertices[n].y	= SPACING/2 + (n / cols) * SPACING;
+	if(n % cols > 0)
+	    add_edge(n-1, n);
+	if(n >= cols)
+	    add_edge(n-cols, n);
+    }
+}
+
+//  EACH NEW NODE PICKS AN END OF AN EXISTING LINK AT RANDOM, SO PICKS
+//  EACH EARLIER NODE IN PROPORTION TO ITS DEGREE
+static void scalefree(double degree)
+{
+    int		m	= (int)ceil(degree / 2);
+    int		*ends	= malloc(2 * (size_t)nvertices * m * sizeof(int));
+    int		nends	= 0;
+
+    place_randomly();
+    for(int n=1 ; n<nvertices ; ++n) {
+	int	want	= (int)(degree / 2 + drand48());	// on average
+
+	if(want < 1)
+	    want	= 1;
+	if(want > n)
+	    want	= n;
+
+	for(int k=0 ; k<want ; ++k) {
+	    int	to;
+
+	    do {
+		to	= (nends == 0) ? 0 : ends[(int)(drand48() * nends)];
+	    } while(linked(n, to));
+	    add_edge(n, to);
+	    ends[nends++]	= n;
+	    ends[nends++]	= to;
+	}
+    }
+    free(ends);
+}
+
+//  JOIN EACH SMALLER COMPONENT TO THE LARGEST, BY THEIR CLOSEST PAIR
+static int find(int *parent, int n)
+{
+    while(parent[n] != n)
+	n	= parent[n]	= parent[parent[n]];
+    return n;
+}
+
+static void connect(void)
+{
+    int		*parent	= malloc(nvertices * sizeof(int));
+    int		*size	= calloc(nvertices, sizeof(int));
+    int		*best	= malloc(nvertices * sizeof(int));	// by root
+    int		*with	= malloc(nvertices * sizeof(int));
+    double	*dist	= malloc(nvertices * sizeof(double));
+    int		largest	= 0;
+
+    for(int n=0 ; n<nvertices ; ++n) {
+	parent[n]	= n;
+	best[n]		= -1;
+    }
+    for(int e=0 ; e<nedges ; ++e)
+	parent[find(parent, edges[e].from)]	= find(parent, edges[e].to);
+    for(int n=0 ; n<nvertices ; ++n)
+	if(++size[find(parent, n)] > size[largest])
+	    largest	= find(parent, n);
+
+    for(int a=0 ; a<nvertices ; ++a) {
+	int	ra	= find(parent, a);
+
+	if(ra == largest)
+	    continue;
+	for(int b=0 ; b<nvertices ; ++b)
+	    if(find(parent, b) == largest &&
+	      (best[ra] < 0 || distance(a, b) < dist[ra])) {
+		best[ra]	= a;
+		with[ra]	= b;
+		dist[ra]	= distance(a, b);
+	    }
+    }
+    for(int r=0 ; r<nvertices ; ++r)
+	if(best[r] >= 0)
+	    add_edge(best[r], with[r]);
+    free(parent);
+    free(size);
+    free(best);
+    free(with);
+    free(dist);
+}
+
+// -----------------------------------------------------------------
+
+//  WRITE THE ATTRIBUTES WHOSE DISTRIBUTIONS ARE (OR ARE NOT) CONSTANT
+static void write_link_attrs(FILE *fp, const char *indent, const char *prefix,
+			     const EDGE *e, const DIST *bw, const DIST *delay,
+			     const DIST *loss, int constant)
+{
+    int		pad	= constant ? 20 : 0;	// as N20's defaults
+
+    if((bw->kind == D_CONSTANT) == constant)
+	fprintf(fp, "%s%s%-*s = %lldbps\n", indent, prefix,
+		pad, "bandwidth", (long long)e->bandwidth);
+    if((delay->kind == D_CONSTANT) == constant)
+	fprintf(fp, "%s%s%-*s = %lldusec\n", indent, prefix,
+		pad, "propagationdelay", (long long)e->delay);
+    if((loss->kind == D_CONSTANT) == constant)
+	fprintf(fp, "%s%s%-*s = %d\n", indent, prefix,
+		pad, "probframeloss", e->loss);
+}
+
+static void write_topology(FILE *fp, const char *sources,
+			   const DIST *bw, const DIST *delay, const DIST *loss)
+{
+    int		width	= 1;
+    EDGE	dflt;
+
+    for(int n=nvertices-1 ; n>=10 ; n/=10)
+	++width;
+
+    memset(&dflt, 0, sizeof(dflt));
+    dflt.bandwidth	= llround(bw->a);
+    dflt.delay		= llround(delay->a);
+    dflt.loss		= (int)loss->a;
+
+    fprintf(fp, "/* global attributes */\n\n");
+    fprintf(fp, "/* default node attributes */\n");
+    fprintf(fp, "compile                  = \"%s\"\n", sources);
+    fprintf(fp, "rebootfunc               = \"reboot_node\"\n");
+    fprintf(fp, "nodemtbf                 = 0usec\t\t/* will not fail */\n");
+    fprintf(fp, "nodemttr                 = 0usec\t\t/* instant repair */\n");
+    fprintf(fp, "messagerate              = 1000000usec\n");
+    fprintf(fp, "minmessagesize           = 48bytes\n");
+    fprintf(fp, "maxmessagesize           = 32768bytes\n\n");
+
+    fprintf(fp, "/* default WAN attributes */\n");
+    write_link_attrs(fp, "", "wan-", &dflt, bw, delay, loss, 1);
+    fprintf(fp, "wan-mtu                  = 33792bytes\n");
+    fprintf(fp, "wan-jitter               = 0usec\n");
+    fprintf(fp, "wan-linkmtbf             = 0usec\t\t/* will not fail */\n");
+    fprintf(fp, "wan-linkmttr             = 0usec\t\t/* instant repair */\n");
+    fprintf(fp, "wan-costperbyte          = 0\n");
+    fprintf(fp, "wan-costperframe         = 0\n");
+    fprintf(fp, "wan-probframecorrupt     = 0\n");
+
+    for(int n=0 ; n<nvertices ; ++n) {
+	VERTEX	*v	= &vertices[n];
+
+	fprintf(fp, "\nhost host%0*d {\n    x=%d, y=%d\n\n", width, n, v->x, v->y);
+	for(int l=0 ; l<v->nedges ; ++l) {
+	    EDGE	*e	= &edges[v->edges[l]];
+
+	    fprintf(fp, "    wan to host%0*d {\t/* wan%d */\n",
+			width, (e->from == n) ? e->to : e->from, l);
+	    write_link_attrs(fp, "\t", "", e, bw, delay, loss, 0);
+	    fprintf(fp, "    }\n");
+	}
+	fprintf(fp, "}\n");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char	*model		= "waxman";
+    const char	*outfile	= NULL;
+    const char	*sources	= "flooding3.c dll_basic.c nl_table.c "
+				  "linkset.c linksched.c pktpool.c spantree.c "
+				  "srcroute.c";
+    double	degree		= 3.0;
+    long	seed		= 1;
+    DIST	bw, delay, loss;
+    FILE	*fp		= stdout;
+    int		opt;
+
+    nvertices	= 100;
+    bw		= parse_dist("56000bps", topo_bps, argv[0]);
+    delay	= parse_dist("100000usec", topo_usecs, argv[0]);
+    loss	= parse_dist("0", parse_loss, argv[0]);
+
+    while((opt = getopt(argc, argv, "b:c:d:l:m:n:o:p:S:")) != -1) {
+	switch (opt) {
+	case 'b' :	bw	= parse_dist(optarg, topo_bps, argv[0]);   break;
+	case 'c' :	sources		= optarg;			   break;
+	case 'd' :	degree		= atof(optarg);			   break;
+	case 'l' :	loss	= parse_dist(optarg, parse_loss, argv[0]); break;
+	case 'm' :	model		= optarg;			   break;
+	case 'n' :	nvertices	= atoi(optarg);			   break;
+	case 'o' :	outfile		= optarg;			   break;
+	case 'p' :	delay	= parse_dist(optarg, topo_usecs, argv[0]); break;
+	case 'S' :	seed		= atol(optarg);			   break;
+	default :	usage(argv[0]);
+	}
+    }
+    if(optind != argc || nvertices < 2 || degree <= 0)
+	usage(argv[0]);
+
+    srand48(seed);
+    vertices	= calloc(nvertices, sizeof(VERTEX));
+    if(strcmp(model, "geometric") == 0)
+	geometric(degree);
+    else if(strcmp(model, "waxman") == 0)
+	waxman(degree);
+    else if(strcmp(model, "grid") == 0)
+	grid();
+    else if(strcmp(model, "scalefree") == 0)
+	scalefree(degree);
+    else
+	usage(argv[0]);
+    connect();
+
+    for(int e=0 ; e<nedges ; ++e) {
+	double	length	= distance(edges[e].from, edges[e].to);
+
+	edges[e].bandwidth	= draw(&bw, length);
+	edges[e].delay		= draw(&delay, length);
+	edges[e].loss		= (int)draw(&loss, length);
+	if(edges[e].bandwidth < 1)
+	    edges[e].bandwidth	= 1;
+	if(edges[e].delay < 1)			// cnetsim's lookahead needs one
+	    edges[e].delay	= 1;
+    }
+
+    if(outfile != NULL && (fp = fopen(outfile, "w")) == NULL) {
+	perror(outfile);
+	exit(EXIT_FAILURE);
+    }
+    write_topology(fp, sources, &bw, &delay, &loss);
+    if(fp != stdout && fclose(fp) != 0) {
+	perror(outfile);
+	exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "%s: %d nodes, %d links, mean degree %.2f\n",
+		model, nvertices, nedges, 2.0 * nedges / nvertices);
+    return 0;
+}
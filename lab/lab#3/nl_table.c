@@ -2,8 +2,13 @@
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "nl_table.h"
+#include "routefile.h"
 
 // ---- A SIMPLE NETWORK LAYER SEQUENCE TABLE AS AN ABSTRACT DATA TYPE ----
 
@@ -13,8 +18,22 @@ typedef struct {
     int		nextpackettosend;
     int		packetexpected;
 
-    int		minhops;		// minimum known hops to remote node
-    int		minhop_link;		// link via which minhops path observed
+    double	cwnd;			// congestion window, in packets
+    int		recover;		// no decrease until acked beyond this
+    unsigned int sacked;		// bit i: ackexpected+1+i was acked
+
+    unsigned int received;		// bit i: packetexpected+1+i arrived
+    int		ackowed;		// packets accepted, but not yet acked
+    int		acklink;		// link on which to return our ACK
+    bool	ackecn;			// congestion mark to be echoed
+    CnetTimerID	acktimer;		// holding ACKs for this node
+    CnetTime	dupacked;		// when a duplicate was last acked at once
+
+    int		mincost;		// least known path cost to remote node
+    int		hops;			// ... and the hops on that path
+    int		best_link;		// link via which mincost path observed
+    CnetTime	updated;		// when that path was last observed
+    int		*linkhops;		// fewest hops seen via each link, or 0
 } NLTABLE;
 
 static	NLTABLE	*NL_table	= NULL;
@@ -34,7 +53,10 @@ static int find_address(CnetAddr address)
     NL_table	= realloc(NL_table, (NL_table_size+1)*sizeof(NLTABLE));
     memset(&NL_table[NL_table_size], 0, sizeof(NLTABLE));
     NL_table[NL_table_size].address	= address;
-    NL_table[NL_table_size].minhops	= INT_MAX;
+    NL_table[NL_table_size].cwnd	= 1.0;
+    NL_table[NL_table_size].mincost	= INT_MAX;
+    NL_table[NL_table_size].acktimer	= NULLTIMER;
+    NL_table[NL_table_size].dupacked	= -NL_ACKHOLD;
     return NL_table_size++;
 }
 
@@ -61,6 +83,465 @@ int NL_packetexpected(CnetAddr address) {
 void inc_NL_packetexpected(CnetAddr address) {
     int	t	= find_address(address);
     NL_table[t].packetexpected++;
+    NL_table[t].received	>>= 1;
+}
+
+// -----------------------------------------------------------------
+
+/*  A SIMPLE AIMD CONGESTION WINDOW IS KEPT FOR EACH REMOTE NODE.  THE WINDOW
+    GROWS BY ONE PACKET FOR EACH WINDOW'S WORTH OF ACKNOWLEDGED PACKETS
+    (ADDITIVE INCREASE), AND IS HALVED ON A RETRANSMISSION TIMEOUT OR AN
+    ECHOED CONGESTION MARK (MULTIPLICATIVE DECREASE).  THE WINDOW IS
+    DECREASED AT MOST ONCE FOR EACH WINDOW OF PACKETS IN FLIGHT.
+ */
+
+//  ACCEPT A CUMULATIVE ACK OF ALL PACKETS UP TO AND INCLUDING seqno, AND A
+//  SELECTIVE ACK OF seqno+2+i FOR EACH BIT i SET IN sack.
+//  RETURN THE NUMBER OF PACKETS NEWLY (CUMULATIVELY) ACKNOWLEDGED
+int NL_ackreceived(CnetAddr address, int seqno, unsigned int sack)
+{
+    int	t	= find_address(address);
+    int	n	= 0;
+    int	shift;
+
+    if(seqno >= NL_table[t].ackexpected && seqno < NL_table[t].nextpackettosend) {
+	n			= seqno + 1 - NL_table[t].ackexpected;
+	NL_table[t].ackexpected	= seqno + 1;
+	NL_table[t].sacked	= (n < NL_SACKBITS) ? NL_table[t].sacked >> n : 0;
+	for(int i=0 ; i<n ; ++i)
+	    NL_table[t].cwnd	+= 1.0 / NL_table[t].cwnd;
+	if(NL_table[t].cwnd > NL_MAXWINDOW)
+	    NL_table[t].cwnd	= NL_MAXWINDOW;
+    }
+
+//  REBASE THE SELECTIVE BITS FROM seqno+2 TO OUR ackexpected+1
+    shift	= NL_table[t].ackexpected - (seqno + 1);
+    if(shift >= 0 && shift < NL_SACKBITS)
+	NL_table[t].sacked	|= sack >> shift;
+    return n;
+}
+
+//  HAS THIS UNACKNOWLEDGED PACKET BEEN SELECTIVELY ACKNOWLEDGED?
+bool NL_issacked(CnetAddr address, int seqno)
+{
+    int	t	= find_address(address);
+    int	bit	= seqno - (NL_table[t].ackexpected + 1);
+
+    return bit >= 0 && bit < NL_SACKBITS &&
+	   (NL_table[t].sacked & (1U << bit)) != 0;
+}
+
+//  THE NUMBER OF PACKETS SENT BUT NOT YET ACKNOWLEDGED
+int NL_inflight(CnetAddr address) {
+    int	t	= find_address(address);
+    return NL_table[t].nextpackettosend - NL_table[t].ackexpected;
+}
+
+//  THE NUMBER OF PACKETS WE MAY HAVE IN FLIGHT
+int NL_window(CnetAddr address) {
+    int	t	= find_address(address);
+    return (int)NL_table[t].cwnd;
+}
+
+void NL_congestion(CnetAddr address)
+{
+    int	t	= find_address(address);
+
+    if(NL_table[t].ackexpected < NL_table[t].recover)
+	return;					// already decreased this window
+    NL_table[t].cwnd	/= 2.0;
+    if(NL_table[t].cwnd < 1.0)
+	NL_table[t].cwnd	= 1.0;
+    NL_table[t].recover	= NL_table[t].nextpackettosend;
+}
+
+// -----------------------------------------------------------------
+
+/*  RATHER THAN RETURNING AN NL_ACK FOR EVERY NL_DATA PACKET, A RECEIVER
+    HOLDS ITS ACKS TO EACH SOURCE FOR UP TO NL_ACKHOLD usecs, OR UNTIL
+    NL_ACKBATCH PACKETS ARE OWED, AND THEN SENDS ONE CUMULATIVE ACK.
+    PACKETS ARRIVING EARLY ARE ACKNOWLEDGED AT ONCE, AND THE ACK CARRIES
+    A BITMAP OF THOSE RECEIVED BEYOND THE FIRST MISSING ONE, SO THAT THE
+    SENDER NEED ONLY RESEND THE GAPS.  A DUPLICATE MEANS THAT OUR ACK WAS
+    LOST, BUT A BURST OF RETRANSMISSIONS NEEDS ONLY ONE ACK IN REPLY, SO
+    DUPLICATES ARE ACKNOWLEDGED AT ONCE NO MORE THAN ONCE PER NL_ACKHOLD.
+ */
+
+static	void	(*send_ack)(CnetAddr dest, int link, bool ecn)	= NULL;
+
+//  SEND THE ACK OWED TO THE NODE IN THIS ENTRY, NOW
+static void flush_ack(int t)
+{
+    if(NL_table[t].acktimer != NULLTIMER) {
+	CNET_stop_timer(NL_table[t].acktimer);
+	NL_table[t].acktimer	= NULLTIMER;
+    }
+    NL_table[t].ackowed	= 0;
+    send_ack(NL_table[t].address, NL_table[t].acklink, NL_table[t].ackecn);
+    NL_table[t].ackecn	= false;
+}
+
+//  EV_TIMER3 - WE HAVE HELD AN ACK FOR LONG ENOUGH
+static EVENT_HANDLER(ack_hold_over)
+{
+    int	t	= find_address((CnetAddr)data);
+
+    NL_table[t].acktimer	= NULLTIMER;
+    flush_ack(t);
+}
+
+//  NOTE THAT WE OWE AN ACK TO address, TO BE RETURNED VIA link.
+//  AN urgent ACK (FOR A PACKET THAT ARRIVED EARLY) IS SENT AT ONCE
+void NL_ackowed(CnetAddr address, int link, bool ecn, bool urgent)
+{
+    int	t	= find_address(address);
+
+    NL_table[t].acklink	= link;
+    NL_table[t].ackecn	= NL_table[t].ackecn || ecn;
+    if(urgent || ++NL_table[t].ackowed >= NL_ACKBATCH)
+	flush_ack(t);
+    else if(NL_table[t].acktimer == NULLTIMER)
+	NL_table[t].acktimer	= CNET_start_timer(EV_TIMER3, NL_ACKHOLD,
+							(CnetData)address);
+}
+
+//  NOTE THAT A DUPLICATE ARRIVED FROM address, VIA link
+void NL_duplicate(CnetAddr address, int link)
+{
+    int	t	= find_address(address);
+
+    if(nodeinfo.time_in_usec - NL_table[t].dupacked >= NL_ACKHOLD) {
+	NL_table[t].dupacked	= nodeinfo.time_in_usec;
+	NL_table[t].acklink	= link;
+	flush_ack(t);
+    }
+    else
+	NL_ackowed(address, link, false, false);
+}
+
+//  REMEMBER THAT seqno ARRIVED AHEAD OF THE PACKET WE EXPECT FROM address
+void NL_outoforder(CnetAddr address, int seqno)
+{
+    int	t	= find_address(address);
+    int	bit	= seqno - (NL_table[t].packetexpected + 1);
+
+    if(bit >= 0 && bit < NL_SACKBITS)
+	NL_table[t].received	|= (1U << bit);
+}
+
+//  THE SELECTIVE ACK BITMAP TO SEND TO address
+unsigned int NL_sackbits(CnetAddr address) {
+    int	t	= find_address(address);
+    return NL_table[t].received;
+}
+
+//  REGISTER THE FUNCTION THAT BUILDS AND SENDS OUR NL_ACKs
+void NL_ackbatching(void (*sender)(CnetAddr dest, int link, bool ecn))
+{
+    send_ack	= sender;
+    CHECK(CNET_set_handler(EV_TIMER3, ack_hold_over, 0));
+}
+
+// -----------------------------------------------------------------
+
+/*  ROUTES ARE CHOSEN BY PATH COST - THE SUM, OVER EACH LINK OF THE PATH, OF
+    THE EXPECTED TRANSMISSION TIME (ETT): THE TIME TO SEND A PACKET ONCE,
+    MULTIPLIED BY THE EXPECTED NUMBER OF TRANSMISSIONS GIVEN THE LINK'S
+    DELIVERY RATIO.  SO A PATH OF SEVERAL CLEAN, FAST LINKS MAY BE PREFERRED
+    TO A SHORTER PATH OVER LOSSY OR SLOW ONES.
+ */
+
+//  NEXT-HOP LINKS PRECOMPUTED BY mkroutes, INDEXED BY DESTINATION ADDRESS
+static	uint16_t	*routes		= NULL;
+static	uint32_t	maxroute	= 0;
+
+//  FIND THE LINK ON WHICH PACKETS OF MINIMUM PATH COST WERE OBSERVED.
+//  IF THE BEST LINK IS UNKNOWN, WE RETURN THE SET OF ALL LINKS (AND false).
+//  A PRECOMPUTED ROUTE, IF ANY, IS ALWAYS PREFERRED.
+
+bool NL_linksofmincost(CnetAddr address, LINKSET *links)
+{
+    int	t, link;
+
+    LS_clear(links);
+    if(routes != NULL && (uint32_t)address <= maxroute &&
+				routes[address] != 0) {
+	LS_add(links, routes[address]);
+	return true;
+    }
+
+    t		= find_address(address);
+    link	= NL_table[t].best_link;
+    if(link == 0) {
+	LS_addall(links, nodeinfo.nlinks);
+	return false;
+    }
+    LS_add(links, link);
+    return true;
+}
+
+static	bool	given_stats	= false;
+
+//  A PACKET FROM address ARRIVED VIA link, HAVING COST cost OVER hops HOPS.
+//  A PACKET ARRIVING ON OUR BEST LINK ALWAYS REFRESHES ITS COST, SO THAT
+//  A ROUTE WHOSE LINKS HAVE DEGRADED CAN BE REPLACED BY A BETTER ONE.
+void NL_savepathcost(CnetAddr address, int hops, int cost, int link)
+{
+    int	t	= find_address(address);
+
+    if(NL_table[t].mincost > cost || NL_table[t].best_link == link) {
+	NL_table[t].mincost	= cost;
+	NL_table[t].hops	= hops;
+	NL_table[t].best_link	= link;
+	NL_table[t].updated	= nodeinfo.time_in_usec;
+	given_stats		= true;
+    }
+    if(NL_table[t].linkhops == NULL)
+	NL_table[t].linkhops	= calloc(nodeinfo.nlinks+1, sizeof(int));
+    if(NL_table[t].linkhops[link] == 0 || NL_table[t].linkhops[link] > hops)
+	NL_table[t].linkhops[link]	= hops;
+}
+
+//  THE FEWEST HOPS TO address SEEN VIA link, OR 0 IF NONE HAS BEEN SEEN
+int NL_hopsvia(CnetAddr address, int link)
+{
+    int	t	= find_address(address);
+
+    return (NL_table[t].linkhops == NULL) ? 0 : NL_table[t].linkhops[link];
+}
+
+/*  LOAD THIS NODE'S NEXT-HOP LINKS FROM A FILE WRITTEN BY mkroutes, SO THAT
+    PACKETS FOLLOW THEIR BEST PATHS FROM THE START OF THE SIMULATION.
+    RETURNS false (LEAVING US TO LEARN ROUTES) IF THERE IS NO SUCH FILE,
+    OR IT DOES NOT DESCRIBE THIS NODE.
+ */
+bool NL_loadroutes(const char *filename)
+{
+    FILE	*fp;
+    ROUTEHEADER	hdr;
+    ROUTENODE	rn;
+
+    if(filename == NULL || *filename == '\0')
+	return false;
+    if((fp = fopen(filename, "rb")) == NULL) {
+	fprintf(stderr, "%s: cannot open %s\n", nodeinfo.nodename, filename);
+	return false;
+    }
+    if(fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+       memcmp(hdr.magic, ROUTE_MAGIC, sizeof(hdr.magic)) != 0 ||
+       hdr.version != ROUTE_VERSION) {
+	fprintf(stderr, "%s: %s is not a routing table\n",
+			nodeinfo.nodename, filename);
+	fclose(fp);
+	return false;
+    }
+
+    free(routes);
+    routes	= calloc(hdr.maxaddress+1, sizeof(uint16_t));
+    maxroute	= hdr.maxaddress;
+    for(uint32_t n=0 ; n<hdr.nnodes ; ++n) {
+	if(fread(&rn, sizeof(rn), 1, fp) != 1 ||
+	   fread(routes, sizeof(uint16_t), maxroute+1, fp) != maxroute+1)
+	    break;
+	if(strcasecmp(rn.name, nodeinfo.nodename) == 0) {
+	    fclose(fp);
+	    return true;
+	}
+    }
+    fprintf(stderr, "%s: not found in %s\n", nodeinfo.nodename, filename);
+    fclose(fp);
+    free(routes);
+    routes	= NULL;
+    return false;
+}
+
+// -----------------------------------------------------------------
+
+void NL_showtable(void)
+{
+    printf("\n%13s %13s %13s %13s %6s",
+	    "destination", "ackexpected", "nextpkttosend", "pktexpected", "cwnd");
+    if(given_stats)
+	printf(" %10s %6s %8s", "pathcost", "hops", "bestlink");
+    printf("\n");
+
+    for(int t=0 ; t<NL_table_size ; ++t)
+	if(NL_table[t].address != nodeinfo.address) {
+	    printf("%13d %13d %13d %13d %6.2f", (int)NL_table[t].address,
+		    NL_table[t].ackexpected, NL_table[t].nextpackettosend,
+		    NL_table[t].packetexpected, NL_table[t].cwnd);
+	    if(NL_table[t].best_link != 0)
+		printf(" %10d %6d %8d", NL_table[t].mincost,
+			NL_table[t].hops, NL_table[t].best_link);
+	    printf("\n");
+	}
+}
+
+// -----------------------------------------------------------------
+
+/*  SO THAT A NODE WHICH CRASHES AND REBOOTS NEED NOT LEARN ITS ROUTES AGAIN
+    BY FLOODING, NL_snapshots() RELOADS THE ROUTES LAST WRITTEN BY THIS NODE,
+    AND THEN WRITES THEM EVERY NL_CHECKPOINT usecs TO A FILE NAMED AFTER THE
+    NODE.  SNAPSHOTS ARE TAKEN ONLY WHEN A DIRECTORY IS GIVEN (TOPOLOGIES
+    WITH A NON-ZERO nodemtbf), AND THE FILES ARE WRITTEN TO A SUBDIRECTORY
+    NAMED AFTER THE PROCESS, SO THAT EACH RUN HAS ITS OWN.
+    THE FILE HOLDS A VERSIONED HEADER AND ONE FIXED-SIZE RECORD PER REMOTE
+    NODE, PROTECTED BY A CHECKSUM.  A SNAPSHOT FROM ANOTHER RUN, FOR ANOTHER
+    ADDRESS, OR A DIFFERENT NUMBER OF LINKS, IS IGNORED, AND ROUTES NOT
+    OBSERVED WITHIN NL_MAXAGE usecs ARE FORGOTTEN.  ONLY ROUTES ARE RESTORED;
+    THE OTHER NODES' SEQUENCE NUMBERS HAVE MOVED ON SINCE THE CHECKPOINT.
+ */
+
+#define	SNAP_MAGIC	"NLSS"
+#define	SNAP_VERSION	2
+
+static	char	snapdir[256];			// empty if not taking snapshots
+
+typedef struct {
+    char	magic[4];
+    uint32_t	version;
+    int32_t	runid;			// process that wrote it
+    int32_t	address;		// of the node that wrote it
+    int32_t	nlinks;
+    int64_t	written;		// simulation time, usecs
+    uint32_t	nentries;
+    int32_t	checksum;		// CNET_ccitt() of all entries
+} SNAPHEADER;
+
+typedef struct {
+    int32_t	address;
+    int32_t	mincost;
+    int32_t	hops;
+    int32_t	best_link;
+    int64_t	updated;
+} SNAPENTRY;
+
+static void snapshot_name(char *name, size_t size)
+{
+    snprintf(name, size, "%s/%s.nlstate", snapdir, nodeinfo.nodename);
 }
 
+//  EV_TIMER5 - WRITE THE TABLE TO OUR SNAPSHOT FILE
+static EVENT_HANDLER(checkpoint)
+{
+    SNAPHEADER	hdr;
+    SNAPENTRY	*e	= calloc(NL_table_size+1, sizeof(SNAPENTRY));
+    char	name[320], tmpname[336];
+    FILE	*fp;
+
+    for(int t=0 ; t<NL_table_size ; ++t) {
+	e[t].address		= NL_table[t].address;
+	e[t].mincost		= NL_table[t].mincost;
+	e[t].hops		= NL_table[t].hops;
+	e[t].best_link		= NL_table[t].best_link;
+	e[t].updated		= NL_table[t].updated;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SNAP_MAGIC, sizeof(hdr.magic));
+    hdr.version		= SNAP_VERSION;
+    hdr.runid		= (int32_t)getpid();
+    hdr.address		= nodeinfo.address;
+    hdr.nlinks		= nodeinfo.nlinks;
+    hdr.written		= nodeinfo.time_in_usec;
+    hdr.nentries	= NL_table_size;
+    hdr.checksum	= CNET_ccitt((unsigned char *)e,
+					(int)(NL_table_size * sizeof(SNAPENTRY)));
+
+//  WRITE A NEW FILE, THEN RENAME IT, SO A CRASH NEVER LEAVES HALF A SNAPSHOT
+    snapshot_name(name, sizeof(name));
+    snprintf(tmpname, sizeof(tmpname), "%s.tmp", name);
+    if((fp = fopen(tmpname, "wb")) != NULL) {
+	if(fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+	   fwrite(e, sizeof(SNAPENTRY), NL_table_size, fp) ==
+						(size_t)NL_table_size &&
+	   fclose(fp) == 0)
+	    rename(tmpname, name);
+	else
+	    remove(tmpname);
+    }
+    free(e);
+    CNET_start_timer(EV_TIMER5, NL_CHECKPOINT, 0);
+}
 
+//  RELOAD OUR SNAPSHOT, IF IT IS VALID, RETURNING THE NUMBER OF ROUTES KEPT
+static int restore_snapshot(void)
+{
+    SNAPHEADER	hdr;
+    SNAPENTRY	*e;
+    char	name[320];
+    FILE	*fp;
+    int		nroutes	= 0;
+
+    snapshot_name(name, sizeof(name));
+    if((fp = fopen(name, "rb")) == NULL)
+	return 0;
+    if(fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+       memcmp(hdr.magic, SNAP_MAGIC, sizeof(hdr.magic)) != 0 ||
+       hdr.version != SNAP_VERSION || hdr.runid != (int32_t)getpid() ||
+       hdr.address != nodeinfo.address || hdr.nlinks != nodeinfo.nlinks ||
+       hdr.nentries > 65536 || hdr.written > nodeinfo.time_in_usec) {
+	fclose(fp);
+	return 0;
+    }
+    e	= calloc(hdr.nentries+1, sizeof(SNAPENTRY));
+    if(fread(e, sizeof(SNAPENTRY), hdr.nentries, fp) != hdr.nentries ||
+       CNET_ccitt((unsigned char *)e, (int)(hdr.nentries * sizeof(SNAPENTRY)))
+							!= hdr.checksum) {
+	fclose(fp);
+	free(e);
+	return 0;
+    }
+    fclose(fp);
+
+    for(uint32_t i=0 ; i<hdr.nentries ; ++i) {
+	if(e[i].best_link >= 1 && e[i].best_link <= nodeinfo.nlinks &&
+	   nodeinfo.time_in_usec - e[i].updated <= NL_MAXAGE) {
+	    int	t	= find_address(e[i].address);
+
+	    NL_table[t].mincost		= e[i].mincost;
+	    NL_table[t].hops		= e[i].hops;
+	    NL_table[t].best_link	= e[i].best_link;
+	    NL_table[t].updated		= e[i].updated;
+	    given_stats			= true;
+	    ++nroutes;
+	}
+    }
+    free(e);
+    return nroutes;
+}
+
+//  RELOAD, AND THEN PERIODICALLY WRITE, OUR SNAPSHOT IN dir (IF NOT NULL)
+bool NL_snapshots(const char *dir)
+{
+    snapdir[0]	= '\0';
+    if(dir == NULL || *dir == '\0')
+	return false;
+    snprintf(snapdir, sizeof(snapdir), "%s/%d", dir, (int)getpid());
+    if(mkdir(snapdir, 0755) != 0 && errno != EEXIST) {
+	fprintf(stderr, "%s: cannot create %s\n", nodeinfo.nodename, snapdir);
+	snapdir[0]	= '\0';
+	return false;
+    }
+
+    if(restore_snapshot() > 0)
+	printf("%s: routes restored from snapshot\n", nodeinfo.nodename);
+    CHECK(CNET_set_handler(EV_TIMER5, checkpoint, 0));
+    CNET_start_timer(EV_TIMER5, NL_CHECKPOINT, 0);
+    return true;
+}
+
+static EVENT_HANDLER(show_NL_table)
+{
+    NL_showtable();
+}
+
+void reboot_NL_table(void)
+{
+    CHECK(CNET_set_handler(EV_DEBUG0, show_NL_table, 0));
+    CHECK(CNET_set_debug_string(EV_DEBUG0, "NL info"));
+
+    NL_table		= calloc(1, sizeof(NLTABLE));
+    NL_table_size	= 0;
+    free(routes);
+    routes		= NULL;
+}
@@ -1,15 +1,38 @@
 #include <cnet.h>
 
-#define	ALL_LINKS	(-1)
+#include "linkset.h"
+
+#define	NL_MAXWINDOW	16		// largest congestion window, in packets
+#define	NL_SACKBITS	32		// packets covered by a selective ACK
+#define	NL_ACKBATCH	4		// packets acknowledged by one NL_ACK
+#define	NL_ACKHOLD	200000		// usec an NL_ACK may be held back
+#define	NL_CHECKPOINT	10000000	// usec between snapshots of the table
+#define	NL_MAXAGE	120000000	// usec before a snapshot route is stale
 
 extern	void	reboot_NL_table(void);
+extern	void	NL_showtable(void);
 
 extern	int	NL_ackexpected(CnetAddr address);
 extern	int	NL_nextpackettosend(CnetAddr address);
 extern	int	NL_packetexpected(CnetAddr address);
 
-extern	void	inc_NL_packetexpected(CnetAddr address);
 extern	void	inc_NL_ackexpected(CnetAddr address);
+extern	void	inc_NL_packetexpected(CnetAddr address);
+
+extern	int	NL_ackreceived(CnetAddr address, int seqno, unsigned int sack);
+extern	bool	NL_issacked(CnetAddr address, int seqno);
+extern	int	NL_inflight(CnetAddr address);
+extern	int	NL_window(CnetAddr address);
+extern	void	NL_congestion(CnetAddr address);
+
+extern	void	NL_ackbatching(void (*sender)(CnetAddr dest, int link, bool ecn));
+extern	void	NL_ackowed(CnetAddr address, int link, bool ecn, bool urgent);
+extern	void	NL_duplicate(CnetAddr address, int link);
+extern	void	NL_outoforder(CnetAddr address, int seqno);
+extern	unsigned int	NL_sackbits(CnetAddr address);
 
-extern	int	NL_linksofminhops(CnetAddr address);
-extern	void	NL_savehopcount(CnetAddr address, int hops, int link);
+extern	bool	NL_linksofmincost(CnetAddr address, LINKSET *links);
+extern	void	NL_savepathcost(CnetAddr address, int hops, int cost, int link);
+extern	int	NL_hopsvia(CnetAddr address, int link);
+extern	bool	NL_loadroutes(const char *filename);
+extern	bool	NL_snapshots(const char *dir);
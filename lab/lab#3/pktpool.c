@@ -0,0 +1,154 @@
+#include <cnet.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pktpool.h"
+
+/*  THIS FILE PROVIDES A POOL OF REFERENCE-COUNTED PACKET BUFFERS.
+    RATHER THAN EMBEDDING A FULL MAX_MESSAGE_SIZE ARRAY IN EVERY STORED
+    PACKET, A CALLER ASKS FOR A BUFFER OF THE LENGTH IT REALLY NEEDS AND
+    RECEIVES ONE FROM THE SMALLEST SIZE CLASS THAT FITS.
+
+    BUFFERS ARE CARVED FROM SLABS AND RETURNED TO A PER-CLASS FREE LIST
+    WHEN THEIR LAST REFERENCE IS RELEASED, SO A NODE'S MEMORY GROWS WITH
+    THE NUMBER OF BYTES IT HAS IN FLIGHT, NOT WITH MESSAGES x 32KB.
+    A BUFFER MAY BE SHARED (e.g. BY A RETRANSMIT STORE AND A LINK QUEUE)
+    BY CALLING pkt_hold() ONCE FOR EACH ADDITIONAL HOLDER.
+ */
+
+typedef struct _pktbuf {
+    struct _pktbuf	*next;		// free list link, when not in use
+    size_t		length;		// bytes requested by the caller
+    int			class;		// index into class_size[]
+    int			refcount;	// 0 while on the free list
+} PKTBUF;
+
+#define	NCLASSES	4
+#define	SLAB_BYTES	16384		// preferred allocation from malloc()
+
+static	const size_t	class_size[NCLASSES] = {
+    64, 256, 2048, POOL_MAXSIZE
+};
+
+static	PKTBUF	*freelist[NCLASSES];
+
+static	int	nbuffers[NCLASSES];	// buffers carved, in use or free
+static	int	ninuse[NCLASSES];
+static	int	maxinuse[NCLASSES];
+static	int	nallocs[NCLASSES];
+
+#define	BUF_TO_DATA(b)	((char *)((b) + 1))
+#define	DATA_TO_BUF(d)	((PKTBUF *)(d) - 1)
+
+// -----------------------------------------------------------------
+
+//  CARVE A NEW SLAB OF BUFFERS FOR THE GIVEN CLASS ONTO ITS FREE LIST
+static void grow_class(int c)
+{
+    size_t	each	= sizeof(PKTBUF) + class_size[c];
+    int		n	= (each < SLAB_BYTES) ? (int)(SLAB_BYTES / each) : 1;
+    char	*slab	= malloc(n * each);
+
+    if(slab == NULL) {
+	fprintf(stderr, "%s: out of memory for packet buffers\n",
+			nodeinfo.nodename);
+	exit(1);
+    }
+    for(int i=0 ; i<n ; ++i) {
+	PKTBUF	*b	= (PKTBUF *)(slab + i*each);
+
+	b->class	= c;
+	b->refcount	= 0;
+	b->next		= freelist[c];
+	freelist[c]	= b;
+    }
+    nbuffers[c]	+= n;
+}
+
+//  ALLOCATE A BUFFER OF AT LEAST length BYTES, WITH A REFERENCE COUNT OF 1
+char *pkt_alloc(size_t length)
+{
+    PKTBUF	*b;
+    int		c;
+
+    for(c=0 ; c<NCLASSES ; ++c)
+	if(length <= class_size[c])
+	    break;
+    if(c == NCLASSES) {
+	fprintf(stderr, "%s: packet of %d bytes is too large for the pool\n",
+			nodeinfo.nodename, (int)length);
+	exit(1);
+    }
+
+    if(freelist[c] == NULL)
+	grow_class(c);
+    b		= freelist[c];
+    freelist[c]	= b->next;
+
+    b->next	= NULL;
+    b->length	= length;
+    b->refcount	= 1;
+
+    ++nallocs[c];
+    if(++ninuse[c] > maxinuse[c])
+	maxinuse[c]	= ninuse[c];
+    return BUF_TO_DATA(b);
+}
+
+//  ALLOCATE A BUFFER OF EXACTLY length BYTES, AND FILL IT FROM data
+char *pkt_copy(const void *data, size_t length)
+{
+    char	*buf	= pkt_alloc(length);
+
+    memcpy(buf, data, length);
+    return buf;
+}
+
+//  ADD ANOTHER REFERENCE TO AN EXISTING BUFFER
+char *pkt_hold(char *buf)
+{
+    DATA_TO_BUF(buf)->refcount++;
+    return buf;
+}
+
+//  DROP ONE REFERENCE, RETURNING THE BUFFER TO ITS FREE LIST IF IT WAS THE LAST
+void pkt_release(char *buf)
+{
+    PKTBUF	*b;
+
+    if(buf == NULL)
+	return;
+    b	= DATA_TO_BUF(buf);
+    if(--b->refcount > 0)
+	return;
+
+    b->next		= freelist[b->class];
+    freelist[b->class]	= b;
+    --ninuse[b->class];
+}
+
+size_t pkt_length(const char *buf)
+{
+    return DATA_TO_BUF(buf)->length;
+}
+
+//  THE NUMBER OF BYTES CURRENTLY RESERVED BY BUFFERS IN USE
+size_t pkt_bytesinuse(void)
+{
+    size_t	total	= 0;
+
+    for(int c=0 ; c<NCLASSES ; ++c)
+	total	+= ninuse[c] * class_size[c];
+    return total;
+}
+
+//  PRINT THE OCCUPANCY OF EACH SIZE CLASS
+void pkt_report(void)
+{
+    printf("\n%10s %8s %8s %8s %10s\n",
+		"class", "inuse", "maxinuse", "carved", "allocs");
+    for(int c=0 ; c<NCLASSES ; ++c)
+	printf("%10d %8d %8d %8d %10d\n", (int)class_size[c],
+		ninuse[c], maxinuse[c], nbuffers[c], nallocs[c]);
+    printf("%10s %8d bytes\n", "in use", (int)pkt_bytesinuse());
+}
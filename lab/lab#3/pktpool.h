@@ -0,0 +1,14 @@
+#include <cnet.h>
+
+/* ------- DECLARATIONS FOR A SIZE-CLASSED POOL OF PACKET BUFFERS -------- */
+
+#define	POOL_MAXSIZE	(MAX_MESSAGE_SIZE + 1024)
+
+extern	char	*pkt_alloc(size_t length);
+extern	char	*pkt_copy(const void *data, size_t length);
+extern	char	*pkt_hold(char *buf);
+extern	void	pkt_release(char *buf);
+extern	size_t	pkt_length(const char *buf);
+
+extern	size_t	pkt_bytesinuse(void);
+extern	void	pkt_report(void);
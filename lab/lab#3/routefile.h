@@ -0,0 +1,30 @@
+#ifndef _ROUTEFILE_H
+#define _ROUTEFILE_H
+
+#include <stdint.h>
+
+/* ------- THE FORMAT OF A PRECOMPUTED ROUTING TABLE FILE --------
+
+   A file holds a ROUTEHEADER, and then for each node a ROUTENODE followed
+   by (maxaddress+1) uint16_t link numbers, indexed by destination address.
+   Link 0 means "no route" (the node itself, or an unused address).
+   Integers are in the byte order of the machine that wrote the file.
+ */
+
+#define	ROUTE_MAGIC	"NLRT"
+#define	ROUTE_VERSION	1
+#define	ROUTE_MAXNAME	32
+
+typedef struct {
+    char	magic[4];
+    uint32_t	version;
+    uint32_t	nnodes;
+    uint32_t	maxaddress;
+} ROUTEHEADER;
+
+typedef struct {
+    char	name[ROUTE_MAXNAME];
+    uint32_t	address;
+} ROUTENODE;
+
+#endif
@@ -0,0 +1,216 @@
+#include <cnet.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spantree.h"
+#include "dll_basic.h"
+
+/*  THIS FILE BUILDS AND MAINTAINS A SPANNING TREE OVER ALL NODES, SO THAT
+    BROADCASTS (AND FLOODS TO UNKNOWN DESTINATIONS) CAN TRAVEL ONLY ON TREE
+    EDGES - EXACTLY N-1 TRANSMISSIONS PER BROADCAST, RATHER THAN ONE PER
+    LINK-DIRECTION AROUND EVERY CYCLE OF THE NETWORK.
+
+    Every ST_PERIOD each node sends a BPDU (bridge protocol data unit) on
+    each of its links, announcing the root it believes in, its cost (hops)
+    to that root, and whether that link is its parent link.  The root is
+    the node with the lowest address.  A node's parent link is the one
+    offering the best (root, cost+1, neighbour address) triple; a link is
+    a child link while the neighbour at its far end calls it its parent.
+
+    Information not refreshed within ST_MAXAGE is forgotten, so the tree
+    repairs itself after node or link failures.  When the root fails, its
+    neighbours may still hear of it from each other, each through the
+    other, at ever greater costs (counting to infinity).  So a root more
+    than ST_MAXCOST hops away is taken to be unreachable, and a BPDU
+    offering one is not used to elect our root and parent.  The tree is not used
+    until it has been unchanged for ST_SETTLE, as broadcasting on a
+    half-built tree would not reach every node.
+
+    As BPDUs are sent at a known rate, they also serve as probes of each
+    link's quality.  We count the BPDUs heard on each link over the last
+    ST_WINDOW periods, and report that count back in our own BPDUs, so
+    each node knows the delivery ratio of its links in both directions.
+ */
+
+#define	ST_PERIOD	2000000		// usec between BPDUs
+#define	ST_MAXAGE	(3*ST_PERIOD)
+#define	ST_SETTLE	(2*ST_PERIOD)
+#define	ST_MAXCOST	32		// hops, beyond which a root is unreachable
+#define	ST_WINDOW	10		// periods over which BPDUs are counted
+#define	ST_MINDELIVERY	0.05		// so that ETX stays finite
+
+typedef struct {
+    CnetAddr	root;
+    int		cost;			// sender's hops to root
+    CnetAddr	sender;
+    bool	isparent;		// receiver is the sender's parent
+    int		heard;			// BPDUs sender heard from receiver
+} BPDU;
+
+typedef struct {
+    CnetTime	heard;			// time of last BPDU, 0 if never
+    BPDU	last;
+    CnetTime	child_until;		// a child link until this time
+    unsigned int history;		// bit i: BPDU heard i periods ago
+} STLINK;
+
+static	STLINK		*stlinks	= NULL;
+static	CnetAddr	root;
+static	int		rootcost;
+static	int		parent_link;	// 0 if we believe we are the root
+static	CnetTime	last_change;
+static	int		nperiods;	// periods since reboot
+
+// -----------------------------------------------------------------
+
+static bool fresh(int link)
+{
+    return stlinks[link].heard != 0 &&
+	   nodeinfo.time_in_usec - stlinks[link].heard <= ST_MAXAGE;
+}
+
+//  CHOOSE OUR ROOT AND PARENT LINK FROM THE FRESH BPDUs OF OUR NEIGHBOURS
+static void elect(void)
+{
+    CnetAddr	newroot	= nodeinfo.address;
+    int		newcost	= 0;
+    int		newparent = 0;
+    CnetAddr	via	= 0;
+
+    for(int link=1 ; link<=nodeinfo.nlinks ; ++link) {
+	BPDU	*b	= &stlinks[link].last;
+
+	if(!fresh(link) || b->cost+1 > ST_MAXCOST)
+	    continue;
+	if(b->root < newroot ||
+	  (b->root == newroot && b->cost+1 < newcost) ||
+	  (b->root == newroot && b->cost+1 == newcost && newparent != 0 &&
+						b->sender < via)) {
+	    newroot	= b->root;
+	    newcost	= b->cost + 1;
+	    newparent	= link;
+	    via		= b->sender;
+	}
+    }
+    if(newroot != root || newparent != parent_link) {
+	last_change	= nodeinfo.time_in_usec;
+	root		= newroot;
+	parent_link	= newparent;
+    }
+    rootcost	= newcost;
+}
+
+//  THE NUMBER OF BPDUs HEARD ON THIS LINK IN THE LAST ST_WINDOW COMPLETE
+//  PERIODS (BIT 0 IS THE CURRENT, INCOMPLETE, PERIOD)
+static int nheard(int link)
+{
+    return __builtin_popcount((stlinks[link].history >> 1) &
+				((1U << ST_WINDOW) - 1));
+}
+
+static void send_bpdus(void)
+{
+    BPDU	b;
+
+    b.root	= root;
+    b.cost	= rootcost;
+    b.sender	= nodeinfo.address;
+    for(int link=1 ; link<=nodeinfo.nlinks ; ++link) {
+	if(DLL_bonded(link))		// its bundle is one link to us
+	    continue;
+	b.isparent	= (link == parent_link);
+	b.heard		= nheard(link);
+	send_tree_packet(link, (char *)&b, sizeof(b));
+    }
+}
+
+//  EV_TIMER4 - TIME TO RE-ELECT, AND REFRESH OUR NEIGHBOURS
+static EVENT_HANDLER(tree_timeout)
+{
+    for(int link=1 ; link<=nodeinfo.nlinks ; ++link)
+	stlinks[link].history	<<= 1;
+    ++nperiods;
+    elect();
+    send_bpdus();
+    CNET_start_timer(EV_TIMER4, ST_PERIOD, 0);
+}
+
+// -----------------------------------------------------------------
+
+//  ST_receive() IS CALLED BY THE NETWORK LAYER WITH EACH BPDU THAT ARRIVES
+void ST_receive(char *bpdu, size_t length, int arrived_on)
+{
+    STLINK	*sl	= &stlinks[arrived_on];
+    bool	waschild = sl->child_until >= nodeinfo.time_in_usec;
+    bool	ischild;
+
+    memcpy(&sl->last, bpdu, sizeof(BPDU));
+    sl->heard		= nodeinfo.time_in_usec;
+    sl->history		|= 1;
+    sl->child_until	= sl->last.isparent ? sl->heard + ST_MAXAGE : 0;
+
+    ischild	= sl->child_until != 0;
+    if(ischild != waschild)
+	last_change	= nodeinfo.time_in_usec;
+    elect();
+}
+
+//  HAS THE TREE BEEN STABLE LONG ENOUGH TO BE USED FOR BROADCASTS?
+bool ST_ready(void)
+{
+    return nodeinfo.time_in_usec - last_change >= ST_SETTLE;
+}
+
+//  THE TREE EDGES AT THIS NODE: OUR PARENT LINK, AND ALL CHILD LINKS
+void ST_treelinks(LINKSET *links)
+{
+    LS_clear(links);
+    if(parent_link != 0)
+	LS_add(links, parent_link);
+    for(int link=1 ; link<=nodeinfo.nlinks ; ++link)
+	if(stlinks[link].child_until >= nodeinfo.time_in_usec)
+	    LS_add(links, link);
+}
+
+/*  THE PROBABILITY THAT A FRAME SENT ON THIS LINK, AND ITS REPLY, ARE BOTH
+    DELIVERED - THE PRODUCT OF THE DELIVERY RATIOS IN EACH DIRECTION.  ITS
+    INVERSE IS THE EXPECTED NUMBER OF TRANSMISSIONS (ETX) OF THE LINK.
+ */
+double ST_delivery(int link)
+{
+    int		window	= (nperiods < ST_WINDOW) ? nperiods : ST_WINDOW;
+    double	forward, reverse, d;
+
+    if(window == 0 || stlinks[link].heard == 0)
+	return 1.0;				// nothing known yet
+    forward	= (double)nheard(link) / window;
+    reverse	= (double)stlinks[link].last.heard / window;
+    d		= (forward > 1.0 ? 1.0 : forward) * (reverse > 1.0 ? 1.0 : reverse);
+    return (d < ST_MINDELIVERY) ? ST_MINDELIVERY : d;
+}
+
+void ST_show(void)
+{
+    printf("\n root=%d cost=%d parent=%d ready=%s children:",
+		(int)root, rootcost, parent_link, ST_ready() ? "yes" : "no");
+    for(int link=1 ; link<=nodeinfo.nlinks ; ++link)
+	if(stlinks[link].child_until >= nodeinfo.time_in_usec)
+	    printf(" %d", link);
+    printf("\n delivery:");
+    for(int link=1 ; link<=nodeinfo.nlinks ; ++link)
+	printf(" %d=%.2f", link, ST_delivery(link));
+    printf("\n");
+}
+
+void reboot_spantree(void)
+{
+    stlinks	= calloc(nodeinfo.nlinks+1, sizeof(STLINK));
+    root	= nodeinfo.address;
+    rootcost	= 0;
+    parent_link	= 0;
+    last_change	= nodeinfo.time_in_usec;
+    nperiods	= 0;
+
+    CHECK(CNET_set_handler(EV_TIMER4, tree_timeout, 0));
+    CNET_start_timer(EV_TIMER4, ST_PERIOD, 0);
+}
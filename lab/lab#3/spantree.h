@@ -0,0 +1,17 @@
+#include <cnet.h>
+
+#include "linkset.h"
+
+/* ------- DECLARATIONS FOR A DISTRIBUTED SPANNING TREE OF THE NETWORK ------- */
+
+extern	void	reboot_spantree(void);
+extern	void	ST_receive(char *bpdu, size_t length, int arrived_on);
+
+extern	bool	ST_ready(void);
+extern	void	ST_treelinks(LINKSET *links);
+extern	double	ST_delivery(int link);
+extern	void	ST_show(void);
+
+//  EACH NETWORK LAYER USING THE TREE MUST PROVIDE THIS FUNCTION, TO CARRY
+//  A BPDU (AS THE PAYLOAD OF ONE OF ITS OWN PACKETS) TO A NEIGHBOUR
+extern	void	send_tree_packet(int link, char *bpdu, size_t length);
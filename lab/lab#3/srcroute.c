@@ -0,0 +1,117 @@
+#include <cnet.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "srcroute.h"
+#include "spantree.h"
+
+/*  THIS FILE KEEPS EACH NODE'S CACHE OF SOURCE ROUTES: FOR EACH
+    DESTINATION, THE SEQUENCE OF LINKS, ONE CHOSEN AT EACH NODE ALONG THE
+    WAY, THAT LAST CARRIED A PACKET FROM HERE TO THERE.  PATHS ARE LEARNT
+    FROM THE LINKS RECORDED BY PACKETS IN TRANSIT (SEE flooding3.c), THE
+    SHORTEST BEING KEPT, AND ARE FORGOTTEN WHEN A ROUTE ERROR REPORTS THAT
+    ONE HAS FAILED, OR AFTER SR_MAXAGE, SO THAT A BETTER ONE MAY BE FOUND.
+ */
+
+typedef struct {
+    CnetAddr		address;
+    unsigned char	len;			// 0 if none known
+    unsigned char	links[SR_MAXPATH];
+    CnetTime		learnt;
+} SRCACHE;
+
+static	SRCACHE		*cache		= NULL;
+static	int		cache_size	= 0;
+
+static	int		nlearnt		= 0;	/* statistics */
+static	int		ninvalidated	= 0;
+
+//  GIVEN AN ADDRESS, LOCATE OR CREATE ITS ENTRY IN THE CACHE
+static SRCACHE *find_path(CnetAddr address)
+{
+    for(int c=0 ; c<cache_size ; ++c)
+	if(cache[c].address == address)
+	    return &cache[c];
+
+    cache	= realloc(cache, (cache_size+1)*sizeof(SRCACHE));
+    memset(&cache[cache_size], 0, sizeof(SRCACHE));
+    cache[cache_size].address	= address;
+    return &cache[cache_size++];
+}
+
+//  FILL route WITH THE CACHED PATH TO dest, IF ONE IS KNOWN AND FRESH
+bool SR_lookup(CnetAddr dest, SRROUTE *route)
+{
+    SRCACHE	*c	= find_path(dest);
+
+    if(c->len == 0 || nodeinfo.time_in_usec - c->learnt > SR_MAXAGE)
+	return false;
+    route->mode	= SR_ROUTED;
+    route->len	= c->len;
+    route->next	= 0;
+    memcpy(route->out, c->links, c->len);
+    return true;
+}
+
+//  REMEMBER A PATH TO dest, IF NONE IS FRESH OR IT IS NO LONGER THAN OURS
+void SR_learn(CnetAddr dest, const unsigned char *links, int len)
+{
+    SRCACHE	*c	= find_path(dest);
+
+    if(len < 1 || len > SR_MAXPATH)
+	return;
+    if(c->len == 0 || len <= c->len ||
+	nodeinfo.time_in_usec - c->learnt > SR_MAXAGE) {
+	c->len		= len;
+	memcpy(c->links, links, len);
+	c->learnt	= nodeinfo.time_in_usec;
+	++nlearnt;
+    }
+}
+
+void SR_invalidate(CnetAddr dest)
+{
+    SRCACHE	*c	= find_path(dest);
+
+    if(c->len != 0) {
+	c->len	= 0;
+	++ninvalidated;
+    }
+}
+
+/*  THE ROUTE BACK TO THE SOURCE OF A PACKET THAT HAS TAKEN hops HOPS: THE
+    LINKS IT ARRIVED ON, IN REVERSE ORDER
+ */
+void SR_reverse(const SRROUTE *from, int hops, SRROUTE *to)
+{
+    to->mode	= SR_ROUTED;
+    to->len	= hops;
+    to->next	= 0;
+    for(int h=0 ; h<hops ; ++h)
+	to->out[h]	= from->back[hops-1-h];
+}
+
+//  CAN A SOURCE ROUTED PACKET LEAVE ON THIS LINK?
+bool SR_usable(int link)
+{
+    return link >= 1 && link <= nodeinfo.nlinks && linkinfo[link].linkup &&
+		ST_delivery(link) > SR_MINDELIVERY;
+}
+
+void SR_showcache(void)
+{
+    int		fresh	= 0;
+
+    for(int c=0 ; c<cache_size ; ++c)
+	if(cache[c].len != 0 &&
+	   nodeinfo.time_in_usec - cache[c].learnt <= SR_MAXAGE)
+	    ++fresh;
+    printf("%s: %d paths cached, %d learnt, %d invalidated\n",
+		nodeinfo.nodename, fresh, nlearnt, ninvalidated);
+}
+
+void reboot_srcroute(void)
+{
+    cache	= NULL;
+    cache_size	= 0;
+}
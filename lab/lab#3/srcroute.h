@@ -0,0 +1,30 @@
+#include <cnet.h>
+
+/* ------- DECLARATIONS FOR SOURCE ROUTES AND A CACHE OF PATHS -------- */
+
+#ifndef	SR_MAXPATH
+#define	SR_MAXPATH	8		// links in a source route
+#endif
+#define	SR_MAXAGE	30000000	// usec before a cached path is rediscovered
+#define	SR_MINDELIVERY	0.1		// a link delivering less has failed
+
+typedef enum	{ SR_NONE, SR_RECORD, SR_ROUTED }	SRMODE;
+
+//  CARRIED IN EACH PACKET'S HEADER.  LINK NUMBERS MUST BE BELOW 256.
+typedef struct {
+    unsigned char	mode;			// an SRMODE
+    unsigned char	len;			// links in out[]
+    unsigned char	next;			// SR_ROUTED: index of next link
+    unsigned char	out[SR_MAXPATH];	// link to leave each node by
+    unsigned char	back[SR_MAXPATH];	// link each node was reached by
+} SRROUTE;
+
+extern	void	reboot_srcroute(void);
+extern	void	SR_showcache(void);
+
+extern	bool	SR_lookup(CnetAddr dest, SRROUTE *route);
+extern	void	SR_learn(CnetAddr dest, const unsigned char *links, int len);
+extern	void	SR_invalidate(CnetAddr dest);
+
+extern	void	SR_reverse(const SRROUTE *from, int hops, SRROUTE *to);
+extern	bool	SR_usable(int link);
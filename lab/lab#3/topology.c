@@ -0,0 +1,571 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "topology.h"
+
+/*  THIS FILE READS THE SUBSET OF cnet's TOPOLOGY FILE SYNTAX USED BY OUR
+    LABS, SO THAT TOOLS OUTSIDE OF cnet (SUCH AS mkroutes) CAN KNOW THE
+    NODES AND LINKS OF A NETWORK.  IT UNDERSTANDS:
+
+	#include "file"		(relative to the including file)
+	name = value		(global attributes)
+	host NAME { ... }	(also router, mobile and accesspoint)
+	link to NAME [{ name = value ... }]	(also wan to NAME)
+	lansegment NAME { ... }
+	lan to NAME [{ ... }]	(a link to the lansegment NAME)
+	wlan [{ ... }]		(a link to the wireless medium)
+
+    Any other words (such as "east of perth") are ignored.  As in cnet, a
+    link mentioned from both of its ends is a single link: the k-th mention
+    of B by A is paired with the k-th mention of A by B.  Each node's links
+    are numbered from 1, in the order in which they are created.  Node
+    names are compared without regard to case.
+
+    A lansegment is not a node: it is a shared medium, described by its
+    lan-bandwidth, lan-propagationdelay, lan-probframeloss and
+    lan-probframecorrupt (from its own block, else global).  Each node's
+    lan to it is one of the node's links, numbered among its others.
+    Every wlan link is to one more segment, the wireless medium, described
+    by the global wlan-bandwidth, wlan-propagationdelay, and so on.  Every
+    node with a wlan link can hear every other: range is not modelled.
+ */
+
+#define	DEFAULT_DELAY		2500		// usec
+#define	DEFAULT_BANDWIDTH	56000		// bps
+#define	DEFAULT_LANDELAY	25		// usec, half an Ethernet slot
+#define	DEFAULT_LANBANDWIDTH	10000000	// bps
+#define	DEFAULT_WLANDELAY	1		// usec
+#define	DEFAULT_WLANBANDWIDTH	2000000		// bps
+
+typedef struct {
+    char	*text;
+    const char	*file;
+    int		line;
+} TOKEN;
+
+typedef struct {			// one "link to NAME" in the file
+    char	from[TOPO_MAXNAME];
+    char	to[TOPO_MAXNAME];
+    int		lan;			// to a lansegment, not a node
+    int		wlan;			// to the wireless medium
+    char	**attrs;
+    int		nattrs;
+} MENTION;
+
+static	TOKEN	*tokens		= NULL;
+static	int	ntokens		= 0;
+static	int	next		= 0;
+
+// -----------------------------------------------------------------
+
+static void add_token(char *text, const char *file, int line)
+{
+    tokens		= realloc(tokens, (ntokens+1)*sizeof(TOKEN));
+    tokens[ntokens].text	= text;
+    tokens[ntokens].file	= file;
+    tokens[ntokens].line	= line;
+    ++ntokens;
+}
+
+//  READ AND TOKENIZE ONE FILE, EXPANDING ANY #include DIRECTIVES IN PLACE
+static int tokenize(const char *filename, int depth)
+{
+    FILE	*fp;
+    char	*buf, *s;
+    long	size;
+    int		line	= 1;
+
+    if(depth > 8) {
+	fprintf(stderr, "%s: #includes nested too deeply\n", filename);
+	return -1;
+    }
+    if((fp = fopen(filename, "r")) == NULL) {
+	perror(filename);
+	return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    size	= ftell(fp);
+    rewind(fp);
+    buf		= calloc(1, size+1);
+    if(fread(buf, 1, size, fp) != (size_t)size) {
+	perror(filename);
+	fclose(fp);
+	free(buf);
+	return -1;
+    }
+    fclose(fp);
+    filename	= strdup(filename);		// kept for error messages
+
+    for(s=buf ; *s ; ) {
+	char	*start;
+
+	if(*s == '\n') {
+	    ++line;
+	    ++s;
+	}
+	else if(isspace((unsigned char)*s) || *s == ',' || *s == ';')
+	    ++s;
+	else if(s[0] == '/' && s[1] == '*') {		// block comment
+	    for(s+=2 ; *s && !(s[0] == '*' && s[1] == '/') ; ++s)
+		if(*s == '\n')
+		    ++line;
+	    if(*s)
+		s += 2;
+	}
+	else if(s[0] == '/' && s[1] == '/') {		// line comment
+	    while(*s && *s != '\n')
+		++s;
+	}
+	else if(strncmp(s, "#include", 8) == 0) {
+	    char	*q, *path;
+	    const char	*slash;
+
+	    for(s+=8 ; *s == ' ' || *s == '\t' ; ++s)
+		;
+	    if(*s != '"' || (q = strchr(s+1, '"')) == NULL) {
+		fprintf(stderr, "%s:%d: bad #include\n", filename, line);
+		return -1;
+	    }
+	    *q		= '\0';
+	    slash	= strrchr(filename, '/');
+	    path	= malloc(strlen(filename) + strlen(s+1) + 2);
+	    if(slash != NULL && s[1] != '/')
+		sprintf(path, "%.*s/%s", (int)(slash-filename), filename, s+1);
+	    else
+		strcpy(path, s+1);
+	    if(tokenize(path, depth+1) != 0)
+		return -1;
+	    free(path);
+	    s		= q+1;
+	}
+	else if(*s == '"') {				// quoted string
+	    start	= ++s;
+	    while(*s && *s != '"' && *s != '\n')
+		++s;
+	    add_token(strndup(start, s-start), filename, line);
+	    if(*s == '"')
+		++s;
+	}
+	else if(*s == '{' || *s == '}' || *s == '=') {
+	    add_token(strndup(s, 1), filename, line);
+	    ++s;
+	}
+	else {						// a word or number
+	    start	= s;
+	    while(*s && !isspace((unsigned char)*s) && !strchr("{}=,;\"", *s))
+		++s;
+	    add_token(strndup(start, s-start), filename, line);
+	}
+    }
+    free(buf);
+    return 0;
+}
+
+static char *peek(int ahead)
+{
+    return (next+ahead < ntokens) ? tokens[next+ahead].text : "";
+}
+
+static void add_attr(char ***attrs, int *nattrs, const char *name,
+			const char *value)
+{
+    char	*pair	= malloc(strlen(name) + strlen(value) + 2);
+
+    sprintf(pair, "%s=%s", name, value);
+    *attrs		= realloc(*attrs, (*nattrs+1)*sizeof(char *));
+    (*attrs)[(*nattrs)++]	= pair;
+}
+
+//  PARSE { name = value ... } INTO THE GIVEN LIST, IGNORING OTHER WORDS
+static int parse_attrblock(char ***attrs, int *nattrs)
+{
+    ++next;					// skip the {
+    while(next < ntokens && strcmp(peek(0), "}") != 0) {
+	if(strcmp(peek(1), "=") == 0) {
+	    add_attr(attrs, nattrs, peek(0), peek(2));
+	    next	+= 3;
+	}
+	else
+	    ++next;
+    }
+    if(next == ntokens) {
+	fprintf(stderr, "missing }\n");
+	return -1;
+    }
+    ++next;					// skip the }
+    return 0;
+}
+
+static int add_node(TOPOLOGY *topo, const char *name)
+{
+    TOPONODE	*n;
+
+    topo->nodes	= realloc(topo->nodes, (topo->nnodes+1)*sizeof(TOPONODE));
+    n		= &topo->nodes[topo->nnodes];
+    memset(n, 0, sizeof(TOPONODE));
+    snprintf(n->name, sizeof(n->name), "%s", name);
+    n->address	= topo->nnodes;
+    return topo->nnodes++;
+}
+
+//  PARSE host NAME { ... }, RECORDING EACH LINK MENTIONED
+static int parse_node(TOPOLOGY *topo, MENTION **mentions, int *nmentions)
+{
+    TOKEN	*t	= &tokens[next];
+    int		n;
+
+    if(topo_findnode(topo, peek(1)) >= 0) {
+	fprintf(stderr, "%s:%d: node '%s' defined twice\n",
+			t->file, t->line, peek(1));
+	return -1;
+    }
+    n		= add_node(topo, peek(1));
+    topo->nodes[n].router	= (strcmp(peek(0), "router") == 0);
+    topo->nodes[n].mobile	= (strcmp(peek(0), "mobile") == 0);
+    topo->nodes[n].accesspoint	= (strcmp(peek(0), "accesspoint") == 0);
+    if(strcmp(peek(2), "{") != 0) {
+	fprintf(stderr, "%s:%d: expected { after %s\n", t->file, t->line,peek(1));
+	return -1;
+    }
+    next	+= 3;
+
+    while(next < ntokens && strcmp(peek(0), "}") != 0) {
+	if(strcmp(peek(1), "to") == 0 && (strcmp(peek(0), "link") == 0 ||
+	   strcmp(peek(0), "wan") == 0 || strcmp(peek(0), "lan") == 0)) {
+	    MENTION	*m;
+
+	    *mentions	= realloc(*mentions, (*nmentions+1)*sizeof(MENTION));
+	    m		= &(*mentions)[(*nmentions)++];
+	    memset(m, 0, sizeof(MENTION));
+	    snprintf(m->from, sizeof(m->from), "%s", topo->nodes[n].name);
+	    snprintf(m->to,   sizeof(m->to),   "%s", peek(2));
+	    m->lan	= (strcmp(peek(0), "lan") == 0);
+	    next	+= 3;
+	    if(strcmp(peek(0), "{") == 0 &&
+		    parse_attrblock(&m->attrs, &m->nattrs) != 0)
+		return -1;
+	}
+	else if(strcmp(peek(0), "wlan") == 0) {
+	    MENTION	*m;
+
+	    *mentions	= realloc(*mentions, (*nmentions+1)*sizeof(MENTION));
+	    m		= &(*mentions)[(*nmentions)++];
+	    memset(m, 0, sizeof(MENTION));
+	    snprintf(m->from, sizeof(m->from), "%s", topo->nodes[n].name);
+	    m->wlan	= 1;
+	    next	+= 1;
+	    if(strcmp(peek(0), "{") == 0 &&
+		    parse_attrblock(&m->attrs, &m->nattrs) != 0)
+		return -1;
+	}
+	else if(strcmp(peek(1), "=") == 0) {
+	    add_attr(&topo->nodes[n].attrs, &topo->nodes[n].nattrs,
+			peek(0), peek(2));
+	    if(strcmp(peek(0), "address") == 0)
+		topo->nodes[n].address	= atoi(peek(2));
+	    next	+= 3;
+	}
+	else
+	    ++next;				// "east of perth", etc.
+    }
+    if(next == ntokens) {
+	fprintf(stderr, "%s:%d: missing } for %s\n",
+			t->file, t->line, topo->nodes[n].name);
+	return -1;
+    }
+    ++next;
+    return 0;
+}
+
+static int add_segment(TOPOLOGY *topo, const char *name, int wireless)
+{
+    TOPOSEGMENT	*seg;
+
+    topo->segments	= realloc(topo->segments,
+				(topo->nsegments+1)*sizeof(TOPOSEGMENT));
+    seg		= &topo->segments[topo->nsegments];
+    memset(seg, 0, sizeof(TOPOSEGMENT));
+    snprintf(seg->name, sizeof(seg->name), "%s", name);
+    seg->wireless	= wireless;
+    return topo->nsegments++;
+}
+
+//  PARSE lansegment NAME { ... }
+static int parse_segment(TOPOLOGY *topo)
+{
+    TOKEN	*t	= &tokens[next];
+    int		s;
+
+    if(topo_findsegment(topo, peek(1)) >= 0) {
+	fprintf(stderr, "%s:%d: lansegment '%s' defined twice\n",
+			t->file, t->line, peek(1));
+	return -1;
+    }
+    if(strcmp(peek(2), "{") != 0) {
+	fprintf(stderr, "%s:%d: expected { after %s\n", t->file, t->line,peek(1));
+	return -1;
+    }
+    s		= add_segment(topo, peek(1), 0);
+    next	+= 2;
+    return parse_attrblock(&topo->segments[s].attrs,
+			   &topo->segments[s].nattrs);
+}
+
+//  FIND AN ATTRIBUTE FOR A LINK: ITS OWN, THEN THE wan- AND PLAIN DEFAULTS
+static const char *link_attr(TOPOLOGY *topo, MENTION *m, const char *name)
+{
+    const char	*v;
+    char	wanname[64];
+
+    if((v = topo_attr(m->attrs, m->nattrs, name)) != NULL)
+	return v;
+    snprintf(wanname, sizeof(wanname), "wan-%s", name);
+    if((v = topo_attr(topo->attrs, topo->nattrs, wanname)) != NULL)
+	return v;
+    return topo_attr(topo->attrs, topo->nattrs, name);
+}
+
+//  FIND AN ATTRIBUTE FOR A SEGMENT: ITS OWN, THEN THE GLOBAL lan- (OR wlan-)
+//  DEFAULT
+static const char *segment_attr(TOPOLOGY *topo, TOPOSEGMENT *seg,
+				const char *name)
+{
+    const char	*v;
+    char	lanname[64];
+
+    snprintf(lanname, sizeof(lanname), "%s-%s",
+		seg->wireless ? "wlan" : "lan", name);
+    if((v = topo_attr(seg->attrs, seg->nattrs, lanname)) != NULL ||
+       (v = topo_attr(seg->attrs, seg->nattrs, name)) != NULL)
+	return v;
+    return topo_attr(topo->attrs, topo->nattrs, lanname);
+}
+
+//  ATTACH THE MENTIONING NODE TO A SEGMENT, AS ITS NEXT LINK
+static int attach(TOPOLOGY *topo, MENTION *m)
+{
+    int		node	= topo_findnode(topo, m->from);
+    int		s	= m->wlan ? -1 : topo_findsegment(topo, m->to);
+    TOPOATTACH	*a;
+
+    if(m->wlan) {			// every wlan shares one medium
+	for(int w=0 ; w<topo->nsegments ; ++w)
+	    if(topo->segments[w].wireless)
+		s	= w;
+	if(s < 0)
+	    s	= add_segment(topo, "wlan", 1);
+    }
+
+    if(s < 0) {
+	fprintf(stderr, "%s has a lan to unknown lansegment '%s'\n",
+			m->from, m->to);
+	return -1;
+    }
+    topo->attaches	= realloc(topo->attaches,
+				(topo->nattaches+1)*sizeof(TOPOATTACH));
+    a		= &topo->attaches[topo->nattaches++];
+    a->node	= node;
+    a->link	= ++topo->nodes[node].nlinks;
+    a->segment	= s;
+    return 0;
+}
+
+//  TURN THE MENTIONS INTO LINKS, PAIRING MENTIONS FROM EACH END
+static int make_links(TOPOLOGY *topo, MENTION *mentions, int nmentions)
+{
+    for(int i=0 ; i<nmentions ; ++i) {
+	MENTION		*m	= &mentions[i];
+	int		from	= topo_findnode(topo, m->from);
+	int		to	= topo_findnode(topo, m->to);
+	int		k	= 0, earlier = 0;
+	const char	*v;
+	TOPOLINK	*l;
+
+	if(m->lan || m->wlan) {
+	    if(attach(topo, m) != 0)
+		return -1;
+	    continue;
+	}
+	if(to < 0) {
+	    fprintf(stderr, "%s has a link to unknown node '%s'\n",
+			    m->from, m->to);
+	    return -1;
+	}
+	for(int j=0 ; j<=i ; ++j) {		// this is our k-th mention of to
+	    if(!mentions[j].lan && strcasecmp(mentions[j].from, m->from) == 0 &&
+	       strcasecmp(mentions[j].to, m->to) == 0)
+		++k;
+	}
+	for(int j=0 ; j<i ; ++j) {		// ... has to mentioned us k times?
+	    if(!mentions[j].lan && strcasecmp(mentions[j].from, m->to) == 0 &&
+	       strcasecmp(mentions[j].to, m->from) == 0)
+		++earlier;
+	}
+	if(earlier >= k)			// the link already exists
+	    continue;
+
+	topo->links	= realloc(topo->links, (topo->nlinks+1)*sizeof(TOPOLINK));
+	l		= &topo->links[topo->nlinks++];
+	l->from		= from;
+	l->to		= to;
+	l->fromlink	= ++topo->nodes[from].nlinks;
+	l->tolink	= ++topo->nodes[to].nlinks;
+	v		= link_attr(topo, m, "propagationdelay");
+	l->delay	= v ? topo_usecs(v) : DEFAULT_DELAY;
+	v		= link_attr(topo, m, "bandwidth");
+	l->bandwidth	= v ? topo_bps(v) : DEFAULT_BANDWIDTH;
+	v		= link_attr(topo, m, "probframeloss");
+	l->probframeloss	= v ? atoi(v) : 0;
+	v		= link_attr(topo, m, "probframecorrupt");
+	l->probframecorrupt	= v ? atoi(v) : 0;
+    }
+
+    for(int s=0 ; s<topo->nsegments ; ++s) {
+	TOPOSEGMENT	*seg	= &topo->segments[s];
+	const char	*v;
+
+	v		= segment_attr(topo, seg, "propagationdelay");
+	seg->delay	= v ? topo_usecs(v) :
+		      seg->wireless ? DEFAULT_WLANDELAY : DEFAULT_LANDELAY;
+	v		= segment_attr(topo, seg, "bandwidth");
+	seg->bandwidth	= v ? topo_bps(v) :
+		      seg->wireless ? DEFAULT_WLANBANDWIDTH : DEFAULT_LANBANDWIDTH;
+	v		= segment_attr(topo, seg, "probframeloss");
+	seg->probframeloss	= v ? atoi(v) : 0;
+	v		= segment_attr(topo, seg, "probframecorrupt");
+	seg->probframecorrupt	= v ? atoi(v) : 0;
+    }
+    return 0;
+}
+
+// -----------------------------------------------------------------
+
+//  READ A TOPOLOGY FILE, RETURNING 0 ON SUCCESS OR -1 (WITH A MESSAGE)
+int topo_read(const char *filename, TOPOLOGY *topo)
+{
+    MENTION	*mentions	= NULL;
+    int		nmentions	= 0;
+    int		result		= 0;
+
+    memset(topo, 0, sizeof(TOPOLOGY));
+    ntokens	= 0;
+    next	= 0;
+    if(tokenize(filename, 0) != 0)
+	return -1;
+
+    while(result == 0 && next < ntokens) {
+	if(strcmp(peek(0), "host") == 0 || strcmp(peek(0), "router") == 0 ||
+	   strcmp(peek(0), "mobile") == 0 ||
+	   strcmp(peek(0), "accesspoint") == 0)
+	    result	= parse_node(topo, &mentions, &nmentions);
+	else if(strcmp(peek(0), "lansegment") == 0)
+	    result	= parse_segment(topo);
+	else if(strcmp(peek(1), "=") == 0) {
+	    add_attr(&topo->attrs, &topo->nattrs, peek(0), peek(2));
+	    next	+= 3;
+	}
+	else {
+	    fprintf(stderr, "%s:%d: unexpected '%s'\n",
+		    tokens[next].file, tokens[next].line, peek(0));
+	    result	= -1;
+	}
+    }
+    if(result == 0)
+	result	= make_links(topo, mentions, nmentions);
+
+    for(int i=0 ; i<nmentions ; ++i) {
+	for(int a=0 ; a<mentions[i].nattrs ; ++a)
+	    free(mentions[i].attrs[a]);
+	free(mentions[i].attrs);
+    }
+    free(mentions);
+    for(int t=0 ; t<ntokens ; ++t)
+	free(tokens[t].text);
+    free(tokens);
+    tokens	= NULL;
+    ntokens	= 0;
+    return result;
+}
+
+void topo_free(TOPOLOGY *topo)
+{
+    for(int n=0 ; n<topo->nnodes ; ++n) {
+	for(int a=0 ; a<topo->nodes[n].nattrs ; ++a)
+	    free(topo->nodes[n].attrs[a]);
+	free(topo->nodes[n].attrs);
+    }
+    for(int s=0 ; s<topo->nsegments ; ++s) {
+	for(int a=0 ; a<topo->segments[s].nattrs ; ++a)
+	    free(topo->segments[s].attrs[a]);
+	free(topo->segments[s].attrs);
+    }
+    for(int a=0 ; a<topo->nattrs ; ++a)
+	free(topo->attrs[a]);
+    free(topo->attrs);
+    free(topo->nodes);
+    free(topo->links);
+    free(topo->segments);
+    free(topo->attaches);
+    memset(topo, 0, sizeof(TOPOLOGY));
+}
+
+int topo_findnode(const TOPOLOGY *topo, const char *name)
+{
+    for(int n=0 ; n<topo->nnodes ; ++n)
+	if(strcasecmp(topo->nodes[n].name, name) == 0)
+	    return n;
+    return -1;
+}
+
+int topo_findsegment(const TOPOLOGY *topo, const char *name)
+{
+    for(int s=0 ; s<topo->nsegments ; ++s)
+	if(strcasecmp(topo->segments[s].name, name) == 0)
+	    return s;
+    return -1;
+}
+
+//  RETURN THE VALUE OF THE LAST name=value PAIR FOR name, OR NULL
+const char *topo_attr(char **attrs, int nattrs, const char *name)
+{
+    size_t	len	= strlen(name);
+
+    for(int a=nattrs-1 ; a>=0 ; --a)
+	if(strncmp(attrs[a], name, len) == 0 && attrs[a][len] == '=')
+	    return &attrs[a][len+1];
+    return NULL;
+}
+
+//  CONVERT A TIME SUCH AS "100ms", "2.5s" OR "2500usec" TO usecs
+int64_t topo_usecs(const char *value)
+{
+    char	*units;
+    double	v	= strtod(value, &units);
+
+    if(strncmp(units, "us", 2) == 0)
+	return (int64_t)v;
+    if(strncmp(units, "ms", 2) == 0)
+	return (int64_t)(v * 1000);
+    if(*units == 's')
+	return (int64_t)(v * 1000000);
+    return (int64_t)v;				// cnet's default is usecs
+}
+
+//  CONVERT A BANDWIDTH SUCH AS "56Kbps" OR "10Mbps" TO bits per second
+int64_t topo_bps(const char *value)
+{
+    char	*units;
+    double	v	= strtod(value, &units);
+
+    switch (toupper((unsigned char)*units)) {
+    case 'K' :	return (int64_t)(v * 1000);
+    case 'M' :	return (int64_t)(v * 1000000);
+    case 'G' :	return (int64_t)(v * 1000000000);
+    }
+    if(strncmp(units, "Bps", 3) == 0)			// bytes per second
+	return (int64_t)(v * 8);
+    return (int64_t)v;
+}
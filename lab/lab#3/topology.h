@@ -0,0 +1,68 @@
+#ifndef _TOPOLOGY_H
+#define _TOPOLOGY_H
+
+#include <stdint.h>
+
+/* ------- DECLARATIONS FOR A READER OF cnet TOPOLOGY FILES -------- */
+
+#define	TOPO_MAXNAME	32
+
+typedef struct {
+    char	name[TOPO_MAXNAME];
+    int		address;		// from "address = N", else node number
+    int		router;			// declared with router, not host
+    int		mobile;			// declared with mobile
+    int		accesspoint;		// declared with accesspoint
+    int		nlinks;			// links are numbered 1..nlinks
+    char	**attrs;		// "name=value" pairs from its block
+    int		nattrs;
+} TOPONODE;
+
+typedef struct {
+    int		from, to;		// node numbers of the two ends
+    int		fromlink, tolink;	// link number at each end
+    int64_t	delay;			// propagation delay, usec
+    int64_t	bandwidth;		// bits per second
+    int		probframeloss;		// 1 frame in 2^N, 0 = never
+    int		probframecorrupt;
+} TOPOLINK;
+
+typedef struct {			// a lansegment, or the wireless medium
+    char	name[TOPO_MAXNAME];
+    int		wireless;		// the medium of every wlan link
+    int64_t	delay;			// propagation delay across it, usec
+    int64_t	bandwidth;		// bits per second
+    int		probframeloss;		// 1 frame in 2^N, 0 = never
+    int		probframecorrupt;
+    char	**attrs;		// "name=value" pairs from its block
+    int		nattrs;
+} TOPOSEGMENT;
+
+typedef struct {			// a node's link to a segment
+    int		node;
+    int		link;			// link number at the node
+    int		segment;
+} TOPOATTACH;
+
+typedef struct {
+    TOPONODE	*nodes;
+    int		nnodes;
+    TOPOLINK	*links;
+    int		nlinks;
+    TOPOSEGMENT	*segments;
+    int		nsegments;
+    TOPOATTACH	*attaches;
+    int		nattaches;
+    char	**attrs;		// global "name=value" pairs
+    int		nattrs;
+} TOPOLOGY;
+
+extern	int		topo_read(const char *filename, TOPOLOGY *topo);
+extern	void		topo_free(TOPOLOGY *topo);
+extern	int		topo_findnode(const TOPOLOGY *topo, const char *name);
+extern	int		topo_findsegment(const TOPOLOGY *topo, const char *name);
+extern	const char	*topo_attr(char **attrs, int nattrs, const char *name);
+extern	int64_t		topo_usecs(const char *value);
+extern	int64_t		topo_bps(const char *value);
+
+#endif
@@ -0,0 +1,332 @@
+#include <cnet.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "twheel.h"
+
+/*  THIS FILE PROVIDES ANY NUMBER OF LOGICAL TIMERS TO A NODE, ALL DRIVEN
+    BY A SINGLE cnet TIMER (TW_EVENT).  STARTING A cnet TIMER PER PACKET OR
+    PER DESTINATION COSTS THE SIMULATOR AN EVENT FOR EVERY ONE OF THEM, AND
+    MOST ARE STOPPED AGAIN BEFORE THEY EXPIRE.
+
+    Timers are held in a hierarchical timing wheel of LEVELS wheels, each
+    of SLOTS slots.  Time is counted in ticks of TW_TICK usecs.  A timer
+    due within SLOTS ticks waits in the level 0 slot for its tick; one due
+    later waits in the slot, of the lowest level that can hold it, for its
+    block of SLOTS^level ticks.  When the wheel reaches the start of that
+    block the slot is cascaded - its timers move down to a lower level -
+    so each timer moves at most LEVELS-1 times.  Each slot is a doubly
+    linked list, so both tw_start() and tw_stop() take constant time, and
+    a bitmap of occupied slots finds the next one with a few
+    count-trailing-zeros instructions.
+
+    The one cnet timer is only ever running for the earliest tick at which
+    a timer expires or a slot must be cascaded.  Stopping a timer does not
+    touch it: if it has nothing to do when it expires, it is simply
+    started again for the next such tick.
+ */
+
+#define	LEVELS		4
+#define	SHIFT		8
+#define	SLOTS		(1 << SHIFT)		// per level
+#define	MASK		(SLOTS - 1)
+#define	MAXDELAY	(((int64_t)1 << (LEVELS*SHIFT)) - 1)	// ticks
+
+#define	BITS		64
+#define	WORDS		(SLOTS / BITS)
+#define	BIT(n)		((uint64_t)1 << (n))
+#define	CTZ(w)		__builtin_ctzll(w)
+
+#define	INDEXBITS	20			// of a TW_TIMER handle
+#define	MAXTIMERS	(1 << INDEXBITS)
+#define	MAXGEN		((1 << (31-INDEXBITS)) - 1)
+#define	NEVER		INT64_MAX
+
+typedef struct {
+    int64_t	expires;		// tick
+    TW_HANDLER	handler;
+    CnetData	data;
+    int32_t	next;			// in its slot, or on the free list
+    int32_t	prev;
+    int16_t	gen;			// of the handle, to detect stale ones
+    int8_t	level;			// -1 when not running
+    uint8_t	slot;
+} TWENTRY;
+
+static	TWENTRY		*entries	= NULL;	// [0] is never used
+static	int		nentries	= 0;
+static	int		maxentries	= 0;
+static	int		freelist	= 0;
+
+static	int32_t		slots[LEVELS][SLOTS];	// first entry, or 0
+static	uint64_t	occupied[LEVELS][WORDS];
+
+static	int64_t		now		= 0;	// the wheel has turned to
+static	bool		turning		= false;
+static	CnetTimerID	wakeup		= NULLTIMER;
+static	int64_t		wakeup_tick	= NEVER;
+
+static	int64_t		nstarted, nstopped, nfired, ncascaded;	// statistics
+static	int64_t		nwakeups, nrearmed;
+static	int		npending, maxpending;
+
+// -----------------------------------------------------------------
+
+static void link_entry(int i, int level, int slot)
+{
+    TWENTRY	*e	= &entries[i];
+
+    e->level	= level;
+    e->slot	= slot;
+    e->prev	= 0;
+    e->next	= slots[level][slot];
+    if(e->next != 0)
+	entries[e->next].prev	= i;
+    slots[level][slot]	= i;
+    occupied[level][slot / BITS]	|= BIT(slot % BITS);
+}
+
+static void unlink_entry(int i)
+{
+    TWENTRY	*e	= &entries[i];
+
+    if(e->prev != 0)
+	entries[e->prev].next	= e->next;
+    else {
+	slots[e->level][e->slot]	= e->next;
+	if(e->next == 0)
+	    occupied[e->level][e->slot / BITS] &= ~BIT(e->slot % BITS);
+    }
+    if(e->next != 0)
+	entries[e->next].prev	= e->prev;
+    e->level	= -1;
+}
+
+//  PLACE A TIMER IN THE LOWEST LEVEL THAT CAN HOLD IT, RELATIVE TO now
+static void place(int i)
+{
+    int64_t	exp	= entries[i].expires;
+    int64_t	delay	= exp - now;
+    int		level	= 0;
+
+    while(level < LEVELS-1 && delay >= ((int64_t)1 << ((level+1)*SHIFT)))
+	++level;
+    link_entry(i, level, (int)((exp >> (level*SHIFT)) & MASK));
+}
+
+//  THE DISTANCE FROM slot start TO THE NEXT OCCUPIED SLOT OF A LEVEL, OR -1
+static int next_occupied(const uint64_t *bits, int start)
+{
+    for(int i=0 ; i<=WORDS ; ++i) {
+	int		word	= (start/BITS + i) % WORDS;
+	uint64_t	w	= bits[word];
+
+	if(i == 0)
+	    w	&= ~(uint64_t)0 << (start % BITS);
+	else if(i == WORDS)			// back to where we started
+	    w	&= ~(~(uint64_t)0 << (start % BITS));
+	if(w != 0)
+	    return (word*BITS + CTZ(w) - start + SLOTS) % SLOTS;
+    }
+    return -1;
+}
+
+/*  THE NEXT TICK AT WHICH A TIMER EXPIRES OR A SLOT MUST BE CASCADED.
+    level 0 HOLDS THE TICKS now+1 .. now+SLOTS-1, AND EACH HIGHER LEVEL
+    THE NEXT SLOTS BLOCKS AFTER THE ONE HOLDING now.
+ */
+static int64_t next_tick(void)
+{
+    int64_t	best	= NEVER;
+    int		d;
+
+    if((d = next_occupied(occupied[0], (int)((now+1) & MASK))) >= 0)
+	best	= now + 1 + d;
+    for(int level=1 ; level<LEVELS ; ++level) {
+	int64_t	block	= now >> (level*SHIFT);
+
+	if((d = next_occupied(occupied[level], (int)((block+1) & MASK))) >= 0)
+	    if(best > ((block + 1 + d) << (level*SHIFT)))
+		best	= (block + 1 + d) << (level*SHIFT);
+    }
+    return best;
+}
+
+//  ENSURE THAT OUR ONE cnet TIMER EXPIRES AT THE NEXT TICK OF INTEREST
+static void rearm(void)
+{
+    int64_t	tick	= next_tick();
+    CnetTime	usecs;
+
+    if(tick >= wakeup_tick)
+	return;
+    if(wakeup != NULLTIMER)
+	CNET_stop_timer(wakeup);
+    usecs	= tick * TW_TICK - nodeinfo.time_in_usec;
+    wakeup	= CNET_start_timer(TW_EVENT, usecs > 0 ? usecs : 1, 0);
+    wakeup_tick	= tick;
+    ++nrearmed;
+}
+
+// -----------------------------------------------------------------
+
+//  TURN THE WHEEL TO tick, CASCADING SLOTS AND CALLING EXPIRED TIMERS
+static void advance(int64_t tick)
+{
+    int64_t	t;
+    int		i;
+
+    turning	= true;
+    while((t = next_tick()) <= tick) {
+	now	= t;
+	for(int level=LEVELS-1 ; level>0 ; --level) {
+	    int	shift	= level*SHIFT;
+
+	    if((t & (((int64_t)1 << shift) - 1)) != 0)
+		continue;
+	    while((i = slots[level][(t >> shift) & MASK]) != 0) {
+		unlink_entry(i);
+		place(i);
+		++ncascaded;
+	    }
+	}
+//  A HANDLER MAY START OR STOP OTHER TIMERS, SO TAKE ONE AT A TIME
+	while((i = slots[0][t & MASK]) != 0) {
+	    TWENTRY	*e	= &entries[i];
+	    TW_TIMER	handle	= (e->gen << INDEXBITS) | i;
+
+	    unlink_entry(i);
+	    e->gen	= (e->gen % MAXGEN) + 1;
+	    e->next	= freelist;
+	    freelist	= i;
+	    --npending;
+	    ++nfired;
+	    e->handler(handle, e->data);
+	}
+    }
+    if(now < tick)
+	now	= tick;
+    turning	= false;
+}
+
+//  TW_EVENT - THE WHEEL HAS A TIMER TO CALL, OR A SLOT TO CASCADE
+static EVENT_HANDLER(wheel_turns)
+{
+    ++nwakeups;
+    wakeup	= NULLTIMER;
+    wakeup_tick	= NEVER;
+    advance(nodeinfo.time_in_usec / TW_TICK);
+    rearm();
+}
+
+// -----------------------------------------------------------------
+
+/*  tw_start() CALLS handler(timer, data) AFTER usecs, ROUNDED UP TO THE
+    NEXT TICK.  THE RETURNED HANDLE MAY BE GIVEN TO tw_stop() EVEN AFTER
+    THE TIMER HAS EXPIRED.
+ */
+TW_TIMER tw_start(CnetTime usecs, TW_HANDLER handler, CnetData data)
+{
+    int64_t	exp	= (nodeinfo.time_in_usec + usecs + TW_TICK-1) / TW_TICK;
+    TWENTRY	*e;
+    int		i;
+
+    if(exp <= now)
+	exp	= now + 1;
+    if(exp - now > MAXDELAY)
+	exp	= now + MAXDELAY;
+
+    if(freelist != 0) {
+	i		= freelist;
+	freelist	= entries[i].next;
+    }
+    else {
+	if(nentries == MAXTIMERS) {
+	    fprintf(stderr, "%s: more than %d timers\n",
+			nodeinfo.nodename, MAXTIMERS-1);
+	    CNET_exit(__FILE__, __func__, __LINE__);
+	}
+	if(nentries == maxentries) {
+	    maxentries	= (maxentries == 0) ? 64 : 2*maxentries;
+	    entries	= realloc(entries, maxentries * sizeof(TWENTRY));
+	}
+	if(nentries == 0)
+	    nentries	= 1;			// entry 0 marks an empty slot
+	i		= nentries++;
+	entries[i].gen	= 1;
+    }
+    e		= &entries[i];
+    e->expires	= exp;
+    e->handler	= handler;
+    e->data	= data;
+    place(i);
+
+    ++nstarted;
+    if(maxpending < ++npending)
+	maxpending	= npending;
+    if(!turning)
+	rearm();
+    return (e->gen << INDEXBITS) | i;
+}
+
+//  STOP A RUNNING TIMER, RETURNING false IF IT HAD ALREADY EXPIRED
+bool tw_stop(TW_TIMER timer)
+{
+    int		i	= timer & (MAXTIMERS-1);
+    TWENTRY	*e;
+
+    if(timer == TW_NULLTIMER || i >= nentries)
+	return false;
+    e	= &entries[i];
+    if(e->level < 0 || e->gen != (timer >> INDEXBITS))
+	return false;
+    unlink_entry(i);
+    e->gen	= (e->gen % MAXGEN) + 1;
+    e->next	= freelist;
+    freelist	= i;
+    --npending;
+    ++nstopped;
+    return true;
+}
+
+//  THE NUMBER OF TIMERS STILL RUNNING
+int tw_pending(void)
+{
+    return npending;
+}
+
+/*  THE WHEEL'S STATISTICS, INCLUDING HOW MANY cnet TIMER EVENTS IT HAS
+    COST THE SIMULATOR PER SECOND, AGAINST THE LOGICAL TIMERS IT HAS RUN.
+ */
+void tw_showstats(void)
+{
+    double	secs	= nodeinfo.time_in_usec / 1000000.0;
+
+    printf("\n%10s %10s %10s %10s %8s %8s\n",
+		"started", "stopped", "fired", "cascaded", "pending", "maxpend");
+    printf("%10lld %10lld %10lld %10lld %8d %8d\n",
+		(long long)nstarted, (long long)nstopped, (long long)nfired,
+		(long long)ncascaded, npending, maxpending);
+    printf("%.2f timers/sec started, on %.2f cnet timer events/sec "
+	   "(%lld restarts)\n",
+		secs > 0 ? nstarted / secs : 0.0,
+		secs > 0 ? nwakeups / secs : 0.0, (long long)nrearmed);
+}
+
+void reboot_twheel(void)
+{
+    free(entries);
+    entries	= NULL;
+    freelist	= 0;
+    nentries	= 0;
+    maxentries	= 0;
+    memset(slots, 0, sizeof(slots));
+    memset(occupied, 0, sizeof(occupied));
+    now		= nodeinfo.time_in_usec / TW_TICK;
+    turning	= false;
+    wakeup	= NULLTIMER;
+    wakeup_tick	= NEVER;
+    npending	= 0;
+
+    CHECK(CNET_set_handler(TW_EVENT, wheel_turns, 0));
+}
@@ -0,0 +1,18 @@
+#include <cnet.h>
+
+/* ------- DECLARATIONS FOR MANY LOGICAL TIMERS ON ONE cnet TIMER -------- */
+
+#define	TW_EVENT	EV_TIMER6	// the only cnet timer the wheel uses
+#define	TW_TICK		1000		// usecs, the resolution of the wheel
+
+typedef	int32_t		TW_TIMER;	// a handle, never TW_NULLTIMER
+#define	TW_NULLTIMER	0
+
+typedef	void		(*TW_HANDLER)(TW_TIMER timer, CnetData data);
+
+extern	void		reboot_twheel(void);
+extern	TW_TIMER	tw_start(CnetTime usecs, TW_HANDLER handler,
+				 CnetData data);
+extern	bool		tw_stop(TW_TIMER timer);
+extern	int		tw_pending(void);
+extern	void		tw_showstats(void);
@@ -0,0 +1,229 @@
+#ifndef _ARQ_H
+#define _ARQ_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "header.h"
+
+/* ------- ARQ POLICIES OF THE LAYERED STACK --------
+
+   An ARQ policy is a class template, given the window size W and the
+   sequence space M of the header format, of which one object per link
+   holds the state of both the sender and the receiver.  Its methods are
+   given the stack's link L, which provides:
+
+	l.transmit(kind, seq)	queue a DL_DATA or DL_ACK frame to be written
+	l.deliver(packet, len)	pass a packet up to the network layer,
+				which may rewrite its header in place
+	l.acked(outstanding)	the oldest frame sent has been acknowledged
+
+   A DL_DATA frame is only built when the link is free to write it, when
+   its packet is fetched with payload(), so a frame acknowledged while it
+   is still queued is not written at all.  The link owns the timer, which
+   calls timeout().
+ */
+
+//  A PACKET HELD BY THE DATALINK LAYER, IN A BUFFER THAT IS REUSED
+struct Buffer {
+    char	*data	= nullptr;
+    size_t	len	= 0;
+    size_t	cap	= 0;
+
+    Buffer() = default;
+    Buffer(const Buffer &) = delete;
+    ~Buffer()	{ free(data); }
+
+    void set(const char *p, size_t n)
+    {
+	if(n > cap) {
+	    data	= (char *)realloc(data, n);
+	    cap		= n;
+	}
+	memcpy(data, p, n);
+	len	= n;
+    }
+};
+
+//  THE DISTANCE FROM from FORWARD TO to, IN A SEQUENCE SPACE OF M
+template <unsigned M>
+inline unsigned seqdist(unsigned from, unsigned to)
+{
+    return (to - from) & (M-1);
+}
+
+// -----------------------------------------------------------------
+
+/*  GO-BACK-N: THE RECEIVER ACCEPTS ONLY THE FRAME IT EXPECTS, AND ANSWERS
+    EVERY FRAME WITH THE SEQUENCE NUMBER IT NEXT EXPECTS (A CUMULATIVE ACK).
+    ON A TIMEOUT THE SENDER RESENDS EVERY FRAME OUTSTANDING.
+ */
+template <int W, unsigned M>
+class GoBackN {
+    static_assert((M & (M-1)) == 0 && M % W == 0, "W must divide M, 2^n");
+    static_assert((unsigned)W < M, "the window must be less than M");
+
+public:
+    static constexpr const char	*name		= "gbn";
+    static constexpr bool	CUMULATIVE	= true;
+
+    bool full() const	{ return outstanding == W; }
+
+    const char *payload(unsigned seq, size_t *len) const
+    {
+	if(seqdist<M>(base, seq) >= (unsigned)outstanding)
+	    return nullptr;			// acknowledged since queued
+	*len	= slot[seq % W].len;
+	return slot[seq % W].data;
+    }
+
+    template <class L> void send(L &l, const char *packet, size_t len)
+    {
+	unsigned	seq	= (base + outstanding) & (M-1);
+
+	slot[seq % W].set(packet, len);
+	++outstanding;
+	l.transmit(DL_DATA, seq);
+    }
+
+    template <class L> void ack(L &l, unsigned seq)
+    {
+	unsigned	d	= seqdist<M>(base, seq);
+
+	if(d == 0 || d > (unsigned)outstanding)
+	    return;				// a duplicate, or stale
+	base		= seq;
+	outstanding	-= d;
+	l.acked(outstanding);
+    }
+
+    template <class L> void timeout(L &l)
+    {
+	for(int i=0 ; i<outstanding ; ++i)
+	    l.transmit(DL_DATA, (base + i) & (M-1));
+    }
+
+    template <class L> void data(L &l, unsigned seq, char *packet,
+				 size_t len)
+    {
+	bool	inorder	= (seq == expected);
+
+	if(inorder)
+	    expected	= (expected + 1) & (M-1);
+	l.transmit(DL_ACK, expected);
+	if(inorder)
+	    l.deliver(packet, len);
+    }
+
+private:
+    Buffer	slot[W];			// by seq % W
+    unsigned	base		= 0;		// oldest unacknowledged
+    int		outstanding	= 0;
+    unsigned	expected	= 0;
+};
+
+//  STOP-AND-WAIT, AS IN lab#2's stopandwait.c, IS GO-BACK-1
+template <int W, unsigned M>
+class StopAndWait : public GoBackN<1, M> {
+public:
+    static constexpr const char	*name	= "saw";
+};
+
+/*  SELECTIVE REPEAT: THE RECEIVER ACCEPTS AND HOLDS ANY FRAME WITHIN ITS
+    WINDOW, AND ACKNOWLEDGES EACH FRAME BY ITS OWN SEQUENCE NUMBER.  ON A
+    TIMEOUT THE SENDER RESENDS ONLY THE FRAMES NOT YET ACKNOWLEDGED.
+ */
+template <int W, unsigned M>
+class SelectiveRepeat {
+    static_assert((M & (M-1)) == 0 && M % W == 0, "W must divide M, 2^n");
+    static_assert(2 * (unsigned)W <= M, "the window must be at most M/2");
+
+public:
+    static constexpr const char	*name		= "sr";
+    static constexpr bool	CUMULATIVE	= false;
+
+    bool full() const	{ return outstanding == W; }
+
+    const char *payload(unsigned seq, size_t *len) const
+    {
+	if(seqdist<M>(base, seq) >= (unsigned)outstanding || acked[seq % W])
+	    return nullptr;
+	*len	= slot[seq % W].len;
+	return slot[seq % W].data;
+    }
+
+    template <class L> void send(L &l, const char *packet, size_t len)
+    {
+	unsigned	seq	= (base + outstanding) & (M-1);
+
+	slot[seq % W].set(packet, len);
+	acked[seq % W]	= false;
+	++outstanding;
+	l.transmit(DL_DATA, seq);
+    }
+
+    template <class L> void ack(L &l, unsigned seq)
+    {
+	if(seqdist<M>(base, seq) >= (unsigned)outstanding)
+	    return;
+	acked[seq % W]	= true;
+	if(seq != base)
+	    return;
+	while(outstanding > 0 && acked[base % W]) {
+	    base	= (base + 1) & (M-1);
+	    --outstanding;
+	}
+	l.acked(outstanding);
+    }
+
+    template <class L> void timeout(L &l)
+    {
+	for(int i=0 ; i<outstanding ; ++i) {
+	    unsigned	seq	= (base + i) & (M-1);
+
+	    if(!acked[seq % W])
+		l.transmit(DL_DATA, seq);
+	}
+    }
+
+    template <class L> void data(L &l, unsigned seq, char *packet,
+				 size_t len)
+    {
+	unsigned	d	= seqdist<M>(expected, seq);
+
+	if(d >= (unsigned)W) {			// already delivered?
+	    if(d >= M - W)
+		l.transmit(DL_ACK, seq);	// then our ACK was lost
+	    return;
+	}
+	l.transmit(DL_ACK, seq);
+	if(d > 0) {				// hold it until the gap fills
+	    if(!held[seq % W]) {
+		early[seq % W].set(packet, len);
+		held[seq % W]	= true;
+	    }
+	    return;
+	}
+	expected	= (expected + 1) & (M-1);
+	l.deliver(packet, len);
+	while(held[expected % W]) {
+	    Buffer	&b	= early[expected % W];
+
+	    held[expected % W]	= false;
+	    expected	= (expected + 1) & (M-1);
+	    l.deliver(b.data, b.len);
+	}
+    }
+
+private:
+    Buffer	slot[W];			// sent, by seq % W
+    bool	acked[W]	= {};
+    unsigned	base		= 0;
+    int		outstanding	= 0;
+
+    Buffer	early[W];			// received out of order
+    bool	held[W]		= {};
+    unsigned	expected	= 0;
+};
+
+#endif
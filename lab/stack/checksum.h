@@ -0,0 +1,70 @@
+#ifndef _CHECKSUM_H
+#define _CHECKSUM_H
+
+#include <cnet.h>
+
+/* ------- CHECKSUM POLICIES OF THE LAYERED STACK --------
+
+   A checksum is appended to each frame as a trailer of SIZE bytes, most
+   significant byte first, and covers all of the frame before it.
+ */
+
+struct CCITT {				// as our labs, with CNET_ccitt()
+    static constexpr const char	*name	= "ccitt";
+    static constexpr size_t	SIZE	= 2;
+
+    static uint32_t sum(const unsigned char *p, size_t n)
+    {
+	return (uint16_t)CNET_ccitt(const_cast<unsigned char *>(p), (int)n);
+    }
+};
+
+struct CRC32 {
+    static constexpr const char	*name	= "crc32";
+    static constexpr size_t	SIZE	= 4;
+
+    static uint32_t sum(const unsigned char *p, size_t n)
+    {
+	return CNET_crc32(const_cast<unsigned char *>(p), (int)n);
+    }
+};
+
+//  THE 16-BIT ONES' COMPLEMENT SUM OF IP, UDP AND TCP (RFC 1071)
+struct Internet16 {
+    static constexpr const char	*name	= "inet16";
+    static constexpr size_t	SIZE	= 2;
+
+    static uint32_t sum(const unsigned char *p, size_t n)
+    {
+	uint32_t	s	= 0;
+
+	for( ; n > 1 ; p += 2, n -= 2)
+	    s	+= (p[0] << 8) | p[1];
+	if(n > 0)
+	    s	+= p[0] << 8;
+	while(s >> 16)
+	    s	= (s & 0xffff) + (s >> 16);
+	return ~s & 0xffff;
+    }
+};
+
+// -----------------------------------------------------------------
+
+template <class CHECKSUM>
+inline void put_checksum(unsigned char *p, uint32_t sum)
+{
+    for(int i=CHECKSUM::SIZE-1 ; i>=0 ; --i, sum >>= 8)
+	p[i]	= sum & 0xff;
+}
+
+template <class CHECKSUM>
+inline uint32_t get_checksum(const unsigned char *p)
+{
+    uint32_t	sum	= 0;
+
+    for(size_t i=0 ; i<CHECKSUM::SIZE ; ++i)
+	sum	= (sum << 8) | p[i];
+    return sum;
+}
+
+#endif
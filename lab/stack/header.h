@@ -0,0 +1,133 @@
+#ifndef _HEADER_H
+#define _HEADER_H
+
+#include <cnet.h>
+#include <string.h>
+
+/* ------- HEADER FORMAT POLICIES OF THE LAYERED STACK --------
+
+   A header policy encodes and decodes the datalink layer's header, at the
+   start of each frame, and the network layer's header, at the start of
+   each packet.  Their fields are given, decoded, in a DLHEADER and an
+   NLHEADER, and the policy declares the range of each that it can carry.
+ */
+
+enum { DL_DATA, DL_ACK };
+enum { NL_DATA, NL_ACK };
+
+typedef struct {
+    int		kind;			// DL_DATA or DL_ACK
+    unsigned	seq;			// 0 .. SEQMOD-1
+    size_t	len;			// of the packet carried, if any
+} DLHEADER;
+
+typedef struct {
+    int		kind;			// NL_DATA or NL_ACK
+    CnetAddr	src;
+    CnetAddr	dest;
+    unsigned	seq;			// 0 .. NLSEQMOD-1, by destination
+    unsigned	attempt;		// 0 .. ATTEMPTMOD-1, by retransmission
+    int		hops;			// 0 .. MAXHOPS
+} NLHEADER;
+
+//  FIELDS OF int, AS IN THE FRAME AND NL_PACKET STRUCTURES OF OUR LABS
+struct WideHeader {
+    static constexpr const char	*name		= "wide";
+    static constexpr size_t	DLSIZE		= 3 * sizeof(int);
+    static constexpr size_t	NLSIZE		= 6 * sizeof(int);
+    static constexpr unsigned	SEQMOD		= 1u << 16;
+    static constexpr unsigned	NLSEQMOD	= 1u << 30;
+    static constexpr unsigned	ATTEMPTMOD	= 1u << 30;
+    static constexpr int	MAXHOPS		= 1 << 30;
+
+    static void put_dl(unsigned char *p, const DLHEADER &h)
+    {
+	int	f[3]	= { h.kind, (int)h.seq, (int)h.len };
+
+	memcpy(p, f, sizeof(f));
+    }
+
+    //  THE LENGTH CARRIED MUST AGREE WITH THAT OF THE FRAME RECEIVED
+    static bool get_dl(const unsigned char *p, size_t len, DLHEADER &h)
+    {
+	int	f[3];
+
+	memcpy(f, p, sizeof(f));
+	h.kind	= f[0];
+	h.seq	= (unsigned)f[1] % SEQMOD;
+	h.len	= (size_t)f[2];
+	return (h.kind == DL_DATA || h.kind == DL_ACK) && h.len == len;
+    }
+
+    static void put_nl(unsigned char *p, const NLHEADER &h)
+    {
+	int	f[6]	= { h.src, h.dest, h.kind, (int)h.seq,
+			    (int)h.attempt, h.hops };
+
+	memcpy(p, f, sizeof(f));
+    }
+
+    static void get_nl(const unsigned char *p, NLHEADER &h)
+    {
+	int	f[6];
+
+	memcpy(f, p, sizeof(f));
+	h.src		= f[0];
+	h.dest		= f[1];
+	h.kind		= f[2];
+	h.seq		= (unsigned)f[3] % NLSEQMOD;
+	h.attempt	= (unsigned)f[4] % ATTEMPTMOD;
+	h.hops		= f[5];
+    }
+};
+
+/*  AS FEW BYTES AS WILL DO: ONE FOR THE DATALINK HEADER (kind:1, seq:7),
+    AND SEVEN FOR THE NETWORK HEADER (src:16, dest:16, seq:16, and kind:1,
+    attempt:3, hops:4).  THE LENGTH IS THAT OF THE FRAME, AND ADDRESSES
+    MUST FIT IN 16 BITS.
+ */
+struct PackedHeader {
+    static constexpr const char	*name		= "packed";
+    static constexpr size_t	DLSIZE		= 1;
+    static constexpr size_t	NLSIZE		= 7;
+    static constexpr unsigned	SEQMOD		= 1u << 7;
+    static constexpr unsigned	NLSEQMOD	= 1u << 16;
+    static constexpr unsigned	ATTEMPTMOD	= 1u << 3;
+    static constexpr int	MAXHOPS		= (1 << 4) - 1;
+
+    static void put_dl(unsigned char *p, const DLHEADER &h)
+    {
+	p[0]	= (h.kind << 7) | (h.seq & (SEQMOD-1));
+    }
+
+    static bool get_dl(const unsigned char *p, size_t len, DLHEADER &h)
+    {
+	h.kind	= p[0] >> 7;
+	h.seq	= p[0] & (SEQMOD-1);
+	h.len	= len;
+	return true;
+    }
+
+    static void put_nl(unsigned char *p, const NLHEADER &h)
+    {
+	p[0]	= h.src >> 8;
+	p[1]	= h.src & 0xff;
+	p[2]	= h.dest >> 8;
+	p[3]	= h.dest & 0xff;
+	p[4]	= h.seq >> 8;
+	p[5]	= h.seq & 0xff;
+	p[6]	= (h.kind << 7) | ((h.attempt & (ATTEMPTMOD-1)) << 4) | h.hops;
+    }
+
+    static void get_nl(const unsigned char *p, NLHEADER &h)
+    {
+	h.src		= (p[0] << 8) | p[1];
+	h.dest		= (p[2] << 8) | p[3];
+	h.seq		= (p[4] << 8) | p[5];
+	h.kind		= p[6] >> 7;
+	h.attempt	= (p[6] >> 4) & (ATTEMPTMOD-1);
+	h.hops		= p[6] & MAXHOPS;
+    }
+};
+
+#endif
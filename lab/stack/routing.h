@@ -0,0 +1,74 @@
+#ifndef _ROUTING_H
+#define _ROUTING_H
+
+#include <cnet.h>
+#include <unordered_map>
+
+/* ------- ROUTING POLICIES OF THE LAYERED STACK --------
+
+   A routing policy is told of every packet that arrives, by learn(), and
+   chooses the links on which to send each packet, by route(), which calls
+   forward(link) once for each.  A packet is never sent after MAXHOPS hops.
+ */
+
+//  ON EVERY LINK BUT THE ONE IT ARRIVED ON, AS lab#3's flooding2.c
+template <int HOPS>
+class Flooding {
+public:
+    static constexpr const char	*name		= "flood";
+    static constexpr int	MAXHOPS		= HOPS;
+
+    void learn(CnetAddr src, int hops, int link)
+    {
+    }
+
+    template <class F> void route(CnetAddr dest, int arrived, F &&forward)
+    {
+	for(int link=1 ; link<=nodeinfo.nlinks ; ++link)
+	    if(link != arrived)
+		forward(link);
+    }
+};
+
+/*  BACK ALONG THE LINK ON WHICH PACKETS FROM THE DESTINATION HAVE ARRIVED
+    IN THE FEWEST HOPS, AS lab#3's flooding3.c AND lab3.c, FLOODING ONLY
+    WHILE NO PACKET FROM IT HAS BEEN SEEN.
+ */
+template <int HOPS>
+class ReversePath {
+public:
+    static constexpr const char	*name		= "revpath";
+    static constexpr int	MAXHOPS		= HOPS;
+
+    void learn(CnetAddr src, int hops, int link)
+    {
+	ROUTE	&r	= table[src];
+
+	if(r.link == 0 || hops < r.hops || link == r.link) {
+	    r.hops	= hops;
+	    r.link	= link;
+	}
+    }
+
+    template <class F> void route(CnetAddr dest, int arrived, F &&forward)
+    {
+	auto	r	= table.find(dest);
+
+	if(r != table.end() && r->second.link != arrived)
+	    forward(r->second.link);
+	else
+	    for(int link=1 ; link<=nodeinfo.nlinks ; ++link)
+		if(link != arrived)
+		    forward(link);
+    }
+
+private:
+    typedef struct {
+	int	hops;
+	int	link;			// 0 if none known
+    } ROUTE;
+
+    std::unordered_map<CnetAddr, ROUTE>	table;
+};
+
+#endif
@@ -0,0 +1,34 @@
+#include "stack.h"
+
+/*  ONE CONFIGURATION OF THE LAYERED STACK, AS A cnet PROTOCOL, CHOSEN WITH
+    -D WHEN IT IS COMPILED, e.g. WITH cnetsim:
+
+	CC=c++ ../cnetsim/cnetsim -q -s -D STACK_ARQ=SelectiveRepeat STACK
+ */
+
+#ifndef	STACK_ARQ
+#define	STACK_ARQ	GoBackN
+#endif
+#ifndef	STACK_WINDOW
+#define	STACK_WINDOW	8
+#endif
+#ifndef	STACK_CHECKSUM
+#define	STACK_CHECKSUM	CRC32
+#endif
+#ifndef	STACK_ROUTING
+#define	STACK_ROUTING	ReversePath
+#endif
+#ifndef	STACK_HEADER
+#define	STACK_HEADER	PackedHeader
+#endif
+#ifndef	MAXHOPS
+#define	MAXHOPS		4
+#endif
+
+typedef Stack<STACK_ARQ, STACK_WINDOW, STACK_CHECKSUM,
+	      STACK_ROUTING<MAXHOPS>, STACK_HEADER>	STACK;
+
+extern "C" EVENT_HANDLER(reboot_node)
+{
+    STACK::reboot(ev, timer, data);
+}
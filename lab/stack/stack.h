@@ -0,0 +1,475 @@
+#ifndef _STACK_H
+#define _STACK_H
+
+#include <cnet.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+#include "arq.h"
+#include "checksum.h"
+#include "header.h"
+#include "routing.h"
+
+/*  THIS IS A LAYERED STACK WHOSE ARQ SCHEME, WINDOW, CHECKSUM, ROUTING AND
+    HEADER FORMAT ARE TEMPLATE PARAMETERS, SO THAT EACH CONFIGURATION IS
+    COMPILED TO CODE OF ITS OWN, WITH NO INDIRECT CALLS BETWEEN THE LAYERS:
+
+	Stack<GoBackN, 8, CRC32, ReversePath<4>, PackedHeader>
+
+    The network layer sends one packet at a time to each destination, as
+    our labs do, and retransmits it if its NL_ACK does not return in time.
+    Each packet is routed by the ROUTING policy, and sent on each link by
+    the datalink layer's ARQ policy, framed with the HEADER policy and
+    protected by the CHECKSUM policy.  Packets awaiting a link's window are
+    held in a queue of up to QUEUELEN, beyond which they are dropped.
+
+    Each node's stack is an object, passed to its handlers as their
+    CnetData, so that many nodes may share one copy of the code (as in
+    stackbench).  Its handlers are:
+
+	EV_APPLICATIONREADY	down_to_network
+	EV_PHYSICALREADY	up_to_datalink
+	EV_TIMER1		datalink_timeout	(data is the link)
+	EV_TIMER2		network_timeout		(data is the peer)
+	EV_TIMER3		link_ready		(data is the link)
+ */
+
+#define	QUEUELEN	64		// packets held awaiting each link's window
+#define	NL_RTO		3000000		// usecs, before a round trip is measured
+#define	NL_MAXRTO	60000000
+
+typedef struct {
+    int64_t	dl_retransmitted;	// frames
+    int64_t	dl_dropped;		// packets, their link's queue full
+    int64_t	dl_corrupted;		// frames failing the checksum
+    int64_t	nl_retransmitted;	// packets
+} STACKSTATS;
+
+template <template <int, unsigned> class ARQ, int WINDOW,
+	  class CHECKSUM, class ROUTING, class HEADER>
+class Stack {
+    static_assert(ROUTING::MAXHOPS <= HEADER::MAXHOPS,
+			"the header cannot count so many hops");
+
+    static constexpr size_t	MAXFRAME	= HEADER::DLSIZE +
+			HEADER::NLSIZE + MAX_MESSAGE_SIZE + CHECKSUM::SIZE;
+
+    typedef ARQ<WINDOW, HEADER::SEQMOD>	LINKARQ;
+
+public:
+    STACKSTATS		stats	= {};
+
+    //  EVERY NODE'S STACK OF THIS CONFIGURATION, IN THIS PROCESS
+    static inline std::vector<Stack *>	nodes;
+
+    static EVENT_HANDLER(reboot)
+    {
+	Stack	*s	= new Stack();
+
+	nodes.push_back(s);
+	CHECK(CNET_set_handler(EV_APPLICATIONREADY, down_to_network,
+				(CnetData)s));
+	CHECK(CNET_set_handler(EV_PHYSICALREADY, up_to_datalink, (CnetData)s));
+	CHECK(CNET_set_handler(EV_TIMER1, datalink_timeout, 0));
+	CHECK(CNET_set_handler(EV_TIMER2, network_timeout, 0));
+	CHECK(CNET_set_handler(EV_TIMER3, link_ready, 0));
+	CNET_enable_application(ALLNODES);
+    }
+
+    static void name(char *buf, size_t size)
+    {
+	snprintf(buf, size, "%s%d-%s-%s%d-%s", LINKARQ::name,
+		(int)WINDOW, CHECKSUM::name, ROUTING::name,
+		(int)ROUTING::MAXHOPS, HEADER::name);
+    }
+
+private:
+    static inline thread_local unsigned char	txbuf[MAXFRAME];
+    static inline thread_local unsigned char	rxbuf[MAXFRAME];
+
+// ------------------------- DATALINK LAYER -------------------------
+
+    typedef struct {
+	int		kind;		// DL_DATA or DL_ACK
+	unsigned	seq;
+    } PENDING;
+
+    //  A QUEUE OF FRAMES AWAITING THE TRANSMITTER, WHICH GROWS AS NEEDED
+    class Pending {
+    public:
+	bool	 empty() const	{ return count == 0; }
+	PENDING &front()	{ return ring[head]; }
+	void	 pop_front()	{ head = (head + 1) & (cap-1); --count; }
+
+	void push_back(PENDING p)
+	{
+	    grow();
+	    ring[(head + count++) & (cap-1)]	= p;
+	}
+
+	void push_front(PENDING p)
+	{
+	    grow();
+	    head	= (head + cap - 1) & (cap-1);
+	    ring[head]	= p;
+	    ++count;
+	}
+
+    private:
+	std::vector<PENDING>	ring	= std::vector<PENDING>(16);
+	unsigned		cap	= 16, head = 0, count = 0;
+
+	void grow()
+	{
+	    if(count < cap)
+		return;
+	    std::vector<PENDING>	bigger(2*cap);
+
+	    for(unsigned i=0 ; i<count ; ++i)
+		bigger[i]	= ring[(head + i) & (cap-1)];
+	    ring.swap(bigger);
+	    head	= 0;
+	    cap		*= 2;
+	}
+    };
+
+    struct Link {
+	Stack		*stack;
+	int		number;
+	LINKARQ		arq;
+	Pending		out;			// frames to write
+	Buffer		held[QUEUELEN];		// packets awaiting the window
+	int		heldhead	= 0;
+	int		nheld		= 0;
+	CnetTime	busy_until	= 0;
+	CnetTimerID	txtimer		= NULLTIMER;
+	CnetTimerID	arqtimer	= NULLTIMER;
+	size_t		maxframe	= 0;
+
+	CnetTime txtime(size_t len) const
+	{
+	    return ((CnetTime)len * 8000000) / linkinfo[number].bandwidth;
+	}
+
+	CnetTime rto() const
+	{
+	    return 3 * (linkinfo[number].propagationdelay + txtime(maxframe));
+	}
+
+	void send(const char *packet, size_t len)
+	{
+	    if(nheld == 0 && !arq.full())
+		arq.send(*this, packet, len);
+	    else if(nheld == QUEUELEN)
+		++stack->stats.dl_dropped;
+	    else
+		held[(heldhead + nheld++) % QUEUELEN].set(packet, len);
+	}
+
+	//  CALLED BY THE ARQ POLICY
+	void transmit(int kind, unsigned seq)
+	{
+	    PENDING	p	= { kind, seq };
+
+	    if(kind == DL_DATA)
+		out.push_back(p);
+	    else if(LINKARQ::CUMULATIVE && !out.empty() &&
+					out.front().kind == DL_ACK)
+		out.front().seq	= seq;		// the later ACK covers both
+	    else
+		out.push_front(p);		// ACKs overtake waiting DATA
+	    pump();
+	}
+
+	void deliver(char *packet, size_t len)
+	{
+	    stack->up_to_network(packet, len, number);
+	}
+
+	void acked(int outstanding)
+	{
+	    if(arqtimer != NULLTIMER) {
+		CNET_stop_timer(arqtimer);
+		arqtimer	= NULLTIMER;
+	    }
+	    if(outstanding > 0)
+		arqtimer	= CNET_start_timer(EV_TIMER1, rto(),
+						   (CnetData)this);
+	    while(nheld > 0 && !arq.full()) {
+		Buffer	&b	= held[heldhead];
+
+		heldhead	= (heldhead + 1) % QUEUELEN;
+		--nheld;
+		arq.send(*this, b.data, b.len);
+	    }
+	}
+
+	//  WRITE THE NEXT FRAME, IF THE LINK IS FREE, ELSE WAIT UNTIL IT IS
+	void pump()
+	{
+	    CnetTime	now	= nodeinfo.time_in_usec;
+
+	    while(!out.empty() && busy_until <= now) {
+		PENDING	p	= out.front();
+
+		out.pop_front();
+		write(p, now);
+	    }
+	    if(!out.empty() && txtimer == NULLTIMER)
+		txtimer	= CNET_start_timer(EV_TIMER3, busy_until - now,
+					   (CnetData)this);
+	}
+
+	void write(PENDING p, CnetTime now)
+	{
+	    DLHEADER	h	= { p.kind, p.seq, 0 };
+	    const char	*packet	= nullptr;
+	    size_t	len;
+
+	    if(p.kind == DL_DATA &&
+			(packet = arq.payload(p.seq, &h.len)) == nullptr)
+		return;				// acknowledged while queued
+	    HEADER::put_dl(txbuf, h);
+	    if(h.len > 0)
+		memcpy(txbuf + HEADER::DLSIZE, packet, h.len);
+	    len	= HEADER::DLSIZE + h.len;
+	    put_checksum<CHECKSUM>(txbuf + len, CHECKSUM::sum(txbuf, len));
+	    len	+= CHECKSUM::SIZE;
+
+	    if(CNET_write_physical(number, txbuf, &len) != 0) {
+		if(cnet_errno != ER_TOOBUSY)
+		    CNET_exit(__FILE__, __func__, __LINE__);
+		out.push_front(p);		// our clock and cnet's disagree
+		busy_until	= now + 1;
+		return;
+	    }
+	    busy_until	= now + txtime(len);
+	    if(p.kind == DL_DATA) {
+		if(len > maxframe)
+		    maxframe	= len;
+		if(arqtimer == NULLTIMER)
+		    arqtimer	= CNET_start_timer(EV_TIMER1, rto(),
+						   (CnetData)this);
+	    }
+	}
+    };
+
+    std::vector<Link>	links;			// [0..nlinks]
+
+    static EVENT_HANDLER(up_to_datalink)
+    {
+	Stack		*s	= (Stack *)data;
+	DLHEADER	h;
+	size_t		len	= MAXFRAME;
+	int		link;
+
+	CHECK(CNET_read_physical(&link, rxbuf, &len));
+	if(len < HEADER::DLSIZE + CHECKSUM::SIZE)
+	    return;
+	len	-= CHECKSUM::SIZE;
+	if(get_checksum<CHECKSUM>(rxbuf + len) != CHECKSUM::sum(rxbuf, len) ||
+	   !HEADER::get_dl(rxbuf, len - HEADER::DLSIZE, h)) {
+	    ++s->stats.dl_corrupted;
+	    return;
+	}
+
+	Link	&l	= s->links[link];
+
+	if(h.kind == DL_ACK)
+	    l.arq.ack(l, h.seq);
+	else if(h.len >= HEADER::NLSIZE)
+	    l.arq.data(l, h.seq, (char *)rxbuf + HEADER::DLSIZE, h.len);
+    }
+
+    static EVENT_HANDLER(datalink_timeout)
+    {
+	Link	*l	= (Link *)data;
+
+	l->arqtimer	= NULLTIMER;
+	++l->stack->stats.dl_retransmitted;
+	l->arq.timeout(*l);
+    }
+
+    static EVENT_HANDLER(link_ready)
+    {
+	Link	*l	= (Link *)data;
+
+	l->txtimer	= NULLTIMER;
+	l->pump();
+    }
+
+// ------------------------- NETWORK LAYER --------------------------
+
+    struct Peer {				// another node, by its address
+	Stack		*stack;
+	CnetAddr	address;
+
+	bool		busy		= false;	// awaiting an NL_ACK
+	unsigned	nextseq		= 0;
+	unsigned	attempt		= 0;
+	Buffer		packet;				// awaiting its NL_ACK
+	CnetTimerID	timer		= NULLTIMER;
+	CnetTime	sent		= 0;
+	CnetTime	srtt		= 0;
+	CnetTime	rttvar		= 0;
+	CnetTime	rto		= NL_RTO;
+
+	unsigned	expected	= 0;		// from this peer
+	unsigned	lastattempt	= 0;		// of the last acknowledged
+    };
+
+    ROUTING				routing;
+    std::unordered_map<CnetAddr, Peer>	peers;
+
+    Stack() : links(nodeinfo.nlinks + 1)
+    {
+	for(int l=0 ; l<=nodeinfo.nlinks ; ++l) {
+	    links[l].stack	= this;
+	    links[l].number	= l;
+	}
+    }
+
+    Peer &peer(CnetAddr address)
+    {
+	Peer	&p	= peers[address];
+
+	p.stack		= this;
+	p.address	= address;
+	return p;
+    }
+
+    void route(char *packet, size_t len, CnetAddr dest, int arrived)
+    {
+	routing.route(dest, arrived, [&](int link) {
+	    links[link].send(packet, len);
+	});
+    }
+
+    static EVENT_HANDLER(down_to_network)
+    {
+	Stack		*s	= (Stack *)data;
+	unsigned char	*packet	= txbuf + HEADER::DLSIZE;
+	NLHEADER	h;
+	size_t		len	= MAX_MESSAGE_SIZE;
+
+	CHECK(CNET_read_application(&h.dest, packet + HEADER::NLSIZE, &len));
+	CHECK(CNET_disable_application(h.dest));
+
+	Peer	&p	= s->peer(h.dest);
+
+	h.kind		= NL_DATA;
+	h.src		= nodeinfo.address;
+	h.seq		= p.nextseq;
+	h.attempt	= 0;
+	h.hops		= 0;
+	HEADER::put_nl(packet, h);
+	len		+= HEADER::NLSIZE;
+
+	p.busy		= true;
+	p.attempt	= 0;
+	p.sent		= nodeinfo.time_in_usec;
+	p.packet.set((char *)packet, len);
+	p.timer		= CNET_start_timer(EV_TIMER2, p.rto, (CnetData)&p);
+	s->route(p.packet.data, len, h.dest, 0);
+    }
+
+    static EVENT_HANDLER(network_timeout)
+    {
+	Peer		*p	= (Peer *)data;
+	NLHEADER	h;
+
+	p->timer	= NULLTIMER;
+	if(!p->busy)
+	    return;
+	++p->stack->stats.nl_retransmitted;
+	p->attempt	= (p->attempt + 1) % HEADER::ATTEMPTMOD;
+	HEADER::get_nl((unsigned char *)p->packet.data, h);
+	h.attempt	= p->attempt;
+	HEADER::put_nl((unsigned char *)p->packet.data, h);
+
+	p->rto		= (2 * p->rto < NL_MAXRTO) ? 2 * p->rto : NL_MAXRTO;
+	p->timer	= CNET_start_timer(EV_TIMER2, p->rto, (CnetData)p);
+	p->stack->route(p->packet.data, p->packet.len, p->address, 0);
+    }
+
+    void send_ack(const NLHEADER &data)
+    {
+	unsigned char	ack[HEADER::NLSIZE];
+	NLHEADER	h	= { NL_ACK, nodeinfo.address, data.src,
+				    data.seq, data.attempt, 0 };
+
+	HEADER::put_nl(ack, h);
+	route((char *)ack, sizeof(ack), h.dest, 0);
+    }
+
+    void ack_received(const NLHEADER &h)
+    {
+	Peer	&p	= peer(h.src);
+
+	if(!p.busy || h.seq != p.nextseq)
+	    return;
+	if(h.attempt == 0) {			// only unambiguous samples
+	    CnetTime	rtt	= nodeinfo.time_in_usec - p.sent;
+
+	    if(p.srtt == 0) {
+		p.srtt		= rtt;
+		p.rttvar	= rtt / 2;
+	    }
+	    else {
+		CnetTime	err	= rtt - p.srtt;
+
+		p.srtt		+= err / 8;
+		p.rttvar	+= ((err < 0 ? -err : err) - p.rttvar) / 4;
+	    }
+	}
+	if(p.srtt > 0)
+	    p.rto	= p.srtt + 4 * p.rttvar;
+	CNET_stop_timer(p.timer);
+	p.timer		= NULLTIMER;
+	p.busy		= false;
+	p.nextseq	= (p.nextseq + 1) % HEADER::NLSEQMOD;
+	CHECK(CNET_enable_application(h.src));
+    }
+
+    void up_to_network(char *packet, size_t len, int arrived)
+    {
+	NLHEADER	h;
+
+	HEADER::get_nl((unsigned char *)packet, h);
+	++h.hops;				// took 1 hop to get here
+	routing.learn(h.src, h.hops, arrived);
+
+	if(h.dest != nodeinfo.address) {	// for someone else
+	    if(h.hops < ROUTING::MAXHOPS) {
+		HEADER::put_nl((unsigned char *)packet, h);
+		route(packet, len, h.dest, arrived);
+	    }
+	    return;
+	}
+	if(h.kind == NL_ACK) {
+	    ack_received(h);
+	    return;
+	}
+
+	Peer	&p	= peer(h.src);
+
+	if(h.seq == p.expected) {
+	    size_t	msglen	= len - HEADER::NLSIZE;
+
+	    CHECK(CNET_write_application(packet + HEADER::NLSIZE, &msglen));
+	    p.expected		= (p.expected + 1) % HEADER::NLSEQMOD;
+	    p.lastattempt	= h.attempt;
+	    send_ack(h);
+	}
+	//  A COPY OF A RETRANSMISSION IS ANSWERED, BUT NOT EVERY FLOODED COPY
+	else if(h.seq == (p.expected + HEADER::NLSEQMOD - 1) %
+			    HEADER::NLSEQMOD && h.attempt != p.lastattempt) {
+	    p.lastattempt	= h.attempt;
+	    send_ack(h);
+	}
+    }
+};
+
+#endif
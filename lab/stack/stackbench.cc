@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "stack.h"
+#include "stacksim.h"
+
+/*  stackbench RUNS EVERY CONFIGURATION OF THE LAYERED STACK IN stack.h ON
+    ONE TOPOLOGY, WITH cnetsim's SIMULATOR, AND PRINTS ONE LINE OF JSON
+    FOR EACH, GIVING ITS DELIVERIES, EFFICIENCY AND CPU COST:
+
+	stackbench [-e seconds] [-S seed] [-c substring] [-o file.json] TOPOLOGY
+
+    Every configuration is compiled into this program, and each is run in
+    a process of its own, with the same seed, so all are offered the same
+    messages.  The topology's compile attribute is ignored, and with -c
+    only the configurations whose names contain substring are run.
+ */
+
+#ifndef	MAXHOPS
+#define	MAXHOPS		4		// may be given with -D
+#endif
+
+template <class... T> struct List {};
+
+template <template <int, unsigned> class A, int W>
+struct Arq {};				// an ARQ policy, with its window
+
+typedef List<Arq<StopAndWait, 1>,
+	     Arq<GoBackN, 4>, Arq<GoBackN, 16>,
+	     Arq<SelectiveRepeat, 4>, Arq<SelectiveRepeat, 16> >	ARQS;
+typedef List<CCITT, CRC32, Internet16>					CHECKSUMS;
+typedef List<Flooding<MAXHOPS>, ReversePath<MAXHOPS> >			ROUTINGS;
+typedef List<WideHeader, PackedHeader>					HEADERS;
+
+static	FILE		*out;
+static	const char	*topofile;
+static	const char	*only		= NULL;
+static	CnetTime	duration	= 600000000;	// 10 minutes
+static	uint64_t	seed		= 1;
+
+// -----------------------------------------------------------------
+
+template <class STACK>
+static void report(const char *name, const STACKSIMSTATS *st)
+{
+    STACKSTATS	s	= {};
+
+    for(STACK *n : STACK::nodes) {
+	s.dl_retransmitted	+= n->stats.dl_retransmitted;
+	s.dl_dropped		+= n->stats.dl_dropped;
+	s.dl_corrupted		+= n->stats.dl_corrupted;
+	s.nl_retransmitted	+= n->stats.nl_retransmitted;
+    }
+    fprintf(out, "{\"config\": \"%s\", \"generated\": %lld, "
+		 "\"delivered\": %lld, \"avg_delivery_us\": %lld, "
+		 "\"efficiency\": %.2f, \"frames_tx\": %lld, "
+		 "\"dl_retransmitted\": %lld, \"dl_dropped\": %lld, "
+		 "\"dl_corrupted\": %lld, \"nl_retransmitted\": %lld, "
+		 "\"events\": %lld, \"cpu_secs\": %.3f, "
+		 "\"ns_per_event\": %.1f}\n",
+	    name, (long long)st->msgs_generated,
+	    (long long)st->msgs_delivered,
+	    (long long)(st->msgs_delivered ?
+			st->delivery_time / st->msgs_delivered : 0),
+	    st->framebytes_tx ?
+			100.0 * st->msgbytes_delivered / st->framebytes_tx : 0.0,
+	    (long long)st->frames_tx,
+	    (long long)s.dl_retransmitted, (long long)s.dl_dropped,
+	    (long long)s.dl_corrupted, (long long)s.nl_retransmitted,
+	    (long long)st->events, st->cpusecs,
+	    st->events ? st->cpusecs * 1e9 / st->events : 0.0);
+}
+
+template <class A, class C, class R, class H> struct Run;
+
+template <template <int, unsigned> class A, int W, class C, class R, class H>
+struct Run<Arq<A, W>, C, R, H> {
+    typedef Stack<A, W, C, R, H>	STACK;
+
+    static void run()
+    {
+	STACKSIMSTATS	st;
+	char		name[64];
+	pid_t		pid;
+	int		status;
+
+	STACK::name(name, sizeof(name));
+	if(only != NULL && strstr(name, only) == NULL)
+	    return;
+	fflush(out);
+	if((pid = fork()) == 0) {
+	    if(stacksim_run(topofile, seed, duration, STACK::reboot, &st) != 0)
+		_exit(EXIT_FAILURE);
+	    report<STACK>(name, &st);
+	    fflush(out);
+	    _exit(EXIT_SUCCESS);
+	}
+	if(pid < 0 || waitpid(pid, &status, 0) != pid ||
+	   !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	    fprintf(stderr, "stackbench: %s failed\n", name);
+    }
+};
+
+//  EVERY COMBINATION OF ONE POLICY FROM EACH LIST
+template <class A, class C, class R, class... H>
+static void each_header(List<H...>)	{ (Run<A, C, R, H>::run(), ...); }
+
+template <class A, class C, class... R>
+static void each_routing(List<R...>)	{ (each_header<A, C, R>(HEADERS()), ...); }
+
+template <class A, class... C>
+static void each_checksum(List<C...>)	{ (each_routing<A, C>(ROUTINGS()), ...); }
+
+template <class... A>
+static void each_arq(List<A...>)	{ (each_checksum<A>(CHECKSUMS()), ...); }
+
+// -----------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    int		opt;
+
+    out		= stdout;
+    while((opt = getopt(argc, argv, "c:e:o:S:")) != -1) {
+	switch (opt) {
+	case 'c' :	only		= optarg;			break;
+	case 'e' :	duration	= (CnetTime)(atof(optarg) * 1e6); break;
+	case 'S' :	seed		= strtoull(optarg, NULL, 0);	break;
+	case 'o' :
+	    if((out = fopen(optarg, "a")) == NULL) {
+		perror(optarg);
+		exit(EXIT_FAILURE);
+	    }
+	    break;
+	default :
+	    optind	= argc;
+	    break;
+	}
+    }
+    if(optind != argc-1) {
+	fprintf(stderr, "Usage: %s [-e seconds] [-S seed] [-c substring] "
+			"[-o file.json] TOPOLOGY\n", argv[0]);
+	exit(EXIT_FAILURE);
+    }
+    topofile	= argv[optind];
+    each_arq(ARQS());
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../cnetsim/cnetsim.h"
+#include "stacksim.h"
+
+/*  THIS FILE RUNS A TOPOLOGY ON cnetsim's SIMULATOR, WITH A PROTOCOL THAT
+    IS LINKED INTO THIS PROGRAM RATHER THAN COMPILED AND LOADED FOR EACH
+    NODE, SO ITS NODES SHARE ONE COPY OF ITS CODE AND MUST KEEP THEIR STATE
+    IN OBJECTS OF THEIR OWN (AS ../stack/stack.h DOES).  THE SIMULATOR
+    CANNOT BE RESET, SO A PROGRAM RUNNING SEVERAL PROTOCOLS RUNS EACH IN A
+    PROCESS OF ITS OWN.
+ */
+
+//  THE PARTS OF cnetsim.c's STATE THAT ITS API NEEDS
+NODE		*sim_nodes	= NULL;
+int		sim_nnodes	= 0;
+CnetTime	sim_duration	= 0;
+CnetTime	sim_period	= 0;
+bool		sim_showstats	= false;
+
+void sim_report(CnetTime now)
+{
+}
+
+static double cputime(void)
+{
+    struct timespec	ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int stacksim_run(const char *topofile, uint64_t seed, CnetTime duration,
+		 void (*reboot)(CnetEvent, CnetTimerID, CnetData),
+		 STACKSIMSTATS *st)
+{
+    TOPOLOGY	topo;
+    double	started;
+
+    if(topo_read(topofile, &topo) != 0)
+	return -1;
+    sim_makenodes(&topo, seed);
+    topo_free(&topo);
+    for(int i=0 ; i<sim_nnodes ; ++i)
+	sim_nodes[i].reboot	= reboot;
+
+    sim_duration	= duration;
+    sim_ccitt_init();
+    sim_partition(1);
+    sim_boot();
+
+    memset(st, 0, sizeof(STACKSIMSTATS));
+    started	= cputime();
+    st->events	= sim_run();
+    st->cpusecs	= cputime() - started;
+
+    for(int i=0 ; i<sim_nnodes ; ++i) {
+	STATS	*s	= &sim_nodes[i].stats;
+
+	st->msgs_generated	+= s->msgs_generated;
+	st->msgs_delivered	+= s->msgs_delivered;
+	st->msgbytes_delivered	+= s->msgbytes_delivered;
+	st->delivery_time	+= s->delivery_time;
+	st->frames_tx		+= s->frames_tx;
+	st->framebytes_tx	+= s->framebytes_tx;
+	st->frames_corrupted	+= s->frames_corrupted;
+	st->frames_lost		+= s->frames_lost;
+    }
+    return 0;
+}
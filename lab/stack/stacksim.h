@@ -0,0 +1,35 @@
+#ifndef _STACKSIM_H
+#define _STACKSIM_H
+
+#include <cnet.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/* ------- RUNNING A PROTOCOL LINKED INTO THIS PROGRAM WITH cnetsim -------- */
+
+typedef struct {
+    int64_t	events;
+    int64_t	msgs_generated;
+    int64_t	msgs_delivered;
+    int64_t	msgbytes_delivered;
+    int64_t	delivery_time;		// total, usecs
+    int64_t	frames_tx;
+    int64_t	framebytes_tx;
+    int64_t	frames_corrupted;
+    int64_t	frames_lost;
+    double	cpusecs;		// of the simulation alone
+} STACKSIMSTATS;
+
+//  RUN topofile FOR duration, EVERY NODE BOOTING WITH reboot, ONCE ONLY
+extern	int	stacksim_run(const char *topofile, uint64_t seed,
+			CnetTime duration,
+			void (*reboot)(CnetEvent, CnetTimerID, CnetData),
+			STACKSIMSTATS *stats);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif